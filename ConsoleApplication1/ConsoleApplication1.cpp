@@ -4,14 +4,132 @@
 #include <random>
 #include <algorithm>
 #include <float.h>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#include <climits>
+#include <chrono>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <tuple>
+
+#if defined(_WIN32)
+// Пиковая память процесса без windows.h (конфликтует с raylib.h)
+struct ProcessMemoryCounters {
+    unsigned long cb;
+    unsigned long pageFaultCount;
+    size_t peakWorkingSetSize;
+    size_t workingSetSize;
+    size_t quotaPeakPagedPoolUsage;
+    size_t quotaPagedPoolUsage;
+    size_t quotaPeakNonPagedPoolUsage;
+    size_t quotaNonPagedPoolUsage;
+    size_t pagefileUsage;
+    size_t peakPagefileUsage;
+};
+extern "C" __declspec(dllimport) void* __stdcall GetCurrentProcess(void);
+extern "C" __declspec(dllimport) int __stdcall K32GetProcessMemoryInfo(void* process, ProcessMemoryCounters* counters, unsigned long size);
+
+// UDP без winsock2.h (тянет windows.h)
+#pragma comment(lib, "ws2_32.lib")
+typedef size_t NetSocketHandle;                 // SOCKET
+const NetSocketHandle INVALID_NET_SOCKET = ~(size_t)0;
+struct sockaddr;
+struct NetAddress {                             // sockaddr_in
+    short family;
+    unsigned short port;
+    unsigned int address;
+    char zero[8];
+};
+struct WinsockData {                            // WSADATA с запасом
+    char data[512];
+};
+extern "C" __declspec(dllimport) int __stdcall WSAStartup(unsigned short version, WinsockData* data);
+extern "C" __declspec(dllimport) NetSocketHandle __stdcall socket(int family, int type, int protocol);
+extern "C" __declspec(dllimport) int __stdcall bind(NetSocketHandle socket, const void* address, int length);
+extern "C" __declspec(dllimport) int __stdcall getsockname(NetSocketHandle socket, void* address, int* length);
+extern "C" __declspec(dllimport) int __stdcall sendto(NetSocketHandle socket, const char* data, int size, int flags, const void* address, int length);
+extern "C" __declspec(dllimport) int __stdcall recvfrom(NetSocketHandle socket, char* data, int size, int flags, void* address, int* length);
+extern "C" __declspec(dllimport) int __stdcall ioctlsocket(NetSocketHandle socket, long command, unsigned long* argument);
+extern "C" __declspec(dllimport) int __stdcall closesocket(NetSocketHandle socket);
+const int NET_AF_INET = 2;
+const int NET_SOCK_DGRAM = 2;
+const long NET_FIONBIO = (long)0x8004667E;
+
+// Отображение файла в память
+extern "C" __declspec(dllimport) void* __stdcall CreateFileA(const char* name, unsigned long access, unsigned long share, void* security,
+    unsigned long disposition, unsigned long flags, void* templateFile);
+extern "C" __declspec(dllimport) int __stdcall GetFileSizeEx(void* file, long long* size);
+extern "C" __declspec(dllimport) void* __stdcall CreateFileMappingA(void* file, void* security, unsigned long protect,
+    unsigned long sizeHigh, unsigned long sizeLow, const char* name);
+extern "C" __declspec(dllimport) void* __stdcall MapViewOfFile(void* mapping, unsigned long access, unsigned long offsetHigh,
+    unsigned long offsetLow, size_t size);
+extern "C" __declspec(dllimport) int __stdcall UnmapViewOfFile(const void* address);
+extern "C" __declspec(dllimport) int __stdcall CloseHandle(void* handle);
+const unsigned long WIN_GENERIC_READ = 0x80000000ul;
+const unsigned long WIN_FILE_SHARE_READ = 1;
+const unsigned long WIN_OPEN_EXISTING = 3;
+const unsigned long WIN_FILE_ATTRIBUTE_NORMAL = 0x80;
+const unsigned long WIN_PAGE_READONLY = 2;
+const unsigned long WIN_FILE_MAP_READ = 4;
+#else
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+typedef int NetSocketHandle;
+const NetSocketHandle INVALID_NET_SOCKET = -1;
+typedef sockaddr_in NetAddress;
+#if defined(__linux__)
+#include <sys/inotify.h>
+#include <poll.h>
+#endif
+#endif
 #include "raylib.h"
+#include "rlgl.h"
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <xmmintrin.h>
+#define PARTICLES_USE_SSE 1
+#else
+#define PARTICLES_USE_SSE 0
+#endif
+
+// Счетчики горячих путей (0 - вырезаются при компиляции)
+#ifndef ENABLE_STATS
+#define ENABLE_STATS 1
+#endif
 
 // Константы игры
 const int TARGET_FPS = 60;
 
+// Такт симуляции: игра идет целыми тиками фиксированной длины независимо от частоты кадров
+const int SIM_TICK_RATE = 60;
+const double SIM_TICK_SECONDS = 1.0 / SIM_TICK_RATE;
+const int MAX_TICKS_PER_FRAME = 6;  // Больше за кадр не догоняем (отставание отбрасывается)
+
 // Множитель размера (увеличиваем на 40%)
 const float SIZE_MULTIPLIER = 1.4f;
 
+// Размер мира (мир больше экрана, камера следует за игроком)
+const float WORLD_WIDTH = 8000.0f;
+const float WORLD_HEIGHT = 8000.0f;
+
+// Пространственные чанки
+const float CHUNK_SIZE = 512.0f;
+const int COARSE_TICK_INTERVAL = 8; // Дальние чанки обновляются раз в N кадров
+
+// Уровни детализации врагов
+const int LOD_REDUCED_INTERVAL = 4;        // Враги за экраном в активных чанках обновляются раз в N кадров
+const float LOD_PROMOTION_MARGIN = 200.0f; // Запас вокруг экрана, в котором враг уже получает полное обновление
+
 // Цвета
 const Color COLOR_PLAYER = BLUE;
 const Color COLOR_GREEN_ENEMY = GREEN;
@@ -43,6 +161,12 @@ const Color COLOR_FIREBALL = { 255, 69, 0, 255 };
 const Color COLOR_FIREBALL_EXPLOSION = { 255, 140, 0, 150 };
 const Color COLOR_PROJECTILE_COUNT = { 255, 215, 0, 255 }; // Золотой цвет для улучшения количества снарядов
 
+// Бюджет частиц: эффекты не должны занимать весь кадр
+const int MAX_PARTICLES = 8192;
+const int MAX_PARTICLE_SPAWNS_PER_FRAME = 1024;
+const int PARTICLE_DRAW_CHUNK = 1024;   // Частиц за один rlBegin/rlEnd
+const float PARTICLE_DRAG = 3.0f;       // Затухание скорости в секунду
+
 // Состояния игры
 enum GameState {
     MAIN_MENU,
@@ -115,6 +239,238 @@ struct MetaProgression {
     }
 };
 
+// Учет памяти по подсистемам
+// Все игровые контейнеры выделяют память через TaggedAllocator со своей меткой;
+// живые байты, пик и число выделений считаются атомарно (контейнеры растут и в рабочих потоках)
+enum MemoryTag {
+    MEM_ENEMIES,   // Враги, их снаряды, чанки, расписание волн
+    MEM_BULLETS,
+    MEM_EFFECTS,   // Способности, улучшения на карте, частицы
+    MEM_EVENTS,
+    MEM_UI,        // Подписи меню
+    MEM_SYSTEMS,   // Планировщик систем
+    MEM_COUNT
+};
+
+const char* MEMORY_TAG_NAMES[MEM_COUNT] = { "enemies", "bullets", "effects", "events", "ui text", "systems" };
+
+struct MemoryTagStats {
+    std::atomic<long long> liveBytes;
+    std::atomic<long long> peakBytes;
+    std::atomic<long long> allocations;
+    std::atomic<long long> frees;
+};
+
+MemoryTagStats memoryStats[MEM_COUNT];
+
+void TrackAllocation(MemoryTag tag, size_t bytes) {
+    MemoryTagStats& stats = memoryStats[tag];
+    long long live = stats.liveBytes.fetch_add((long long)bytes) + (long long)bytes;
+    long long peak = stats.peakBytes.load();
+    while (live > peak && !stats.peakBytes.compare_exchange_weak(peak, live)) {
+    }
+    stats.allocations.fetch_add(1);
+}
+
+void TrackFree(MemoryTag tag, size_t bytes) {
+    memoryStats[tag].liveBytes.fetch_sub((long long)bytes);
+    memoryStats[tag].frees.fetch_add(1);
+}
+
+long long GetMemoryLiveBytes(MemoryTag tag) {
+    return memoryStats[tag].liveBytes.load();
+}
+
+long long GetMemoryPeakBytes(MemoryTag tag) {
+    return memoryStats[tag].peakBytes.load();
+}
+
+void PrintMemoryReport(FILE* file) {
+    for (int tag = 0; tag < MEM_COUNT; tag++) {
+        const MemoryTagStats& stats = memoryStats[tag];
+        fprintf(file, "memory %-8s live %10.1f KB  peak %10.1f KB  allocations %8lld  frees %8lld\n", MEMORY_TAG_NAMES[tag],
+            stats.liveBytes.load() / 1024.0, stats.peakBytes.load() / 1024.0, stats.allocations.load(), stats.frees.load());
+    }
+}
+
+template <typename T, MemoryTag tag>
+struct TaggedAllocator {
+    typedef T value_type;
+
+    template <typename U>
+    struct rebind {
+        typedef TaggedAllocator<U, tag> other;
+    };
+
+    TaggedAllocator() {}
+
+    template <typename U>
+    TaggedAllocator(const TaggedAllocator<U, tag>&) {}
+
+    T* allocate(size_t count) {
+        TrackAllocation(tag, count * sizeof(T));
+        return static_cast<T*>(::operator new(count * sizeof(T)));
+    }
+
+    void deallocate(T* pointer, size_t count) {
+        TrackFree(tag, count * sizeof(T));
+        ::operator delete(pointer);
+    }
+};
+
+template <typename T, typename U, MemoryTag tag>
+bool operator==(const TaggedAllocator<T, tag>&, const TaggedAllocator<U, tag>&) { return true; }
+
+template <typename T, typename U, MemoryTag tag>
+bool operator!=(const TaggedAllocator<T, tag>&, const TaggedAllocator<U, tag>&) { return false; }
+
+template <typename T, MemoryTag tag>
+using TaggedVector = std::vector<T, TaggedAllocator<T, tag>>;
+
+// Сжатие емкости: только если она в COMPACT_SLACK раз больше нужной (живые элементы или
+// keep - ожидаемый размер), иначе перевыделение посреди игры не окупается.
+// Новый буфер сразу берется под keep, чтобы следом не расти заново
+const size_t COMPACT_SLACK = 4;
+const size_t COMPACT_MIN_CAPACITY = 256;
+
+template <typename Vector>
+void CompactVector(Vector& vector, size_t keep) {
+    size_t needed = std::max(vector.size(), keep);
+    if (vector.capacity() <= std::max(needed * COMPACT_SLACK, COMPACT_MIN_CAPACITY)) return;
+
+    Vector compacted;
+    compacted.reserve(needed);
+    compacted.assign(vector.begin(), vector.end());
+    vector.swap(compacted);
+}
+
+// Метка пула компонентов по типу компонента (задается рядом с объявлением типа)
+template <typename T>
+struct MemoryTagOf;
+
+// Хранилище компонентов
+// Компоненты одного вида лежат плотным массивом (итерация без пропусков), а ссылки
+// между сущностями идут через стабильные дескрипторы: индекс слота + поколение.
+// Удаление переносит последний элемент на место удаленного и увеличивает поколение слота,
+// поэтому старый дескриптор перестает быть действительным
+struct EntityHandle {
+    unsigned int slot;
+    unsigned int generation;  // 0 - пустой дескриптор
+};
+
+template <typename T>
+struct ComponentPool {
+    static const MemoryTag tag = MemoryTagOf<T>::value;
+    typedef TaggedVector<T, tag> DenseArray;
+    typedef TaggedVector<unsigned int, tag> SlotArray;
+    typedef typename DenseArray::iterator iterator;
+    typedef typename DenseArray::const_iterator const_iterator;
+
+    DenseArray dense;                         // Компоненты без пропусков
+    SlotArray denseSlot;                      // Плотный индекс -> слот
+    SlotArray slotIndex;                      // Слот -> плотный индекс
+    SlotArray slotGeneration;                 // Текущее поколение слота
+    SlotArray freeSlots;
+
+    EntityHandle push_back(const T& component) {
+        unsigned int slot;
+        if (!freeSlots.empty()) {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        else {
+            slot = (unsigned int)slotGeneration.size();
+            slotGeneration.push_back(1);
+            slotIndex.push_back(0);
+        }
+
+        slotIndex[slot] = (unsigned int)dense.size();
+        denseSlot.push_back(slot);
+        dense.push_back(component);
+        return { slot, slotGeneration[slot] };
+    }
+
+    // Возвращает итератор на элемент, перенесенный на место удаленного,
+    // поэтому циклы вида it = pool.erase(it) продолжают работать
+    iterator erase(iterator it) {
+        size_t index = it - dense.begin();
+        RemoveAt(index);
+        return dense.begin() + index;
+    }
+
+    void RemoveAt(size_t index) {
+        unsigned int slot = denseSlot[index];
+        slotGeneration[slot]++;
+        freeSlots.push_back(slot);
+
+        size_t last = dense.size() - 1;
+        if (index != last) {
+            dense[index] = std::move(dense[last]);
+            denseSlot[index] = denseSlot[last];
+            slotIndex[denseSlot[index]] = (unsigned int)index;
+        }
+        dense.pop_back();
+        denseSlot.pop_back();
+    }
+
+    bool Remove(EntityHandle handle) {
+        if (!IsAlive(handle)) return false;
+        RemoveAt(slotIndex[handle.slot]);
+        return true;
+    }
+
+    bool IsAlive(EntityHandle handle) const {
+        return handle.slot < slotGeneration.size() && slotGeneration[handle.slot] == handle.generation;
+    }
+
+    T* Get(EntityHandle handle) {
+        return IsAlive(handle) ? &dense[slotIndex[handle.slot]] : nullptr;
+    }
+
+    const T* Get(EntityHandle handle) const {
+        return IsAlive(handle) ? &dense[slotIndex[handle.slot]] : nullptr;
+    }
+
+    EntityHandle HandleAt(size_t index) const {
+        unsigned int slot = denseSlot[index];
+        return { slot, slotGeneration[slot] };
+    }
+
+    void clear() {
+        for (unsigned int slot : denseSlot) {
+            slotGeneration[slot]++;
+            freeSlots.push_back(slot);
+        }
+        dense.clear();
+        denseSlot.clear();
+    }
+
+    // Емкость под count живых компонентов без перевыделений: плотные массивы и таблицы слотов
+    void reserve(size_t count) {
+        dense.reserve(count);
+        denseSlot.reserve(count);
+        slotIndex.reserve(count);
+        slotGeneration.reserve(count);
+        freeSlots.reserve(count);
+    }
+
+    // Возврат лишней емкости плотных массивов (таблица слотов остается: на нее ссылаются дескрипторы)
+    void compact(size_t keep) {
+        CompactVector(dense, keep);
+        CompactVector(denseSlot, keep);
+        CompactVector(freeSlots, 0);
+    }
+
+    size_t size() const { return dense.size(); }
+    bool empty() const { return dense.empty(); }
+    T& operator[](size_t index) { return dense[index]; }
+    const T& operator[](size_t index) const { return dense[index]; }
+    iterator begin() { return dense.begin(); }
+    iterator end() { return dense.end(); }
+    const_iterator begin() const { return dense.begin(); }
+    const_iterator end() const { return dense.end(); }
+};
+
 // Переименованная структура волны
 struct Shockwave {
     Vector2 position;
@@ -122,13 +478,15 @@ struct Shockwave {
     Vector2 direction;
     float speed;
     int damage;
+    Vector2 sweptPosition;     // Фронт на прошлом запросе области (sweptRadius = 0 - запросов не было)
+    float sweptRadius;
     bool active;
 };
 
 // Структура бомбы
 struct Bomb {
     Vector2 position;
-    float timer;
+    unsigned int explodeTick;  // Тик взрыва (для мигания перед взрывом)
     float explosionRadius;
     int damage;
     bool active;
@@ -139,8 +497,7 @@ struct Bomb {
 struct FreezeArea {
     Vector2 position;
     float radius;
-    float duration;
-    float timer;
+    unsigned int expireTick;   // Тик исчезновения области (до него враги в ней заморожены)
     bool active;
 };
 
@@ -153,9 +510,263 @@ struct Fireball {
     float explosionRadius;
     bool active;
     bool exploded;
-    float explosionTimer;
+    bool detonated;   // Урон взрыва уже нанесен (взрыв висит на экране до TIMER_FIREBALL_CLEAR)
+};
+
+// Настройки баланса
+// Все числа баланса в одной плоской структуре. Файл настроек читается целиком в новую
+// структуру (с умолчаниями для отсутствующих ключей), которая после публикации не меняется;
+// главный поток подменяет указатель между тиками, поэтому тик видит настройки целиком
+// старыми или целиком новыми. Горячие пути читают поля напрямую, без поиска по именам
+struct EnemyTuning {
+    float speed;
+    int health;
+    int damage;
+    float attackRange;
+};
+
+struct TuningConfig {
+    // Игрок
+    float playerRadius;
+    float playerSpeed;
+    int playerHealth;
+    int playerDamage;
+    float playerAttackSpeed;
+    float bulletSpeed;
+    float bulletRadius;
+    float bulletSpread;             // Угол между снарядами веера (радианы)
+
+    // Способности
+    double waveCooldown;
+    int waveDamage;
+    float waveStartRadius;
+    float waveSpeed;
+    float waveTargetRange;          // Волна летит к центру врагов в этом радиусе
+    double bombCooldown;
+    double bombFuse;
+    int bombDamage;
+    float bombRadius;
+    double freezeCooldown;
+    float freezeDuration;
+    float freezeRadius;
+    double fireballCooldown;
+    int fireballDamage;
+    float fireballExplosionRadius;
+    float fireballSpeed;
+    float fireballRadius;
+
+    // Эффекты состояний
+    float slowSpeedScale;           // Множитель скорости замедленного врага
+    double thawSlowDuration;        // Замедление после оттаивания (с)
+    int burnDamage;                 // Урон горения за STATUS_DOT_INTERVAL
+    double burnDuration;
+    int poisonDamage;               // Урон яда за STATUS_DOT_INTERVAL
+    double poisonDuration;
+
+    // Улучшения в забеге
+    int upgradeMaxHealth;
+    int upgradeHeal;
+    float upgradeAttackSpeed;
+    int upgradeDamage;
+    float upgradeSpeed;
+    float upgradeCooldownFactor;    // Множитель перезарядки при повторном подборе способности
+    double waveMinCooldown;
+    int upgradeWaveDamage;
+    double bombMinCooldown;
+    int upgradeBombDamage;
+    float upgradeBombRadius;
+    double freezeMinCooldown;
+    float upgradeFreezeDuration;
+    float upgradeFreezeRadius;
+    double fireballMinCooldown;
+    int upgradeFireballDamage;
+    float upgradeFireballRadius;
+
+    // Враги: базовые значения и рост с волной и сложностью
+    EnemyTuning enemies[3];         // По EnemyType
+    float enemyWaveScale;
+    float enemyHealthDifficulty;
+    float enemyHealthWave;
+    float enemyDamageDifficulty;
+    float enemyDamageWave;
+    float enemySpeedDifficulty;
+    float enemySpeedWave;
+};
+
+TuningConfig CreateDefaultTuning() {
+    TuningConfig tuning;
+    tuning.playerRadius = 15.0f;
+    tuning.playerSpeed = 5.0f;
+    tuning.playerHealth = 100;
+    tuning.playerDamage = 20;
+    tuning.playerAttackSpeed = 1.0f;
+    tuning.bulletSpeed = 10.0f;
+    tuning.bulletRadius = 5.0f;
+    tuning.bulletSpread = 0.2f;
+
+    tuning.waveCooldown = 45.0;
+    tuning.waveDamage = 50;
+    tuning.waveStartRadius = 10.0f;
+    tuning.waveSpeed = 3.0f;
+    tuning.waveTargetRange = 300.0f;
+    tuning.bombCooldown = 15.0;
+    tuning.bombFuse = 2.0;
+    tuning.bombDamage = 40;
+    tuning.bombRadius = 80.0f;
+    tuning.freezeCooldown = 25.0;
+    tuning.freezeDuration = 3.0f;
+    tuning.freezeRadius = 100.0f;
+    tuning.fireballCooldown = 8.0;
+    tuning.fireballDamage = 30;
+    tuning.fireballExplosionRadius = 60.0f;
+    tuning.fireballSpeed = 8.0f;
+    tuning.fireballRadius = 8.0f;
+
+    tuning.slowSpeedScale = 0.5f;
+    tuning.thawSlowDuration = 1.5;
+    tuning.burnDamage = 5;
+    tuning.burnDuration = 3.0;
+    tuning.poisonDamage = 3;
+    tuning.poisonDuration = 5.0;
+
+    tuning.upgradeMaxHealth = 10;
+    tuning.upgradeHeal = 20;
+    tuning.upgradeAttackSpeed = 0.2f;
+    tuning.upgradeDamage = 5;
+    tuning.upgradeSpeed = 0.5f;
+    tuning.upgradeCooldownFactor = 0.8f;
+    tuning.waveMinCooldown = 10.0;
+    tuning.upgradeWaveDamage = 10;
+    tuning.bombMinCooldown = 8.0;
+    tuning.upgradeBombDamage = 10;
+    tuning.upgradeBombRadius = 10.0f;
+    tuning.freezeMinCooldown = 12.0;
+    tuning.upgradeFreezeDuration = 0.5f;
+    tuning.upgradeFreezeRadius = 15.0f;
+    tuning.fireballMinCooldown = 4.0;
+    tuning.upgradeFireballDamage = 5;
+    tuning.upgradeFireballRadius = 10.0f;
+
+    tuning.enemies[0] = { 2.5f, 30, 5, 20.0f };     // ENEMY_GREEN
+    tuning.enemies[1] = { 1.0f, 50, 8, 150.0f };    // ENEMY_PURPLE
+    tuning.enemies[2] = { 0.8f, 150, 15, 25.0f };   // ENEMY_RED
+    tuning.enemyWaveScale = 0.1f;
+    tuning.enemyHealthDifficulty = 0.5f;
+    tuning.enemyHealthWave = 0.05f;
+    tuning.enemyDamageDifficulty = 0.3f;
+    tuning.enemyDamageWave = 0.03f;
+    tuning.enemySpeedDifficulty = 0.2f;
+    tuning.enemySpeedWave = 0.02f;
+    return tuning;
+}
+
+// Описание полей для чтения файла (используется только при загрузке)
+enum TuningFieldType {
+    TUNING_INT,
+    TUNING_FLOAT,
+    TUNING_DOUBLE
+};
+
+// Допустимые значения (бесконечности и NaN отвергаются всегда)
+enum TuningRange {
+    TUNING_POSITIVE,       // > 0: базовые значения, на которые делят и умножают
+    TUNING_NON_NEGATIVE,   // >= 0: прибавки улучшений, разброс, рост сложности
+    TUNING_FRACTION        // (0, 1]: множители
 };
 
+struct TuningField {
+    const char* name;
+    TuningFieldType type;
+    size_t offset;
+    TuningRange range;
+};
+
+#define TUNING_FIELD(name, type, member, range) { name, type, offsetof(TuningConfig, member), range }
+#define TUNING_ENEMY_FIELD(name, type, index, member) \
+    { name, type, offsetof(TuningConfig, enemies) + index * sizeof(EnemyTuning) + offsetof(EnemyTuning, member), TUNING_POSITIVE }
+
+const TuningField TUNING_FIELDS[] = {
+    TUNING_FIELD("player_radius", TUNING_FLOAT, playerRadius, TUNING_POSITIVE),
+    TUNING_FIELD("player_speed", TUNING_FLOAT, playerSpeed, TUNING_POSITIVE),
+    TUNING_FIELD("player_health", TUNING_INT, playerHealth, TUNING_POSITIVE),
+    TUNING_FIELD("player_damage", TUNING_INT, playerDamage, TUNING_POSITIVE),
+    TUNING_FIELD("player_attack_speed", TUNING_FLOAT, playerAttackSpeed, TUNING_POSITIVE),
+    TUNING_FIELD("bullet_speed", TUNING_FLOAT, bulletSpeed, TUNING_POSITIVE),
+    TUNING_FIELD("bullet_radius", TUNING_FLOAT, bulletRadius, TUNING_POSITIVE),
+    TUNING_FIELD("bullet_spread", TUNING_FLOAT, bulletSpread, TUNING_NON_NEGATIVE),
+    TUNING_FIELD("wave_cooldown", TUNING_DOUBLE, waveCooldown, TUNING_POSITIVE),
+    TUNING_FIELD("wave_damage", TUNING_INT, waveDamage, TUNING_POSITIVE),
+    TUNING_FIELD("wave_start_radius", TUNING_FLOAT, waveStartRadius, TUNING_POSITIVE),
+    TUNING_FIELD("wave_speed", TUNING_FLOAT, waveSpeed, TUNING_POSITIVE),
+    TUNING_FIELD("wave_target_range", TUNING_FLOAT, waveTargetRange, TUNING_POSITIVE),
+    TUNING_FIELD("bomb_cooldown", TUNING_DOUBLE, bombCooldown, TUNING_POSITIVE),
+    TUNING_FIELD("bomb_fuse", TUNING_DOUBLE, bombFuse, TUNING_POSITIVE),
+    TUNING_FIELD("bomb_damage", TUNING_INT, bombDamage, TUNING_POSITIVE),
+    TUNING_FIELD("bomb_radius", TUNING_FLOAT, bombRadius, TUNING_POSITIVE),
+    TUNING_FIELD("freeze_cooldown", TUNING_DOUBLE, freezeCooldown, TUNING_POSITIVE),
+    TUNING_FIELD("freeze_duration", TUNING_FLOAT, freezeDuration, TUNING_POSITIVE),
+    TUNING_FIELD("freeze_radius", TUNING_FLOAT, freezeRadius, TUNING_POSITIVE),
+    TUNING_FIELD("fireball_cooldown", TUNING_DOUBLE, fireballCooldown, TUNING_POSITIVE),
+    TUNING_FIELD("fireball_damage", TUNING_INT, fireballDamage, TUNING_POSITIVE),
+    TUNING_FIELD("fireball_explosion_radius", TUNING_FLOAT, fireballExplosionRadius, TUNING_POSITIVE),
+    TUNING_FIELD("fireball_speed", TUNING_FLOAT, fireballSpeed, TUNING_POSITIVE),
+    TUNING_FIELD("fireball_radius", TUNING_FLOAT, fireballRadius, TUNING_POSITIVE),
+    TUNING_FIELD("slow_speed_scale", TUNING_FLOAT, slowSpeedScale, TUNING_FRACTION),
+    TUNING_FIELD("thaw_slow_duration", TUNING_DOUBLE, thawSlowDuration, TUNING_NON_NEGATIVE),
+    TUNING_FIELD("burn_damage", TUNING_INT, burnDamage, TUNING_NON_NEGATIVE),
+    TUNING_FIELD("burn_duration", TUNING_DOUBLE, burnDuration, TUNING_NON_NEGATIVE),
+    TUNING_FIELD("poison_damage", TUNING_INT, poisonDamage, TUNING_NON_NEGATIVE),
+    TUNING_FIELD("poison_duration", TUNING_DOUBLE, poisonDuration, TUNING_NON_NEGATIVE),
+    TUNING_FIELD("upgrade_max_health", TUNING_INT, upgradeMaxHealth, TUNING_NON_NEGATIVE),
+    TUNING_FIELD("upgrade_heal", TUNING_INT, upgradeHeal, TUNING_NON_NEGATIVE),
+    TUNING_FIELD("upgrade_attack_speed", TUNING_FLOAT, upgradeAttackSpeed, TUNING_NON_NEGATIVE),
+    TUNING_FIELD("upgrade_damage", TUNING_INT, upgradeDamage, TUNING_NON_NEGATIVE),
+    TUNING_FIELD("upgrade_speed", TUNING_FLOAT, upgradeSpeed, TUNING_NON_NEGATIVE),
+    TUNING_FIELD("upgrade_cooldown_factor", TUNING_FLOAT, upgradeCooldownFactor, TUNING_FRACTION),
+    TUNING_FIELD("wave_min_cooldown", TUNING_DOUBLE, waveMinCooldown, TUNING_POSITIVE),
+    TUNING_FIELD("upgrade_wave_damage", TUNING_INT, upgradeWaveDamage, TUNING_NON_NEGATIVE),
+    TUNING_FIELD("bomb_min_cooldown", TUNING_DOUBLE, bombMinCooldown, TUNING_POSITIVE),
+    TUNING_FIELD("upgrade_bomb_damage", TUNING_INT, upgradeBombDamage, TUNING_NON_NEGATIVE),
+    TUNING_FIELD("upgrade_bomb_radius", TUNING_FLOAT, upgradeBombRadius, TUNING_NON_NEGATIVE),
+    TUNING_FIELD("freeze_min_cooldown", TUNING_DOUBLE, freezeMinCooldown, TUNING_POSITIVE),
+    TUNING_FIELD("upgrade_freeze_duration", TUNING_FLOAT, upgradeFreezeDuration, TUNING_NON_NEGATIVE),
+    TUNING_FIELD("upgrade_freeze_radius", TUNING_FLOAT, upgradeFreezeRadius, TUNING_NON_NEGATIVE),
+    TUNING_FIELD("fireball_min_cooldown", TUNING_DOUBLE, fireballMinCooldown, TUNING_POSITIVE),
+    TUNING_FIELD("upgrade_fireball_damage", TUNING_INT, upgradeFireballDamage, TUNING_NON_NEGATIVE),
+    TUNING_FIELD("upgrade_fireball_radius", TUNING_FLOAT, upgradeFireballRadius, TUNING_NON_NEGATIVE),
+    TUNING_ENEMY_FIELD("enemy_green_speed", TUNING_FLOAT, 0, speed),
+    TUNING_ENEMY_FIELD("enemy_green_health", TUNING_INT, 0, health),
+    TUNING_ENEMY_FIELD("enemy_green_damage", TUNING_INT, 0, damage),
+    TUNING_ENEMY_FIELD("enemy_green_attack_range", TUNING_FLOAT, 0, attackRange),
+    TUNING_ENEMY_FIELD("enemy_purple_speed", TUNING_FLOAT, 1, speed),
+    TUNING_ENEMY_FIELD("enemy_purple_health", TUNING_INT, 1, health),
+    TUNING_ENEMY_FIELD("enemy_purple_damage", TUNING_INT, 1, damage),
+    TUNING_ENEMY_FIELD("enemy_purple_attack_range", TUNING_FLOAT, 1, attackRange),
+    TUNING_ENEMY_FIELD("enemy_red_speed", TUNING_FLOAT, 2, speed),
+    TUNING_ENEMY_FIELD("enemy_red_health", TUNING_INT, 2, health),
+    TUNING_ENEMY_FIELD("enemy_red_damage", TUNING_INT, 2, damage),
+    TUNING_ENEMY_FIELD("enemy_red_attack_range", TUNING_FLOAT, 2, attackRange),
+    TUNING_FIELD("enemy_wave_scale", TUNING_FLOAT, enemyWaveScale, TUNING_NON_NEGATIVE),
+    TUNING_FIELD("enemy_health_difficulty", TUNING_FLOAT, enemyHealthDifficulty, TUNING_NON_NEGATIVE),
+    TUNING_FIELD("enemy_health_wave", TUNING_FLOAT, enemyHealthWave, TUNING_NON_NEGATIVE),
+    TUNING_FIELD("enemy_damage_difficulty", TUNING_FLOAT, enemyDamageDifficulty, TUNING_NON_NEGATIVE),
+    TUNING_FIELD("enemy_damage_wave", TUNING_FLOAT, enemyDamageWave, TUNING_NON_NEGATIVE),
+    TUNING_FIELD("enemy_speed_difficulty", TUNING_FLOAT, enemySpeedDifficulty, TUNING_NON_NEGATIVE),
+    TUNING_FIELD("enemy_speed_wave", TUNING_FLOAT, enemySpeedWave, TUNING_NON_NEGATIVE),
+};
+
+const int TUNING_FIELD_COUNT = sizeof(TUNING_FIELDS) / sizeof(TUNING_FIELDS[0]);
+
+// Действующие настройки (меняет только главный поток между тиками) и загруженные,
+// но еще не примененные (кладет поток слежения за файлом)
+const TuningConfig defaultTuning = CreateDefaultTuning();
+std::atomic<const TuningConfig*> activeTuning(&defaultTuning);
+std::atomic<TuningConfig*> pendingTuning(nullptr);
+
+const TuningConfig& GetTuning() {
+    return *activeTuning.load(std::memory_order_acquire);
+}
+
 // Структура кнопки
 struct Button {
     Rectangle bounds;
@@ -173,6 +784,159 @@ struct Joystick {
     Vector2 direction;
 };
 
+// Ввод игрока за тик: направление движения, квантованное до байта на ось.
+// Симуляция видит только его, поэтому одинаковый ввод дает одинаковый результат на любой машине
+struct PlayerInput {
+    signed char moveX;
+    signed char moveY;
+};
+
+bool operator==(const PlayerInput& a, const PlayerInput& b) {
+    return a.moveX == b.moveX && a.moveY == b.moveY;
+}
+
+bool operator!=(const PlayerInput& a, const PlayerInput& b) {
+    return !(a == b);
+}
+
+// Способности игрока с перезарядкой: выстрел, за ним способности PlayerAbilities
+// (номер выводится из места в списке, см. AbilityIdOf; тип задан явно, чтобы эти
+// номера входили в диапазон значений перечисления)
+enum AbilityId : int {
+    ABILITY_SHOT,
+    ABILITY_FIRST_POLICY
+};
+
+// Типы улучшений: характеристики игрока, за ними улучшения способностей PlayerAbilities
+// (см. AbilityUpgradeOf)
+enum UpgradeType : int {
+    UPGRADE_HEALTH,
+    UPGRADE_ATTACK_SPEED,
+    UPGRADE_DAMAGE,
+    UPGRADE_SPEED,
+    UPGRADE_DOUBLE_SHOT,
+    UPGRADE_PROJECTILE_COUNT,
+    UPGRADE_FIRST_ABILITY
+};
+
+// Способности-политики
+// Способность - тип со своим состоянием State, цветом и статическими функциями создания,
+// срабатывания и улучшения. Список способностей PlayerAbilities - кортеж типов; номер
+// перезарядки и тип улучшения выводятся из места типа в списке. UpdatePlayer, выпадение
+// и применение улучшений и HUD обходят список сверткой (ForEachAbility), поэтому цикл
+// по способностям разворачивается при компиляции, без виртуальных вызовов и таблиц.
+// Новая способность - новый тип в списке; если она создает сущности нового вида, нужны
+// еще их пул (World, AbilityContext), система и отрисовка. Тела функций - у UpdatePlayer
+struct Player;
+struct AbilityContext;
+
+struct WaveAbility {
+    struct State {
+        bool owned;
+        double cooldown;
+        int damage;
+    };
+    static const char* Name() { return "Wave"; }
+    static Color HudColor() { return COLOR_UPGRADE_WAVE; }
+    static State Create(const TuningConfig& tuning, const MetaProgression& meta, const Player& player);
+    static bool Activate(AbilityContext& context, State& state);   // false - не сработала, перезарядки нет
+    static void Upgrade(State& state, const TuningConfig& tuning);
+    // Перенос состояния на новые настройки без потери улучшений забега
+    static void Retune(State& state, const TuningConfig& previous, const TuningConfig& next);
+};
+
+struct BombAbility {
+    struct State {
+        bool owned;
+        double cooldown;
+        int damage;
+        float radius;
+    };
+    static const char* Name() { return "Bomb"; }
+    static Color HudColor() { return COLOR_UPGRADE_BOMB; }
+    static State Create(const TuningConfig& tuning, const MetaProgression& meta, const Player& player);
+    static bool Activate(AbilityContext& context, State& state);
+    static void Upgrade(State& state, const TuningConfig& tuning);
+    static void Retune(State& state, const TuningConfig& previous, const TuningConfig& next);
+};
+
+struct FreezeAbility {
+    struct State {
+        bool owned;
+        double cooldown;
+        float duration;
+        float radius;
+    };
+    static const char* Name() { return "Freeze"; }
+    static Color HudColor() { return COLOR_UPGRADE_FREEZE; }
+    static State Create(const TuningConfig& tuning, const MetaProgression& meta, const Player& player);
+    static bool Activate(AbilityContext& context, State& state);
+    static void Upgrade(State& state, const TuningConfig& tuning);
+    static void Retune(State& state, const TuningConfig& previous, const TuningConfig& next);
+};
+
+struct FireballAbility {
+    struct State {
+        bool owned;
+        double cooldown;
+        int damage;
+        float explosionRadius;
+        float speed;
+    };
+    static const char* Name() { return "Fireball"; }
+    static Color HudColor() { return COLOR_UPGRADE_FIREBALL; }
+    static State Create(const TuningConfig& tuning, const MetaProgression& meta, const Player& player);
+    static bool Activate(AbilityContext& context, State& state);
+    static void Upgrade(State& state, const TuningConfig& tuning);
+    static void Retune(State& state, const TuningConfig& previous, const TuningConfig& next);
+};
+
+// Порядок списка - порядок срабатывания в тике и строк HUD
+typedef std::tuple<WaveAbility, BombAbility, FreezeAbility, FireballAbility> PlayerAbilities;
+
+template <typename List>
+struct AbilityStatesOf;
+
+template <typename... Abilities>
+struct AbilityStatesOf<std::tuple<Abilities...>> {
+    typedef std::tuple<typename Abilities::State...> type;
+};
+
+typedef AbilityStatesOf<PlayerAbilities>::type AbilityStates;
+
+// Место способности в списке
+template <typename Ability, typename List>
+struct AbilityIndexOf;
+
+template <typename Ability, typename... Rest>
+struct AbilityIndexOf<Ability, std::tuple<Ability, Rest...>> {
+    static constexpr int value = 0;
+};
+
+template <typename Ability, typename First, typename... Rest>
+struct AbilityIndexOf<Ability, std::tuple<First, Rest...>> {
+    static constexpr int value = 1 + AbilityIndexOf<Ability, std::tuple<Rest...>>::value;
+};
+
+const int ABILITY_COUNT = ABILITY_FIRST_POLICY + (int)std::tuple_size<PlayerAbilities>::value;
+const int UPGRADE_COUNT = UPGRADE_FIRST_ABILITY + (int)std::tuple_size<PlayerAbilities>::value;
+
+template <typename Ability>
+constexpr AbilityId AbilityIdOf() {
+    return (AbilityId)(ABILITY_FIRST_POLICY + AbilityIndexOf<Ability, PlayerAbilities>::value);
+}
+
+template <typename Ability>
+constexpr UpgradeType AbilityUpgradeOf() {
+    return (UpgradeType)(UPGRADE_FIRST_ABILITY + AbilityIndexOf<Ability, PlayerAbilities>::value);
+}
+
+// fn(ability) для каждой способности списка; ability - пустой объект типа политики
+template <typename Fn>
+void ForEachAbility(Fn&& fn) {
+    std::apply([&](auto... ability) { (fn(ability), ...); }, PlayerAbilities());
+}
+
 // Структура игрока
 struct Player {
     Vector2 position;
@@ -182,36 +946,25 @@ struct Player {
     int maxHealth;
     float attackSpeed;
     int damage;
-    double lastShotTime;
     int projectileCount; // Количество выпускаемых снарядов
 
-    // Новые способности
-    bool hasWaveAttack;
-    double waveCooldown;
-    double lastWaveTime;
-    int waveDamage;
+    // Перезарядка: бит способности выставляет таймер, тик окончания нужен только HUD
+    unsigned int abilityReady;                     // Биты AbilityId
+    unsigned int abilityReadyTick[ABILITY_COUNT];
 
+    AbilityStates abilities;                       // Состояния способностей PlayerAbilities
     bool hasDoubleShot;
+};
 
-    bool hasBombAttack;
-    double bombCooldown;
-    double lastBombTime;
-    int bombDamage;
-    float bombRadius;
-
-    bool hasFreezeAttack;
-    double freezeCooldown;
-    double lastFreezeTime;
-    float freezeDuration;
-    float freezeRadius;
+template <typename Ability>
+typename Ability::State& GetAbilityState(Player& player) {
+    return std::get<typename Ability::State>(player.abilities);
+}
 
-    bool hasFireballAttack;
-    double fireballCooldown;
-    double lastFireballTime;
-    int fireballDamage;
-    float fireballExplosionRadius;
-    float fireballSpeed;
-};
+template <typename Ability>
+const typename Ability::State& GetAbilityState(const Player& player) {
+    return std::get<typename Ability::State>(player.abilities);
+}
 
 // Структура пули
 struct Bullet {
@@ -227,6 +980,7 @@ struct EnemyProjectile {
     Vector2 velocity;
     float radius;
     int damage;
+    EntityHandle owner;   // Стрелявший враг: снаряд исчезает вместе с ним или при его засыпании
 };
 
 // Типы врагов
@@ -236,39 +990,84 @@ enum EnemyType {
     ENEMY_RED
 };
 
-// Структура врага
-struct Enemy {
+// Характеристики врага после масштабирования волной
+struct EnemyStats {
+    float speed;
+    int health;
+    int damage;
+    float attackRange;
+    float attackCooldown;
+};
+
+// Запись расписания спавна
+struct SpawnEntry {
+    unsigned int tick;        // Тик от начала волны
+    unsigned short archetype; // Индекс в таблице архетипов врагов
+    unsigned char side;       // Сторона видимой области (0 - верх, 1 - право, 2 - низ, 3 - лево)
+    unsigned short edge;      // Позиция вдоль стороны (0..65535)
+};
+
+// Расписание волны
+struct WavePlan {
+    TaggedVector<SpawnEntry, MEM_ENEMIES> entries;
+    size_t next;           // Следующая запись для спавна
+    unsigned int startTick;
+};
+
+// Уровень детализации врага
+enum EnemyLod {
+    LOD_FULL,     // Видимая область с запасом: полное обновление и полоска здоровья
+    LOD_REDUCED,  // Активные чанки за экраном: только движение раз в LOD_REDUCED_INTERVAL кадров
+    LOD_DORMANT   // Дальние чанки: только движение раз в COARSE_TICK_INTERVAL кадров
+};
+
+const float ENEMY_RADIUS = 15.0f * SIZE_MULTIPLIER;
+const int FIXED_SHIFT = 16;                   // Позиции врагов в фиксированной точке 16.16
+const int ENEMY_HEALTH_LIMIT = 65535;         // Предел 16-битного здоровья
+const size_t ENEMY_ARCHETYPE_LIMIT = 65536;   // Предел 16-битного индекса архетипа
+const size_t ENEMY_ARCHETYPE_SEARCH = 64;     // Сколько последних архетипов проверяется при регистрации
+const float ENEMY_DIFFICULTY_STEPS = 30.0f;   // Ступени сложности (каждые 10 с до выхода на максимум)
+
+// Архетип врага: неизменяемые характеристики, общие для всех врагов одного типа,
+// волны и сложности. Враг хранит только индекс архетипа
+struct EnemyArchetype {
     EnemyType type;
-    Vector2 position;
-    float radius;
     Color color;
     float speed;
-    int health;
+    float attackRange;
     int maxHealth;
     int damage;
-    float attackRange;
+    unsigned int attackCooldownTicks;
+    unsigned short healthUnits;   // maxHealth в единицах здоровья врага
+    unsigned char healthShift;    // Единица здоровья = 1 << healthShift (для поздних волн, где здоровье не помещается в 16 бит)
     bool isRanged;
-    double lastAttackTime;
-    float attackCooldown;
-    std::vector<EnemyProjectile> projectiles;
-    bool isFrozen;
-    double frozenUntil;
 };
 
-// Типы улучшений
-enum UpgradeType {
-    UPGRADE_HEALTH,
-    UPGRADE_ATTACK_SPEED,
-    UPGRADE_DAMAGE,
-    UPGRADE_SPEED,
-    UPGRADE_WAVE,
-    UPGRADE_DOUBLE_SHOT,
-    UPGRADE_BOMB,
-    UPGRADE_FREEZE,
-    UPGRADE_FIREBALL,
-    UPGRADE_PROJECTILE_COUNT
+// Класс движения врага (младшие биты flags) - индекс в таблице множителей скорости,
+// которую UpdateEnemies собирает раз за тик. Класс пересчитывается только при наложении
+// и снятии эффектов состояний, поэтому в обновлении врага нет проверок эффектов
+enum EnemyFlags : unsigned char {
+    ENEMY_MOVE_NORMAL = 0,
+    ENEMY_MOVE_SLOWED = 1,
+    ENEMY_MOVE_STOPPED = 2,
+    ENEMY_MOVE_MASK = 3
+};
+
+// Структура врага (горячее состояние)
+// Все, что общее для группы врагов, вынесено в архетип, поэтому враг занимает 20 байт
+// вместо 72 и 100 000 врагов (~2 МБ) помещаются в кэш целиком
+struct Enemy {
+    int x;                          // Позиция в фиксированной точке 16.16
+    int y;
+    unsigned int attackReadyTick;   // Тик симуляции, с которого враг снова может атаковать
+    unsigned short health;          // В единицах здоровья архетипа
+    unsigned short archetype;
+    unsigned char lod;              // EnemyLod
+    unsigned char flags;            // EnemyFlags
 };
 
+static_assert(sizeof(Enemy) <= 24, "Enemy hot state must stay within 24 bytes");
+
 // Структура улучшения
 struct Upgrade {
     Vector2 position;
@@ -277,72 +1076,793 @@ struct Upgrade {
     Color color;
 };
 
-// Вспомогательные функции для векторов
-Vector2 Vector2Add(Vector2 v1, Vector2 v2) {
-    return { v1.x + v2.x, v1.y + v2.y };
+template <> struct MemoryTagOf<Enemy> { static const MemoryTag value = MEM_ENEMIES; };
+template <> struct MemoryTagOf<EnemyProjectile> { static const MemoryTag value = MEM_ENEMIES; };
+template <> struct MemoryTagOf<Bullet> { static const MemoryTag value = MEM_BULLETS; };
+template <> struct MemoryTagOf<Upgrade> { static const MemoryTag value = MEM_EFFECTS; };
+template <> struct MemoryTagOf<Shockwave> { static const MemoryTag value = MEM_EFFECTS; };
+template <> struct MemoryTagOf<Bomb> { static const MemoryTag value = MEM_EFFECTS; };
+template <> struct MemoryTagOf<FreezeArea> { static const MemoryTag value = MEM_EFFECTS; };
+template <> struct MemoryTagOf<Fireball> { static const MemoryTag value = MEM_EFFECTS; };
+template <> struct MemoryTagOf<EnemyArchetype> { static const MemoryTag value = MEM_ENEMIES; };
+
+// Таблица архетипов врагов (своя у каждого мира)
+// Пополняется только главным потоком при планировании волны (до запуска систем тика),
+// поэтому системы в рабочих потоках читают ее без синхронизации
+typedef TaggedVector<EnemyArchetype, MEM_ENEMIES> EnemyArchetypeTable;
+
+int ToFixed(float value) {
+    return (int)(value * (float)(1 << FIXED_SHIFT));
 }
 
-Vector2 Vector2Subtract(Vector2 v1, Vector2 v2) {
-    return { v1.x - v2.x, v1.y - v2.y };
+float FromFixed(int value) {
+    return (float)value * (1.0f / (1 << FIXED_SHIFT));
 }
 
-Vector2 Vector2Scale(Vector2 v, float scale) {
-    return { v.x * scale, v.y * scale };
+Vector2 GetEnemyPosition(const Enemy& enemy) {
+    return { FromFixed(enemy.x), FromFixed(enemy.y) };
 }
 
-float Vector2Length(Vector2 v) {
-    return sqrtf(v.x * v.x + v.y * v.y);
+void SetEnemyPosition(Enemy& enemy, Vector2 position) {
+    enemy.x = ToFixed(position.x);
+    enemy.y = ToFixed(position.y);
 }
 
-Vector2 Vector2Normalize(Vector2 v) {
-    float length = Vector2Length(v);
-    if (length > 0) {
-        return { v.x / length, v.y / length };
-    }
-    return { 0, 0 };
+const EnemyArchetype& GetEnemyArchetype(const EnemyArchetypeTable& archetypes, const Enemy& enemy) {
+    return archetypes[enemy.archetype];
 }
 
-float Vector2Distance(Vector2 v1, Vector2 v2) {
-    float dx = v1.x - v2.x;
-    float dy = v1.y - v2.y;
-    return sqrtf(dx * dx + dy * dy);
+// Номер потока: 0 - главный, далее рабочие потоки пула задач (по одному на ядро)
+int GetThreadCount() {
+    static const int count = std::max(1, (int)std::thread::hardware_concurrency());
+    return count;
 }
 
-// Функции для кнопок
-bool IsButtonHovered(Button& button) {
-    button.hovered = CheckCollisionPointRec(GetMousePosition(), button.bounds);
-    return button.hovered;
-}
+thread_local int threadIndex = 0;
+
+// Счетчики горячих путей
+// Каждый поток пишет в свой блок (выровнен по строке кэша, без атомарных операций),
+// в конце тика главный поток сводит блоки в значения тика и секунды
+enum StatCounter {
+    STAT_COLLISION_TESTS,   // Проверки дистанции в CheckCollisions
+    STAT_COLLISION_HITS,
+    STAT_ERASES,            // Удаления сущностей в CheckCollisions
+    STAT_ENEMY_KILLS,
+    STAT_ENEMY_FULL_UPDATES,
+    STAT_ENEMY_BATCH_MOVES, // Враги пониженной детализации в пакете движения
+    STAT_FREEZE_TESTS,      // Проверки попадания в заморозку
+    STAT_AOE_TESTS,         // Проверки кандидатов в запросах областей (взрывы, волны)
+    STAT_ENEMY_SPAWNS,
+    STAT_UPGRADE_SPAWNS,
+    STAT_COUNT
+};
 
-bool IsButtonClicked(Button& button) {
-    return IsButtonHovered(button) && IsMouseButtonPressed(MOUSE_LEFT_BUTTON);
-}
+const char* STAT_NAMES[STAT_COUNT] = {
+    "collision tests", "collision hits", "erases", "enemy kills", "enemy full updates",
+    "enemy batch moves", "freeze tests", "aoe tests", "enemy spawns", "upgrade spawns"
+};
 
-void DrawButton(Button& button) {
-    Color color = button.hovered ? COLOR_BUTTON_HOVER : COLOR_BUTTON;
-    DrawRectangleRec(button.bounds, color);
-    DrawRectangleLinesEx(button.bounds, 2, WHITE);
+struct alignas(64) StatsThreadBlock {
+    long long values[STAT_COUNT];
+};
 
-    int textWidth = MeasureText(button.text, 20);
-    int textX = button.bounds.x + (button.bounds.width - textWidth) / 2;
-    int textY = button.bounds.y + (button.bounds.height - 20) / 2;
+std::vector<StatsThreadBlock> statsThreads(GetThreadCount());
 
-    DrawText(button.text, textX, textY, 20, WHITE);
-}
+#if ENABLE_STATS
+#define STAT_ADD(counter, amount) (statsThreads[threadIndex].values[counter] += (amount))
+#else
+#define STAT_ADD(counter, amount) ((void)0)
+#endif
 
-// Функции для джойстика
-Joystick CreateJoystick() {
-    Joystick joystick;
-    int screenWidth = GetScreenWidth();
-    int screenHeight = GetScreenHeight();
+enum StatWindow {
+    STAT_WINDOW_TICK,        // Последний тик
+    STAT_WINDOW_SECOND,      // Последняя полная секунда
+    STAT_WINDOW_PEAK_TICK,   // Максимум за тик с начала замера
+    STAT_WINDOW_TOTAL        // Сумма с начала замера
+};
 
-    joystick.outerRadius = 100.0f * SIZE_MULTIPLIER;
-    joystick.innerRadius = 40.0f * SIZE_MULTIPLIER;
+struct StatsState {
+    long long tick[STAT_COUNT];
+    long long second[STAT_COUNT];
+    long long secondAccum[STAT_COUNT];
+    long long peakTick[STAT_COUNT];
+    long long total[STAT_COUNT];
+    double secondTime;      // Накопленное время текущей секунды
+    long long ticks;
+};
 
-    joystick.position = {
-        joystick.outerRadius + 80.0f,
-        screenHeight - joystick.outerRadius - 60.0f
-    };
+void ResetStats(StatsState& stats) {
+    memset(&stats, 0, sizeof(stats));
+    memset(statsThreads.data(), 0, statsThreads.size() * sizeof(StatsThreadBlock));
+}
+
+// Вызывается в главном потоке после барьера (рабочие потоки не пишут)
+void EndStatsTick(StatsState& stats, double deltaTime) {
+    for (int counter = 0; counter < STAT_COUNT; counter++) {
+        long long value = 0;
+        for (auto& block : statsThreads) {
+            value += block.values[counter];
+            block.values[counter] = 0;
+        }
+
+        stats.tick[counter] = value;
+        stats.secondAccum[counter] += value;
+        stats.total[counter] += value;
+        stats.peakTick[counter] = std::max(stats.peakTick[counter], value);
+    }
+
+    stats.ticks++;
+    stats.secondTime += deltaTime;
+    if (stats.secondTime >= 1.0) {
+        memcpy(stats.second, stats.secondAccum, sizeof(stats.second));
+        memset(stats.secondAccum, 0, sizeof(stats.secondAccum));
+        stats.secondTime -= 1.0;
+    }
+}
+
+long long GetStat(const StatsState& stats, StatCounter counter, StatWindow window) {
+    switch (window) {
+    case STAT_WINDOW_TICK: return stats.tick[counter];
+    case STAT_WINDOW_SECOND: return stats.second[counter];
+    case STAT_WINDOW_PEAK_TICK: return stats.peakTick[counter];
+    case STAT_WINDOW_TOTAL: return stats.total[counter];
+    }
+    return 0;
+}
+
+// Шина игровых событий
+// Горячие циклы симуляции только дописывают POD-записи, а счет, здоровье игрока,
+// статистика и эффекты обрабатывают их пачкой после симуляции.
+// События, меняющие состояние (урон, убийства, подборы), пишутся в журнал без потерь,
+// кольцевой буфер с отбрасыванием остается только для оформления (взрывы, залпы)
+enum GameEventType : unsigned char {
+    EVENT_DAMAGE_DEALT,      // Урон по врагу
+    EVENT_ENEMY_KILLED,      // Враг убит
+    EVENT_PLAYER_HIT,        // Урон по игроку
+    EVENT_UPGRADE_COLLECTED, // Игрок подобрал улучшение
+    EVENT_EXPLOSION,         // Взрыв бомбы или фаербола (для эффектов)
+    EVENT_SHOT               // Залп игрока (для звука)
+};
+
+// Подтип события взрыва
+enum ExplosionType : unsigned char {
+    EXPLOSION_BOMB,
+    EXPLOSION_FIREBALL
+};
+
+struct GameEvent {
+    GameEventType type;
+    unsigned char subtype;   // EnemyType, UpgradeType или номер игрока (EVENT_PLAYER_HIT, EVENT_SHOT)
+    int amount;              // Урон, радиус взрыва, снаряды залпа или номер игрока (EVENT_UPGRADE_COLLECTED)
+    Vector2 position;
+};
+
+// Ограниченная очередь со счетчиками последовательности в ячейках:
+// писать можно из нескольких потоков, читает один потребитель
+const size_t EVENT_BUFFER_SIZE = 1 << 16; // Степень двойки
+
+struct EventCell {
+    std::atomic<size_t> sequence;
+    GameEvent event;
+};
+
+// Запись журнала: ключ - номер системы-источника и позиция в полосе потока
+struct LoggedEvent {
+    unsigned long long order;
+    GameEvent event;
+};
+
+typedef TaggedVector<LoggedEvent, MEM_EVENTS> EventLane;
+
+// Система, выполняемая текущим потоком (1 + индекс в планировщике, 0 - вне систем)
+thread_local unsigned int eventSource = 0;
+
+struct EventBus {
+    TaggedVector<EventCell, MEM_EVENTS> cells;
+    std::atomic<size_t> writePos;
+    size_t readPos;
+    std::atomic<unsigned int> dropped; // События оформления, не поместившиеся в буфер
+    TaggedVector<EventLane, MEM_EVENTS> lanes; // Журнал тика: своя полоса у каждого потока
+    EventLane merged;
+
+    EventBus() : cells(EVENT_BUFFER_SIZE), writePos(0), readPos(0), dropped(0), lanes(GetThreadCount()) {
+        for (size_t i = 0; i < cells.size(); i++) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+};
+
+// Событие состояния: дописывается в полосу текущего потока и никогда не теряется.
+// Система целиком выполняется одним потоком, поэтому ключ (система, позиция) дает
+// после слияния тот же порядок, что и последовательный прогон систем
+void RecordEvent(EventBus& bus, const GameEvent& event) {
+    EventLane& lane = bus.lanes[threadIndex];
+    lane.push_back({ ((unsigned long long)eventSource << 32) | lane.size(), event });
+}
+
+// Событие оформления: при переполнении буфера отбрасывается
+void PushEvent(EventBus& bus, const GameEvent& event) {
+    const size_t mask = EVENT_BUFFER_SIZE - 1;
+    size_t pos = bus.writePos.load(std::memory_order_relaxed);
+
+    for (;;) {
+        EventCell& cell = bus.cells[pos & mask];
+        size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        long long diff = (long long)sequence - (long long)pos;
+
+        if (diff == 0) {
+            if (bus.writePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                cell.event = event;
+                cell.sequence.store(pos + 1, std::memory_order_release);
+                return;
+            }
+        }
+        else if (diff < 0) {
+            // Буфер полон: симуляцию не блокируем
+            bus.dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        else {
+            pos = bus.writePos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+typedef TaggedVector<GameEvent, MEM_EVENTS> EventBatch;
+
+// Забирает все опубликованные события в пачку: сначала журнал в детерминированном
+// порядке, затем события оформления. Вызывается, когда рабочие потоки стоят на барьере
+size_t DrainEvents(EventBus& bus, EventBatch& batch) {
+    const size_t mask = EVENT_BUFFER_SIZE - 1;
+    batch.clear();
+
+    bus.merged.clear();
+    for (auto& lane : bus.lanes) {
+        bus.merged.insert(bus.merged.end(), lane.begin(), lane.end());
+        lane.clear();
+    }
+    std::sort(bus.merged.begin(), bus.merged.end(), [](const LoggedEvent& a, const LoggedEvent& b) {
+        return a.order < b.order;
+    });
+    for (const auto& logged : bus.merged) {
+        batch.push_back(logged.event);
+    }
+
+    for (;;) {
+        EventCell& cell = bus.cells[bus.readPos & mask];
+        size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        if (sequence != bus.readPos + 1) break;
+
+        batch.push_back(cell.event);
+        cell.sequence.store(bus.readPos + EVENT_BUFFER_SIZE, std::memory_order_release);
+        bus.readPos++;
+    }
+
+    return batch.size();
+}
+
+// Урон по врагу с записью событий. Возвращает true, если враг убит
+bool DamageEnemy(Enemy& enemy, const EnemyArchetypeTable& archetypes, int damage, EventBus& events) {
+    const EnemyArchetype& archetype = GetEnemyArchetype(archetypes, enemy);
+    Vector2 position = GetEnemyPosition(enemy);
+    RecordEvent(events, { EVENT_DAMAGE_DEALT, (unsigned char)archetype.type, damage, position });
+
+    // Урон переводится в единицы здоровья архетипа с округлением, но не меньше одной единицы
+    int units = std::max(1, (damage + ((1 << archetype.healthShift) >> 1)) >> archetype.healthShift);
+    if (units >= enemy.health) {
+        enemy.health = 0;
+        RecordEvent(events, { EVENT_ENEMY_KILLED, (unsigned char)archetype.type, 0, position });
+        STAT_ADD(STAT_ENEMY_KILLS, 1);
+        return true;
+    }
+
+    enemy.health = (unsigned short)(enemy.health - units);
+    return false;
+}
+
+void HitPlayer(int playerIndex, const Player& player, int damage, EventBus& events) {
+    RecordEvent(events, { EVENT_PLAYER_HIT, (unsigned char)playerIndex, damage, player.position });
+}
+
+// Статистика забега (потребитель событий)
+struct RunStats {
+    int kills[3];            // По EnemyType
+    long long damageDealt;
+    long long damageTaken;
+    int upgradesCollected;
+};
+
+// Колесо таймеров
+// Узел таймера лежит в слоте (тик срабатывания & маска). Продвижение на тик просматривает
+// один слот, поэтому срабатывание стоит O(1) и не требует опроса сущностей каждый кадр.
+// Таймер дальше одного оборота (~68 с) остается в слоте до своего оборота.
+// Ставить таймеры можно из систем в рабочих потоках, продвигает колесо главный поток
+const int TIMER_WHEEL_SLOTS = 4096; // Степень двойки
+
+enum TimerKind : unsigned char {
+    TIMER_ABILITY_READY,     // target.slot - номер игрока * ABILITY_COUNT + AbilityId
+    TIMER_BOMB_FUSE,
+    TIMER_FREEZE_EXPIRE,
+    TIMER_FIREBALL_CLEAR,    // Конец взрыва фаербола
+    TIMER_WAVE_SPAWN,        // Очередная запись расписания волны
+    TIMER_STATUS_FREEZE,     // Конец эффекта состояния: TIMER_STATUS_FREEZE + StatusEffectType,
+    TIMER_STATUS_SLOW,       // target - дескриптор врага
+    TIMER_STATUS_BURN,
+    TIMER_STATUS_POISON
+};
+
+struct Timer {
+    unsigned int tick;       // Тик срабатывания
+    TimerKind kind;
+    EntityHandle target;
+    int next;                // Следующий узел слота или свободного списка
+};
+
+typedef TaggedVector<Timer, MEM_SYSTEMS> TimerBatch;
+
+struct TimerWheel {
+    TaggedVector<Timer, MEM_SYSTEMS> nodes;
+    TaggedVector<int, MEM_SYSTEMS> slots;   // Первый узел слота, -1 - пусто
+    int freeNode;
+    unsigned int currentTick;
+    std::mutex lock;
+};
+
+unsigned int SecondsToTicks(double seconds) {
+    return (unsigned int)std::max(1.0, ceil(seconds * SIM_TICK_RATE - 1e-6));
+}
+
+void ResetTimers(TimerWheel& wheel, unsigned int tick) {
+    std::lock_guard<std::mutex> guard(wheel.lock);
+    wheel.nodes.clear();
+    wheel.slots.assign(TIMER_WHEEL_SLOTS, -1);
+    wheel.freeNode = -1;
+    wheel.currentTick = tick;
+}
+
+// Таймер срабатывает в начале тика currentTick + delay (не раньше следующего тика)
+void ScheduleTimer(TimerWheel& wheel, unsigned int delay, TimerKind kind, EntityHandle target) {
+    std::lock_guard<std::mutex> guard(wheel.lock);
+    int node = wheel.freeNode;
+    if (node >= 0) {
+        wheel.freeNode = wheel.nodes[node].next;
+    }
+    else {
+        node = (int)wheel.nodes.size();
+        wheel.nodes.push_back(Timer());
+    }
+
+    Timer& timer = wheel.nodes[node];
+    timer.tick = wheel.currentTick + std::max(1u, delay);
+    timer.kind = kind;
+    timer.target = target;
+
+    int& head = wheel.slots[timer.tick & (TIMER_WHEEL_SLOTS - 1)];
+    timer.next = head;
+    head = node;
+}
+
+bool TimerFiresBefore(const Timer& a, const Timer& b) {
+    if (a.tick != b.tick) return a.tick < b.tick;
+    if (a.kind != b.kind) return a.kind < b.kind;
+    if (a.target.slot != b.target.slot) return a.target.slot < b.target.slot;
+    return a.target.generation < b.target.generation;
+}
+
+// Продвижение колеса до тика. Сработавшие таймеры сортируются, чтобы порядок их обработки
+// не зависел от того, в каком порядке их поставили рабочие потоки
+void AdvanceTimers(TimerWheel& wheel, unsigned int tick, TimerBatch& fired) {
+    fired.clear();
+    std::lock_guard<std::mutex> guard(wheel.lock);
+    while (wheel.currentTick != tick) {
+        wheel.currentTick++;
+        int* link = &wheel.slots[wheel.currentTick & (TIMER_WHEEL_SLOTS - 1)];
+        while (*link >= 0) {
+            int node = *link;
+            Timer& timer = wheel.nodes[node];
+            if (timer.tick != wheel.currentTick) {
+                link = &timer.next;
+                continue;
+            }
+
+            fired.push_back(timer);
+            *link = timer.next;
+            timer.next = wheel.freeNode;
+            wheel.freeNode = node;
+        }
+    }
+
+    std::sort(fired.begin(), fired.end(), TimerFiresBefore);
+}
+
+// Вспомогательные функции для векторов
+Vector2 Vector2Add(Vector2 v1, Vector2 v2) {
+    return { v1.x + v2.x, v1.y + v2.y };
+}
+
+Vector2 Vector2Subtract(Vector2 v1, Vector2 v2) {
+    return { v1.x - v2.x, v1.y - v2.y };
+}
+
+Vector2 Vector2Scale(Vector2 v, float scale) {
+    return { v.x * scale, v.y * scale };
+}
+
+float Vector2Length(Vector2 v) {
+    return sqrtf(v.x * v.x + v.y * v.y);
+}
+
+Vector2 Vector2Normalize(Vector2 v) {
+    float length = Vector2Length(v);
+    if (length > 0) {
+        return { v.x / length, v.y / length };
+    }
+    return { 0, 0 };
+}
+
+float Vector2Distance(Vector2 v1, Vector2 v2) {
+    float dx = v1.x - v2.x;
+    float dy = v1.y - v2.y;
+    return sqrtf(dx * dx + dy * dy);
+}
+
+// Функции для камеры и отсечения
+// Видимая высота мира не зависит от разрешения и DPI экрана: камера масштабируется так,
+// чтобы по вертикали помещалось VIEW_HEIGHT единиц мира (как на эталонном 1080p без окна)
+const float VIEW_HEIGHT = 1080.0f;
+
+// Размер экрана; без окна (безголовые режимы) - эталонный 1920x1080
+Vector2 GetViewSize() {
+    if (!IsWindowReady()) return { 1920.0f, 1080.0f };
+    return { (float)GetScreenWidth(), (float)GetScreenHeight() };
+}
+
+Rectangle GetCameraView(const Camera2D& camera) {
+    Vector2 size = GetViewSize();
+    float width = size.x / camera.zoom;
+    float height = size.y / camera.zoom;
+    return { camera.target.x - camera.offset.x / camera.zoom, camera.target.y - camera.offset.y / camera.zoom, width, height };
+}
+
+Rectangle ExpandRect(const Rectangle& rect, float margin) {
+    return { rect.x - margin, rect.y - margin, rect.width + margin * 2, rect.height + margin * 2 };
+}
+
+bool IsPointInRect(Vector2 point, const Rectangle& rect) {
+    return point.x >= rect.x && point.x <= rect.x + rect.width &&
+        point.y >= rect.y && point.y <= rect.y + rect.height;
+}
+
+bool IsCircleVisible(Vector2 center, float radius, const Rectangle& view) {
+    return center.x + radius >= view.x && center.x - radius <= view.x + view.width &&
+        center.y + radius >= view.y && center.y - radius <= view.y + view.height;
+}
+
+void UpdateCamera(Camera2D& camera, Vector2 target) {
+    Vector2 size = GetViewSize();
+
+    camera.offset = { size.x / 2.0f, size.y / 2.0f };
+    camera.rotation = 0.0f;
+    camera.zoom = size.y / VIEW_HEIGHT;
+
+    // Камера не выходит за границы мира
+    float halfWidth = camera.offset.x / camera.zoom;
+    float halfHeight = camera.offset.y / camera.zoom;
+    camera.target.x = std::max(halfWidth, std::min(WORLD_WIDTH - halfWidth, target.x));
+    camera.target.y = std::max(halfHeight, std::min(WORLD_HEIGHT - halfHeight, target.y));
+}
+
+// Масштаб интерфейса: HUD рисуется в родном разрешении экрана, размеры заданы для 1080p
+float GetUiScale() {
+    return std::max(0.75f, GetViewSize().y / VIEW_HEIGHT);
+}
+
+// Динамическое разрешение мира
+// Мир рисуется в текстуру размером с экран, но только в ее левый верхний угол
+// scale * экран, и растягивается на экран с билинейной фильтрацией. Текстура не
+// пересоздается при смене масштаба. Raylib не дает запросов времени GPU, поэтому
+// мерой служит время от начала текстуры мира до возврата из EndDrawing: когда GPU
+// не успевает, обмен буферов ждет его и замер выходит за бюджет. Частота кадров
+// ограничивается вручную (WaitFrameBudget) уже после замера, SetTargetFPS не используется
+const float RENDER_SCALE_MIN = 0.5f;
+const float RENDER_SCALE_STEP = 0.05f;
+const int RENDER_SCALE_HOLD_FRAMES = 30;    // После смены масштаба ждем, пока устоится замер
+const int RENDER_SCALE_PROBE_FRAMES = 90;   // Кадров в бюджете перед попыткой поднять разрешение
+
+struct DynamicResolution {
+    RenderTexture2D target;
+    int width;               // Размер текстуры (экран)
+    int height;
+    float scale;             // Доля разрешения экрана по каждой оси
+    float fixedScale;        // > 0 - масштаб задан параметром и не меняется
+    double frameMs;          // Сглаженное время отрисовки кадра
+    int framesInBudget;
+    int framesSinceChange;
+};
+
+void AllocateRenderTarget(DynamicResolution& resolution) {
+    Vector2 size = GetViewSize();
+    resolution.width = (int)size.x;
+    resolution.height = (int)size.y;
+    resolution.target = LoadRenderTexture(resolution.width, resolution.height);
+    SetTextureFilter(resolution.target.texture, TEXTURE_FILTER_BILINEAR);
+}
+
+DynamicResolution CreateDynamicResolution(float fixedScale) {
+    DynamicResolution resolution;
+    AllocateRenderTarget(resolution);
+    resolution.fixedScale = fixedScale > 0.0f ? std::max(RENDER_SCALE_MIN, std::min(1.0f, fixedScale)) : 0.0f;
+    resolution.scale = resolution.fixedScale > 0.0f ? resolution.fixedScale : 1.0f;
+    resolution.frameMs = 1000.0 / TARGET_FPS;
+    resolution.framesInBudget = 0;
+    resolution.framesSinceChange = 0;
+    return resolution;
+}
+
+void UnloadDynamicResolution(DynamicResolution& resolution) {
+    UnloadRenderTexture(resolution.target);
+}
+
+// Ограничитель частоты кадров вместо SetTargetFPS: досыпает остаток бюджета кадра
+// в конце итерации главного цикла, после замера отрисовки
+void WaitFrameBudget(std::chrono::steady_clock::time_point frameStart) {
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - frameStart).count();
+    double remaining = 1.0 / TARGET_FPS - elapsed;
+    if (remaining > 0.0) {
+        WaitTime(remaining);
+    }
+}
+
+// Раз в кадр игры по времени отрисовки предыдущего кадра: от начала текстуры мира до
+// конца EndDrawing, включая обмен буферов. Догоняющие тики симуляции идут до замера,
+// ожидание ограничителя частоты кадров - после, масштаб на них не влияет
+void UpdateDynamicResolution(DynamicResolution& resolution, double renderSeconds) {
+    Vector2 size = GetViewSize();
+    if ((int)size.x != resolution.width || (int)size.y != resolution.height) {
+        UnloadRenderTexture(resolution.target);
+        AllocateRenderTarget(resolution);
+    }
+    if (resolution.fixedScale > 0.0f) return;
+
+    double budgetMs = 1000.0 / TARGET_FPS;
+    resolution.frameMs += (renderSeconds * 1000.0 - resolution.frameMs) * 0.1;
+    resolution.framesSinceChange++;
+    if (resolution.framesSinceChange < RENDER_SCALE_HOLD_FRAMES) return;
+
+    if (resolution.frameMs > budgetMs * 1.1) {
+        // Стоимость растет с числом пикселей, то есть с квадратом масштаба
+        float target = resolution.scale * (float)sqrt(budgetMs * 0.9 / resolution.frameMs);
+        resolution.scale = std::max(RENDER_SCALE_MIN, std::min(resolution.scale - RENDER_SCALE_STEP, target));
+        resolution.framesSinceChange = 0;
+        resolution.framesInBudget = 0;
+    }
+    else if (resolution.frameMs < budgetMs * 1.02) {
+        resolution.framesInBudget++;
+        if (resolution.framesInBudget >= RENDER_SCALE_PROBE_FRAMES && resolution.scale < 1.0f) {
+            resolution.scale = std::min(1.0f, resolution.scale + RENDER_SCALE_STEP);
+            resolution.framesSinceChange = 0;
+            resolution.framesInBudget = 0;
+        }
+    }
+    else {
+        resolution.framesInBudget = 0;
+    }
+}
+
+int GetWorldRenderWidth(const DynamicResolution& resolution) {
+    return std::max(1, (int)(resolution.width * resolution.scale));
+}
+
+int GetWorldRenderHeight(const DynamicResolution& resolution) {
+    return std::max(1, (int)(resolution.height * resolution.scale));
+}
+
+// Камера для отрисовки в уменьшенную область. Отсечение и игровая логика
+// продолжают работать с обычной камерой
+Camera2D GetRenderCamera(const DynamicResolution& resolution, const Camera2D& camera) {
+    float scaleX = (float)GetWorldRenderWidth(resolution) / resolution.width;
+    float scaleY = (float)GetWorldRenderHeight(resolution) / resolution.height;
+    Camera2D renderCamera = camera;
+    renderCamera.offset.x *= scaleX;
+    renderCamera.offset.y *= scaleY;
+    renderCamera.zoom *= scaleY;
+    return renderCamera;
+}
+
+// Растягивает нарисованную область на весь экран (текстуры рендера перевернуты по Y)
+void DrawRenderTarget(const DynamicResolution& resolution) {
+    float width = (float)GetWorldRenderWidth(resolution);
+    float height = (float)GetWorldRenderHeight(resolution);
+    Rectangle source = { 0.0f, resolution.height - height, width, -height };
+    Rectangle destination = { 0.0f, 0.0f, (float)resolution.width, (float)resolution.height };
+    DrawTexturePro(resolution.target.texture, source, destination, { 0.0f, 0.0f }, 0.0f, WHITE);
+}
+
+// Пакет врагов пониженной детализации для движения одним проходом
+struct EnemyMoveBatch {
+    TaggedVector<int, MEM_ENEMIES> index;
+    TaggedVector<float, MEM_ENEMIES> x;
+    TaggedVector<float, MEM_ENEMIES> y;
+    TaggedVector<float, MEM_ENEMIES> targetX; // Ближайший игрок на момент постановки
+    TaggedVector<float, MEM_ENEMIES> targetY;
+    TaggedVector<float, MEM_ENEMIES> step;   // Максимальный путь за пропущенные кадры
+    TaggedVector<float, MEM_ENEMIES> range;  // Дистанция атаки (ближе к игроку не подходим)
+};
+
+// Пространственные чанки
+// Враги раскладываются по чанкам сортировкой подсчетом раз в кадр
+struct ChunkGrid {
+    int columns;
+    int rows;
+    TaggedVector<int, MEM_ENEMIES> chunkStart;  // Начало диапазона чанка в enemyOrder (columns * rows + 1)
+    TaggedVector<int, MEM_ENEMIES> enemyOrder;  // Индексы врагов, отсортированные по чанкам
+    TaggedVector<int, MEM_ENEMIES> enemyChunk;  // Чанк каждого врага
+    TaggedVector<int, MEM_ENEMIES> cursor;      // Рабочий массив сортировки
+    int activeMinX, activeMinY;   // Прямоугольник активных чанков (включительно)
+    int activeMaxX, activeMaxY;
+    Rectangle fullDetailArea;     // Область полной детализации врагов (экран с запасом)
+};
+
+ChunkGrid CreateChunkGrid() {
+    ChunkGrid grid;
+    grid.columns = (int)ceilf(WORLD_WIDTH / CHUNK_SIZE);
+    grid.rows = (int)ceilf(WORLD_HEIGHT / CHUNK_SIZE);
+    grid.chunkStart.assign(grid.columns * grid.rows + 1, 0);
+    grid.activeMinX = grid.activeMinY = 0;
+    grid.activeMaxX = grid.columns - 1;
+    grid.activeMaxY = grid.rows - 1;
+    grid.fullDetailArea = { 0, 0, WORLD_WIDTH, WORLD_HEIGHT };
+    return grid;
+}
+
+int GetChunkCoord(float value, int count) {
+    int coord = (int)floorf(value / CHUNK_SIZE);
+    return std::max(0, std::min(count - 1, coord));
+}
+
+// Активны чанки, пересекающие видимую область с запасом в один чанк
+void SetActiveChunks(ChunkGrid& grid, const Rectangle& view) {
+    grid.activeMinX = GetChunkCoord(view.x, grid.columns) - 1;
+    grid.activeMinY = GetChunkCoord(view.y, grid.rows) - 1;
+    grid.activeMaxX = GetChunkCoord(view.x + view.width, grid.columns) + 1;
+    grid.activeMaxY = GetChunkCoord(view.y + view.height, grid.rows) + 1;
+    grid.fullDetailArea = ExpandRect(view, LOD_PROMOTION_MARGIN);
+}
+
+// Все чанки активны, все враги в полной детализации (для сравнения в бенчмарке)
+void DisableEnemyLod(ChunkGrid& grid) {
+    grid.activeMinX = 0;
+    grid.activeMinY = 0;
+    grid.activeMaxX = grid.columns - 1;
+    grid.activeMaxY = grid.rows - 1;
+    grid.fullDetailArea = { -WORLD_WIDTH, -WORLD_HEIGHT, WORLD_WIDTH * 3, WORLD_HEIGHT * 3 };
+}
+
+bool IsChunkActive(const ChunkGrid& grid, int chunkX, int chunkY) {
+    return chunkX >= grid.activeMinX && chunkX <= grid.activeMaxX &&
+        chunkY >= grid.activeMinY && chunkY <= grid.activeMaxY;
+}
+
+// Область, в которой живут снаряды (активные чанки)
+Rectangle GetActiveArea(const ChunkGrid& grid) {
+    return {
+        grid.activeMinX * CHUNK_SIZE,
+        grid.activeMinY * CHUNK_SIZE,
+        (grid.activeMaxX - grid.activeMinX + 1) * CHUNK_SIZE,
+        (grid.activeMaxY - grid.activeMinY + 1) * CHUNK_SIZE
+    };
+}
+
+// Функции для кнопок
+bool IsButtonHovered(Button& button) {
+    button.hovered = CheckCollisionPointRec(GetMousePosition(), button.bounds);
+    return button.hovered;
+}
+
+bool IsButtonClicked(Button& button) {
+    return IsButtonHovered(button) && IsMouseButtonPressed(MOUSE_LEFT_BUTTON);
+}
+
+void DrawButton(Button& button) {
+    Color color = button.hovered ? COLOR_BUTTON_HOVER : COLOR_BUTTON;
+    DrawRectangleRec(button.bounds, color);
+    DrawRectangleLinesEx(button.bounds, 2, WHITE);
+
+    int textWidth = MeasureText(button.text, 20);
+    int textX = button.bounds.x + (button.bounds.width - textWidth) / 2;
+    int textY = button.bounds.y + (button.bounds.height - 20) / 2;
+
+    DrawText(button.text, textX, textY, 20, WHITE);
+}
+
+// Событийная перерисовка меню
+// Вне PLAYING экран меняется только от ввода, поэтому ждем событий и перерисовываем
+// только при изменении наведения или данных
+struct FrameCounter {
+    long long loopIterations;   // Итерации главного цикла
+    long long presentedFrames;  // Реально отрисованные кадры
+    long long skippedFrames;    // Пропущенные кадры меню (ничего не изменилось)
+};
+
+struct MenuRedrawState {
+    bool eventWaiting;          // Включено ли ожидание событий
+    bool valid;                 // Есть ли на экране актуальный кадр
+    GameState lastState;
+    unsigned int lastSignature;
+};
+
+unsigned int HashCombine(unsigned int seed, unsigned int value) {
+    return seed ^ (value + 0x9e3779b9u + (seed << 6) + (seed >> 2));
+}
+
+unsigned int ButtonSignature(unsigned int seed, const Button& button) {
+    return HashCombine(seed, button.hovered ? 1u : 0u);
+}
+
+unsigned int MetaSignature(unsigned int seed, const MetaProgression& meta) {
+    seed = HashCombine(seed, (unsigned int)meta.totalPoints);
+    seed = HashCombine(seed, (unsigned int)meta.availablePoints);
+    seed = HashCombine(seed, (unsigned int)meta.healthLevel);
+    seed = HashCombine(seed, (unsigned int)meta.damageLevel);
+    seed = HashCombine(seed, (unsigned int)meta.speedLevel);
+    seed = HashCombine(seed, (unsigned int)meta.attackSpeedLevel);
+    seed = HashCombine(seed, (unsigned int)meta.projectileCountLevel);
+    seed = HashCombine(seed, (meta.hasBombAbility ? 1u : 0u) | (meta.hasFreezeAbility ? 2u : 0u) | (meta.hasWaveAbility ? 4u : 0u));
+    return seed;
+}
+
+// Включает ожидание событий во всех состояниях, кроме PLAYING.
+// backgroundWork - кадры нужны и без ввода (например, идет загрузка ресурсов)
+void UpdatePresentationMode(MenuRedrawState& redraw, GameState state, bool backgroundWork) {
+    bool wantWaiting = (state != PLAYING) && !backgroundWork;
+    if (wantWaiting != redraw.eventWaiting) {
+        if (wantWaiting) {
+            EnableEventWaiting();
+        }
+        else {
+            DisableEventWaiting();
+        }
+        redraw.eventWaiting = wantWaiting;
+        redraw.valid = false;
+    }
+}
+
+// Возвращает true, если кадр меню нужно перерисовать.
+// Иначе блокируется до следующего события ввода
+bool MenuNeedsRedraw(MenuRedrawState& redraw, GameState state, unsigned int signature, FrameCounter& frames) {
+    signature = HashCombine(signature, (unsigned int)GetScreenWidth());
+    signature = HashCombine(signature, (unsigned int)GetScreenHeight());
+
+    if (redraw.valid && redraw.lastState == state && redraw.lastSignature == signature) {
+        frames.skippedFrames++;
+        PollInputEvents();
+        if (!redraw.eventWaiting) {
+            // Ожидание выключено ради фоновой работы: не крутим цикл вхолостую
+            WaitTime(1.0 / TARGET_FPS);
+        }
+        return false;
+    }
+
+    redraw.valid = true;
+    redraw.lastState = state;
+    redraw.lastSignature = signature;
+    frames.presentedFrames++;
+    return true;
+}
+
+// Функции для джойстика
+Joystick CreateJoystick() {
+    Joystick joystick;
+    int screenWidth = GetScreenWidth();
+    int screenHeight = GetScreenHeight();
+
+    joystick.outerRadius = 100.0f * SIZE_MULTIPLIER;
+    joystick.innerRadius = 40.0f * SIZE_MULTIPLIER;
+
+    joystick.position = {
+        joystick.outerRadius + 80.0f,
+        screenHeight - joystick.outerRadius - 60.0f
+    };
 
     joystick.touchPosition = joystick.position;
     joystick.isActive = false;
@@ -350,1170 +1870,6071 @@ Joystick CreateJoystick() {
     return joystick;
 }
 
-void UpdateJoystick(Joystick& joystick) {
-    if (IsMouseButtonDown(MOUSE_LEFT_BUTTON)) {
-        Vector2 touchPos = GetMousePosition();
-        float distance = Vector2Distance(touchPos, joystick.position);
+void UpdateJoystick(Joystick& joystick) {
+    if (IsMouseButtonDown(MOUSE_LEFT_BUTTON)) {
+        Vector2 touchPos = GetMousePosition();
+        float distance = Vector2Distance(touchPos, joystick.position);
+
+        if (!joystick.isActive && distance < joystick.outerRadius * 1.5f) {
+            joystick.isActive = true;
+        }
+
+        if (joystick.isActive) {
+            Vector2 direction = { touchPos.x - joystick.position.x, touchPos.y - joystick.position.y };
+            float dist = Vector2Length(direction);
+
+            float maxDistance = joystick.outerRadius - joystick.innerRadius * 0.3f;
+            if (dist > maxDistance) {
+                float scale = maxDistance / dist;
+                direction = Vector2Scale(direction, scale);
+            }
+
+            joystick.touchPosition = Vector2Add(joystick.position, direction);
+
+            if (dist > 5.0f) {
+                joystick.direction = Vector2Normalize(direction);
+            }
+            else {
+                joystick.direction = { 0, 0 };
+            }
+        }
+    }
+    else {
+        joystick.isActive = false;
+        joystick.touchPosition = joystick.position;
+        joystick.direction = { 0, 0 };
+    }
+}
+
+// Ввод тика из джойстика (или автопилота) и, в окне, клавиш WASD
+PlayerInput SamplePlayerInput(const Joystick& joystick, bool useKeyboard) {
+    Vector2 movement = { 0, 0 };
+    if (useKeyboard) {
+        if (IsKeyDown(KEY_A)) movement.x -= 1;
+        if (IsKeyDown(KEY_D)) movement.x += 1;
+        if (IsKeyDown(KEY_W)) movement.y -= 1;
+        if (IsKeyDown(KEY_S)) movement.y += 1;
+    }
+
+    if (joystick.isActive) {
+        movement.x += joystick.direction.x;
+        movement.y += joystick.direction.y;
+    }
+
+    PlayerInput input = { 0, 0 };
+    float length = Vector2Length(movement);
+    if (length > 0) {
+        input.moveX = (signed char)lroundf(movement.x / length * 127.0f);
+        input.moveY = (signed char)lroundf(movement.y / length * 127.0f);
+    }
+    return input;
+}
+
+void DrawJoystick(const Joystick& joystick) {
+    DrawCircleV(joystick.position, joystick.outerRadius, COLOR_JOYSTICK_BG);
+    DrawCircleV(joystick.touchPosition, joystick.innerRadius, COLOR_JOYSTICK);
+}
+
+// Автопилот: источник ввода на месте джойстика (--autopilot, F2, безголовые прогоны).
+// Уходит от угроз в радиусе AUTOPILOT_THREAT_RADIUS (ближние сильнее), держится
+// подальше от краев мира и подбирает улучшения, если рядом нет угроз
+const float AUTOPILOT_THREAT_RADIUS = 450.0f;
+const float AUTOPILOT_UPGRADE_RADIUS = 700.0f;
+const float AUTOPILOT_EDGE_MARGIN = 900.0f;
+
+void UpdateAutopilot(Joystick& joystick, const Player& player, const EnemyArchetypeTable& archetypes, const ComponentPool<Enemy>& enemies,
+    const ComponentPool<EnemyProjectile>& projectiles, const ComponentPool<Upgrade>& upgrades) {
+    Vector2 steer = { 0, 0 };
+    float threat = 0.0f;
+
+    for (const auto& enemy : enemies) {
+        Vector2 away = Vector2Subtract(player.position, GetEnemyPosition(enemy));
+        float distance = Vector2Length(away);
+        float reach = AUTOPILOT_THREAT_RADIUS + GetEnemyArchetype(archetypes, enemy).attackRange;
+        if (distance >= reach || distance <= 0.0f) continue;
+
+        float weight = (reach - distance) / reach;
+        weight *= weight;
+        steer = Vector2Add(steer, Vector2Scale(away, weight / distance));
+        threat += weight;
+    }
+
+    for (const auto& projectile : projectiles) {
+        Vector2 away = Vector2Subtract(player.position, projectile.position);
+        float distance = Vector2Length(away);
+        if (distance >= AUTOPILOT_THREAT_RADIUS || distance <= 0.0f) continue;
+
+        float weight = 2.0f * (AUTOPILOT_THREAT_RADIUS - distance) / AUTOPILOT_THREAT_RADIUS;
+        steer = Vector2Add(steer, Vector2Scale(away, weight / distance));
+        threat += weight;
+    }
+
+    // Отталкивание от краев, чтобы не зажиматься в углу
+    float edges[4] = {
+        player.position.x, WORLD_WIDTH - player.position.x,
+        player.position.y, WORLD_HEIGHT - player.position.y
+    };
+    Vector2 edgeDirections[4] = { { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 } };
+    for (int i = 0; i < 4; i++) {
+        if (edges[i] >= AUTOPILOT_EDGE_MARGIN) continue;
+        float weight = (AUTOPILOT_EDGE_MARGIN - edges[i]) / AUTOPILOT_EDGE_MARGIN;
+        steer = Vector2Add(steer, Vector2Scale(edgeDirections[i], weight * std::max(1.0f, threat)));
+    }
+
+    if (threat < 0.05f) {
+        const Upgrade* nearest = nullptr;
+        float nearestDistance = AUTOPILOT_UPGRADE_RADIUS;
+        for (const auto& upgrade : upgrades) {
+            float distance = Vector2Distance(player.position, upgrade.position);
+            if (distance < nearestDistance) {
+                nearestDistance = distance;
+                nearest = &upgrade;
+            }
+        }
+        if (nearest != nullptr) {
+            steer = Vector2Add(steer, Vector2Normalize(Vector2Subtract(nearest->position, player.position)));
+        }
+    }
+
+    float length = Vector2Length(steer);
+    joystick.isActive = length > 0.01f;
+    joystick.direction = joystick.isActive ? Vector2Scale(steer, 1.0f / length) : Vector2{ 0, 0 };
+    float maxDistance = joystick.outerRadius - joystick.innerRadius * 0.3f;
+    joystick.touchPosition = Vector2Add(joystick.position, Vector2Scale(joystick.direction, maxDistance));
+}
+
+// Функции для игрока
+Player CreatePlayer(const MetaProgression& meta) {
+    const TuningConfig& tuning = GetTuning();
+    Player player;
+
+    player.position = { WORLD_WIDTH / 2.0f, WORLD_HEIGHT / 2.0f };
+    player.radius = tuning.playerRadius * SIZE_MULTIPLIER;
+
+    float baseSpeed = tuning.playerSpeed;
+    int baseHealth = tuning.playerHealth;
+    int baseDamage = tuning.playerDamage;
+    float baseAttackSpeed = tuning.playerAttackSpeed;
+
+    player.speed = std::max(1.0f, baseSpeed * meta.GetSpeedBonus());
+    player.maxHealth = std::max(50, (int)(baseHealth * meta.GetHealthBonus()));
+    player.health = player.maxHealth;
+    player.damage = std::max(5, (int)(baseDamage * meta.GetDamageBonus()));
+    player.attackSpeed = std::max(0.1f, baseAttackSpeed * meta.GetAttackSpeedBonus());
+    player.projectileCount = meta.GetProjectileCount();
+
+    player.abilityReady = (1u << ABILITY_COUNT) - 1;
+    for (int ability = 0; ability < ABILITY_COUNT; ability++) {
+        player.abilityReadyTick[ability] = 0;
+    }
+
+    player.hasDoubleShot = false;
+    ForEachAbility([&](auto ability) {
+        typedef decltype(ability) Ability;
+        GetAbilityState<Ability>(player) = Ability::Create(tuning, meta, player);
+    });
+
+    return player;
+}
+
+bool IsAbilityReady(const Player& player, AbilityId ability) {
+    return (player.abilityReady & (1u << ability)) != 0;
+}
+
+// Запуск перезарядки: готовность вернет таймер TIMER_ABILITY_READY
+void StartCooldown(int playerIndex, Player& player, AbilityId ability, double seconds, TimerWheel& timers) {
+    unsigned int ticks = SecondsToTicks(seconds);
+    player.abilityReady &= ~(1u << ability);
+    player.abilityReadyTick[ability] = timers.currentTick + ticks;
+    ScheduleTimer(timers, ticks, TIMER_ABILITY_READY, { (unsigned int)(playerIndex * ABILITY_COUNT + ability), 0 });
+}
+
+double GetCooldownRemaining(const Player& player, AbilityId ability, unsigned int tick) {
+    if (IsAbilityReady(player, ability) || player.abilityReadyTick[ability] <= tick) return 0.0;
+    return (player.abilityReadyTick[ability] - tick) * SIM_TICK_SECONDS;
+}
+
+// Что нужно способностям при срабатывании
+struct AbilityContext {
+    int playerIndex;
+    Player& player;
+    const TuningConfig& tuning;
+    TimerWheel& timers;
+    const ComponentPool<Enemy>& enemies;
+    ComponentPool<Shockwave>& shockwaves;
+    ComponentPool<Bomb>& bombs;
+    ComponentPool<FreezeArea>& freezeAreas;
+    ComponentPool<Fireball>& fireballs;
+};
+
+// Повторный подбор способности сокращает перезарядку до нижней границы
+double ReduceCooldown(double cooldown, double minCooldown, const TuningConfig& tuning) {
+    return std::max(minCooldown, cooldown * tuning.upgradeCooldownFactor);
+}
+
+// Смена настроек на ходу: множители мета-прогрессии и сокращения перезарядки сохраняются
+// пропорционально, прибавки улучшений - сдвигом на разность базовых значений
+double RescaleTuned(double value, double previousBase, double nextBase) {
+    return value * (nextBase / previousBase);
+}
+
+// Волна летит к центру врагов рядом (или к ближайшему врагу)
+WaveAbility::State WaveAbility::Create(const TuningConfig& tuning, const MetaProgression& meta, const Player&) {
+    return { meta.hasWaveAbility, tuning.waveCooldown, tuning.waveDamage };
+}
+
+bool WaveAbility::Activate(AbilityContext& context, State& state) {
+    const TuningConfig& tuning = context.tuning;
+    const Player& player = context.player;
+    if (context.enemies.empty()) return false;
+
+    Shockwave shockwave;
+    shockwave.position = player.position;
+    shockwave.radius = tuning.waveStartRadius * SIZE_MULTIPLIER;
+
+    Vector2 averagePosition = { 0, 0 };
+    int enemyCount = 0;
+
+    for (const auto& enemy : context.enemies) {
+        Vector2 enemyPosition = GetEnemyPosition(enemy);
+        float distance = Vector2Distance(player.position, enemyPosition);
+        if (distance < tuning.waveTargetRange * SIZE_MULTIPLIER) {
+            averagePosition.x += enemyPosition.x;
+            averagePosition.y += enemyPosition.y;
+            enemyCount++;
+        }
+    }
+
+    Vector2 waveDirection = { 0, 1 };
+
+    if (enemyCount > 0) {
+        averagePosition.x /= enemyCount;
+        averagePosition.y /= enemyCount;
+        waveDirection = Vector2Subtract(averagePosition, player.position);
+        waveDirection = Vector2Normalize(waveDirection);
+    }
+    else {
+        float min_distance = FLT_MAX;
+        for (const auto& enemy : context.enemies) {
+            Vector2 enemyPosition = GetEnemyPosition(enemy);
+            float distance = Vector2Distance(player.position, enemyPosition);
+            if (distance < min_distance) {
+                min_distance = distance;
+                waveDirection = Vector2Subtract(enemyPosition, player.position);
+                waveDirection = Vector2Normalize(waveDirection);
+            }
+        }
+    }
+
+    shockwave.direction = waveDirection;
+    shockwave.speed = tuning.waveSpeed;
+    shockwave.damage = state.damage;
+    shockwave.sweptPosition = shockwave.position;
+    shockwave.sweptRadius = 0.0f;
+    shockwave.active = true;
+    context.shockwaves.push_back(shockwave);
+    return true;
+}
+
+void WaveAbility::Upgrade(State& state, const TuningConfig& tuning) {
+    state.cooldown = ReduceCooldown(state.cooldown, tuning.waveMinCooldown, tuning);
+    state.damage += tuning.upgradeWaveDamage;
+}
+
+void WaveAbility::Retune(State& state, const TuningConfig& previous, const TuningConfig& next) {
+    state.cooldown = RescaleTuned(state.cooldown, previous.waveCooldown, next.waveCooldown);
+    state.damage += next.waveDamage - previous.waveDamage;
+}
+
+// Бомба взрывается по таймеру TIMER_BOMB_FUSE
+BombAbility::State BombAbility::Create(const TuningConfig& tuning, const MetaProgression& meta, const Player&) {
+    return { meta.hasBombAbility, tuning.bombCooldown, tuning.bombDamage, tuning.bombRadius * SIZE_MULTIPLIER };
+}
+
+bool BombAbility::Activate(AbilityContext& context, State& state) {
+    unsigned int fuse = SecondsToTicks(context.tuning.bombFuse);
+    Bomb bomb;
+    bomb.position = context.player.position;
+    bomb.explodeTick = context.timers.currentTick + fuse;
+    bomb.explosionRadius = state.radius;
+    bomb.damage = state.damage;
+    bomb.active = true;
+    bomb.exploded = false;
+    ScheduleTimer(context.timers, fuse, TIMER_BOMB_FUSE, context.bombs.push_back(bomb));
+    return true;
+}
+
+void BombAbility::Upgrade(State& state, const TuningConfig& tuning) {
+    state.cooldown = ReduceCooldown(state.cooldown, tuning.bombMinCooldown, tuning);
+    state.damage += tuning.upgradeBombDamage;
+    state.radius += tuning.upgradeBombRadius * SIZE_MULTIPLIER;
+}
+
+void BombAbility::Retune(State& state, const TuningConfig& previous, const TuningConfig& next) {
+    state.cooldown = RescaleTuned(state.cooldown, previous.bombCooldown, next.bombCooldown);
+    state.damage += next.bombDamage - previous.bombDamage;
+    state.radius += (next.bombRadius - previous.bombRadius) * SIZE_MULTIPLIER;
+}
+
+// Область заморозки вокруг игрока, снимается таймером TIMER_FREEZE_EXPIRE
+FreezeAbility::State FreezeAbility::Create(const TuningConfig& tuning, const MetaProgression& meta, const Player&) {
+    return { meta.hasFreezeAbility, tuning.freezeCooldown, tuning.freezeDuration, tuning.freezeRadius * SIZE_MULTIPLIER };
+}
+
+bool FreezeAbility::Activate(AbilityContext& context, State& state) {
+    FreezeArea freeze;
+    freeze.position = context.player.position;
+    freeze.radius = state.radius;
+    freeze.expireTick = context.timers.currentTick + SecondsToTicks(state.duration);
+    freeze.active = true;
+    ScheduleTimer(context.timers, SecondsToTicks(state.duration), TIMER_FREEZE_EXPIRE, context.freezeAreas.push_back(freeze));
+    return true;
+}
+
+void FreezeAbility::Upgrade(State& state, const TuningConfig& tuning) {
+    state.cooldown = ReduceCooldown(state.cooldown, tuning.freezeMinCooldown, tuning);
+    state.duration += tuning.upgradeFreezeDuration;
+    state.radius += tuning.upgradeFreezeRadius * SIZE_MULTIPLIER;
+}
+
+void FreezeAbility::Retune(State& state, const TuningConfig& previous, const TuningConfig& next) {
+    state.cooldown = RescaleTuned(state.cooldown, previous.freezeCooldown, next.freezeCooldown);
+    state.duration += next.freezeDuration - previous.freezeDuration;
+    state.radius += (next.freezeRadius - previous.freezeRadius) * SIZE_MULTIPLIER;
+}
+
+// Фаербол летит в ближайшего врага; только из улучшения в забеге
+FireballAbility::State FireballAbility::Create(const TuningConfig& tuning, const MetaProgression&, const Player& player) {
+    return { false, tuning.fireballCooldown, tuning.fireballDamage + player.damage / 2,
+        tuning.fireballExplosionRadius * SIZE_MULTIPLIER, tuning.fireballSpeed };
+}
+
+bool FireballAbility::Activate(AbilityContext& context, State& state) {
+    const Player& player = context.player;
+    float min_distance = FLT_MAX;
+    const Enemy* nearest_enemy = nullptr;
+    for (const auto& enemy : context.enemies) {
+        float distance = Vector2Distance(player.position, GetEnemyPosition(enemy));
+        if (distance < min_distance) {
+            min_distance = distance;
+            nearest_enemy = &enemy;
+        }
+    }
+    if (nearest_enemy == nullptr) return false;
+
+    Fireball fireball;
+    fireball.position = player.position;
+
+    Vector2 direction = Vector2Subtract(GetEnemyPosition(*nearest_enemy), player.position);
+    direction = Vector2Normalize(direction);
+
+    fireball.velocity.x = direction.x * state.speed;
+    fireball.velocity.y = direction.y * state.speed;
+    fireball.radius = context.tuning.fireballRadius * SIZE_MULTIPLIER;
+    fireball.damage = state.damage + player.damage / 2;
+    fireball.explosionRadius = state.explosionRadius;
+    fireball.active = true;
+    fireball.exploded = false;
+    fireball.detonated = false;
+
+    context.fireballs.push_back(fireball);
+    return true;
+}
+
+void FireballAbility::Upgrade(State& state, const TuningConfig& tuning) {
+    state.cooldown = ReduceCooldown(state.cooldown, tuning.fireballMinCooldown, tuning);
+    state.damage += tuning.upgradeFireballDamage;
+    state.explosionRadius += tuning.upgradeFireballRadius * SIZE_MULTIPLIER;
+}
+
+void FireballAbility::Retune(State& state, const TuningConfig& previous, const TuningConfig& next) {
+    state.cooldown = RescaleTuned(state.cooldown, previous.fireballCooldown, next.fireballCooldown);
+    state.damage += next.fireballDamage - previous.fireballDamage;
+    state.explosionRadius += (next.fireballExplosionRadius - previous.fireballExplosionRadius) * SIZE_MULTIPLIER;
+    state.speed = next.fireballSpeed;
+}
+
+// Характеристики игрока, скопированные из настроек в CreatePlayer, под новые настройки.
+// Здоровье сохраняет долю от максимума
+void RetunePlayer(Player& player, const TuningConfig& previous, const TuningConfig& next) {
+    float healthFraction = (float)player.health / player.maxHealth;
+    player.radius = next.playerRadius * SIZE_MULTIPLIER;
+    player.speed = (float)RescaleTuned(player.speed, previous.playerSpeed, next.playerSpeed);
+    player.maxHealth = std::max(1, (int)RescaleTuned(player.maxHealth, previous.playerHealth, next.playerHealth));
+    player.health = std::min(player.maxHealth, (int)ceilf(healthFraction * player.maxHealth));
+    player.damage = std::max(1, (int)RescaleTuned(player.damage, previous.playerDamage, next.playerDamage));
+    player.attackSpeed = (float)RescaleTuned(player.attackSpeed, previous.playerAttackSpeed, next.playerAttackSpeed);
+
+    ForEachAbility([&](auto ability) {
+        typedef decltype(ability) Ability;
+        Ability::Retune(GetAbilityState<Ability>(player), previous, next);
+    });
+}
+
+void UpdatePlayer(int playerIndex, Player& player, const PlayerInput& input, TimerWheel& timers, ComponentPool<Bullet>& bullets, const ComponentPool<Enemy>& enemies, ComponentPool<Shockwave>& shockwaves, ComponentPool<Bomb>& bombs, ComponentPool<FreezeArea>& freezeAreas, ComponentPool<Fireball>& fireballs, EventBus& events) {
+    const TuningConfig& tuning = GetTuning();
+    Vector2 movement = { (float)input.moveX, (float)input.moveY };
+
+    if (movement.x != 0 || movement.y != 0) {
+        float length = sqrtf(movement.x * movement.x + movement.y * movement.y);
+        movement.x /= length;
+        movement.y /= length;
+
+        player.position.x += movement.x * player.speed;
+        player.position.y += movement.y * player.speed;
+
+        player.position.x = std::max(player.radius, std::min(WORLD_WIDTH - player.radius, player.position.x));
+        player.position.y = std::max(player.radius, std::min(WORLD_HEIGHT - player.radius, player.position.y));
+    }
+
+    // Автоматическая стрельба по ближайшему врагу
+    if (IsAbilityReady(player, ABILITY_SHOT)) {
+        float min_distance = FLT_MAX;
+        const Enemy* nearest_enemy = nullptr;
+        for (const auto& enemy : enemies) {
+            float distance = Vector2Distance(player.position, GetEnemyPosition(enemy));
+            if (distance < min_distance) {
+                min_distance = distance;
+                nearest_enemy = &enemy;
+            }
+        }
+
+        if (nearest_enemy != nullptr) {
+            Vector2 direction = Vector2Subtract(GetEnemyPosition(*nearest_enemy), player.position);
+            float length = Vector2Length(direction);
+
+            if (length > 0) {
+                direction.x /= length;
+                direction.y /= length;
+
+                // Создаем снаряды в зависимости от их количества
+                for (int i = 0; i < player.projectileCount; i++) {
+                    Bullet bullet;
+                    bullet.position = player.position;
+
+                    if (player.projectileCount == 1) {
+                        // Один снаряд - летит прямо
+                        bullet.velocity.x = direction.x * tuning.bulletSpeed;
+                        bullet.velocity.y = direction.y * tuning.bulletSpeed;
+                    }
+                    else {
+                        // Несколько снарядов - распределяем веером
+                        float angleOffset = (i - (player.projectileCount - 1) / 2.0f) * tuning.bulletSpread;
+                        Vector2 rotatedDirection = {
+                            direction.x * cosf(angleOffset) - direction.y * sinf(angleOffset),
+                            direction.x * sinf(angleOffset) + direction.y * cosf(angleOffset)
+                        };
+                        bullet.velocity.x = rotatedDirection.x * tuning.bulletSpeed;
+                        bullet.velocity.y = rotatedDirection.y * tuning.bulletSpeed;
+                    }
+
+                    bullet.radius = tuning.bulletRadius * SIZE_MULTIPLIER;
+                    bullet.damage = player.damage;
+                    bullets.push_back(bullet);
+                }
+
+                // Дополнительный выстрел при улучшении
+                if (player.hasDoubleShot) {
+                    Bullet secondBullet;
+                    secondBullet.position = player.position;
+
+                    Vector2 perpendicular = { -direction.y, direction.x };
+                    secondBullet.velocity.x = direction.x * 8.0f + perpendicular.x * 3.0f;
+                    secondBullet.velocity.y = direction.y * 8.0f + perpendicular.y * 3.0f;
+
+                    float velLength = Vector2Length(secondBullet.velocity);
+                    secondBullet.velocity.x = secondBullet.velocity.x / velLength * tuning.bulletSpeed;
+                    secondBullet.velocity.y = secondBullet.velocity.y / velLength * tuning.bulletSpeed;
+
+                    secondBullet.radius = tuning.bulletRadius * SIZE_MULTIPLIER;
+                    secondBullet.damage = player.damage;
+                    bullets.push_back(secondBullet);
+                }
+
+                // Одно событие на залп, а не на снаряд
+                int volley = player.projectileCount + (player.hasDoubleShot ? 1 : 0);
+                PushEvent(events, { EVENT_SHOT, (unsigned char)playerIndex, volley, player.position });
+                StartCooldown(playerIndex, player, ABILITY_SHOT, 1.0 / player.attackSpeed, timers);
+            }
+        }
+    }
+
+    // Способности по списку PlayerAbilities
+    AbilityContext context = { playerIndex, player, tuning, timers, enemies, shockwaves, bombs, freezeAreas, fireballs };
+    ForEachAbility([&](auto ability) {
+        typedef decltype(ability) Ability;
+        typename Ability::State& state = GetAbilityState<Ability>(player);
+        if (state.owned && IsAbilityReady(player, AbilityIdOf<Ability>()) && Ability::Activate(context, state)) {
+            StartCooldown(playerIndex, player, AbilityIdOf<Ability>(), state.cooldown, timers);
+        }
+    });
+}
+
+void DrawPlayer(const Player& player, const Rectangle& view) {
+    if (!IsCircleVisible(player.position, player.radius + 15.0f * SIZE_MULTIPLIER, view)) return;
+
+    DrawCircleV(player.position, player.radius, COLOR_PLAYER);
+
+    float healthBarWidth = 40.0f * SIZE_MULTIPLIER;
+    float healthBarHeight = 5.0f * SIZE_MULTIPLIER;
+    Vector2 healthBarPos = {
+            player.position.x - healthBarWidth / 2,
+            player.position.y - player.radius - 15.0f * SIZE_MULTIPLIER
+    };
+
+    DrawRectangle((int)healthBarPos.x, (int)healthBarPos.y, (int)healthBarWidth, (int)healthBarHeight, RED);
+    DrawRectangle((int)healthBarPos.x, (int)healthBarPos.y, (int)(healthBarWidth * (player.health / (float)player.maxHealth)), (int)healthBarHeight, GREEN);
+}
+
+// Функции для пуль
+// Пули живут только в активных чанках
+void UpdateBullets(ComponentPool<Bullet>& bullets, const Rectangle& activeArea) {
+    Rectangle bounds = ExpandRect(activeArea, 100);
+
+    for (auto it = bullets.begin(); it != bullets.end();) {
+        if (it == bullets.end()) break;
+
+        it->position.x += it->velocity.x;
+        it->position.y += it->velocity.y;
+
+        if (!IsPointInRect(it->position, bounds)) {
+            it = bullets.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+void DrawBullets(const ComponentPool<Bullet>& bullets, const Rectangle& view) {
+    for (const auto& bullet : bullets) {
+        if (!IsCircleVisible(bullet.position, bullet.radius, view)) continue;
+        DrawCircleV(bullet.position, bullet.radius, COLOR_BULLET);
+    }
+}
+
+// Функции для шоквейвов
+void UpdateShockwaves(ComponentPool<Shockwave>& shockwaves, const Rectangle& activeArea) {
+    Rectangle bounds = ExpandRect(activeArea, 100);
+
+    for (auto it = shockwaves.begin(); it != shockwaves.end();) {
+        if (it == shockwaves.end()) break;
+
+        it->position.x += it->direction.x * it->speed;
+        it->position.y += it->direction.y * it->speed;
+        it->radius += 0.8f;
+
+        if (!IsPointInRect(it->position, bounds) ||
+            it->radius > 200 * SIZE_MULTIPLIER) {
+            it = shockwaves.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+void DrawShockwaves(const ComponentPool<Shockwave>& shockwaves, const Rectangle& view) {
+    for (const auto& shockwave : shockwaves) {
+        if (!IsCircleVisible(shockwave.position, shockwave.radius, view)) continue;
+        DrawCircleV(shockwave.position, shockwave.radius, COLOR_WAVE_ATTACK);
+        DrawCircleLines((int)shockwave.position.x, (int)shockwave.position.y, (int)shockwave.radius, BLUE);
+    }
+}
+
+// Функции для бомб
+// Фитиль догорает по таймеру TIMER_BOMB_FUSE, взорвавшуюся бомбу убирает ResolveAreaEffects
+void ExplodeBomb(Bomb& bomb, EventBus& events) {
+    if (bomb.exploded) return;
+    bomb.exploded = true;
+    PushEvent(events, { EVENT_EXPLOSION, EXPLOSION_BOMB, (int)bomb.explosionRadius, bomb.position });
+}
+
+void DrawBombs(const ComponentPool<Bomb>& bombs, const Rectangle& view, unsigned int tick) {
+    const unsigned int blinkTicks = SIM_TICK_RATE / 2;
+    const unsigned int blinkPeriod = SIM_TICK_RATE / 10;
+    for (const auto& bomb : bombs) {
+        if (!IsCircleVisible(bomb.position, bomb.explosionRadius, view)) continue;
+        if (!bomb.exploded) {
+            Color bombColor = COLOR_BOMB;
+            unsigned int remaining = bomb.explodeTick > tick ? bomb.explodeTick - tick : 0;
+            if (remaining < blinkTicks) {
+                bombColor = (remaining % blinkPeriod >= blinkPeriod / 2) ? RED : COLOR_BOMB;
+            }
+            DrawCircleV(bomb.position, 12.0f * SIZE_MULTIPLIER, bombColor);
+        }
+        else {
+            // Заливку взрыва заменяют частицы, остается только контур
+            DrawCircleLines((int)bomb.position.x, (int)bomb.position.y, (int)bomb.explosionRadius, RED);
+        }
+    }
+}
+
+// Функции для заморозки (область снимает таймер TIMER_FREEZE_EXPIRE)
+void DrawFreezeAreas(const ComponentPool<FreezeArea>& freezeAreas, const Rectangle& view) {
+    for (const auto& freeze : freezeAreas) {
+        if (!IsCircleVisible(freeze.position, freeze.radius, view)) continue;
+        DrawCircleV(freeze.position, freeze.radius, COLOR_FREEZE);
+        DrawCircleLines((int)freeze.position.x, (int)freeze.position.y, (int)freeze.radius, BLUE);
+    }
+}
+
+// Функции для фаерболов
+// Взрыв длится FIREBALL_EXPLOSION_SECONDS, затем фаербол убирает таймер TIMER_FIREBALL_CLEAR
+const double FIREBALL_EXPLOSION_SECONDS = 0.3;
+
+void ExplodeFireball(ComponentPool<Fireball>& fireballs, size_t index, TimerWheel& timers, EventBus& events) {
+    Fireball& fireball = fireballs[index];
+    fireball.exploded = true;
+    PushEvent(events, { EVENT_EXPLOSION, EXPLOSION_FIREBALL, (int)fireball.explosionRadius, fireball.position });
+    ScheduleTimer(timers, SecondsToTicks(FIREBALL_EXPLOSION_SECONDS), TIMER_FIREBALL_CLEAR, fireballs.HandleAt(index));
+}
+
+void UpdateFireballs(ComponentPool<Fireball>& fireballs, const ComponentPool<Enemy>& enemies, const Rectangle& activeArea, TimerWheel& timers, EventBus& events) {
+    for (auto it = fireballs.begin(); it != fireballs.end();) {
+        if (it == fireballs.end()) break;
+
+        if (!it->exploded) {
+            it->position.x += it->velocity.x;
+            it->position.y += it->velocity.y;
+
+            bool hitEnemy = false;
+            for (const auto& enemy : enemies) {
+                float distance = Vector2Distance(it->position, GetEnemyPosition(enemy));
+                if (distance < it->radius + ENEMY_RADIUS) {
+                    hitEnemy = true;
+                    break;
+                }
+            }
+
+            if (!IsPointInRect(it->position, activeArea) || hitEnemy) {
+                ExplodeFireball(fireballs, it - fireballs.begin(), timers, events);
+            }
+        }
+        ++it;
+    }
+}
+
+void DrawFireballs(const ComponentPool<Fireball>& fireballs, const Rectangle& view) {
+    for (const auto& fireball : fireballs) {
+        if (!IsCircleVisible(fireball.position, std::max(fireball.radius, fireball.explosionRadius), view)) continue;
+        // Шлейф и заливку взрыва рисует система частиц
+        if (!fireball.exploded) {
+            DrawCircleV(fireball.position, fireball.radius, COLOR_FIREBALL);
+        }
+        else {
+            DrawCircleLines((int)fireball.position.x, (int)fireball.position.y, (int)fireball.explosionRadius, ORANGE);
+        }
+    }
+}
+
+// Система частиц
+// Частицы хранятся в плотных массивах фиксированной емкости (SoA), интегрируются
+// векторным проходом и рисуются одной текстурой одним пакетом rlgl
+struct ParticleSystem {
+    TaggedVector<float, MEM_EFFECTS> x, y;
+    TaggedVector<float, MEM_EFFECTS> vx, vy;
+    TaggedVector<float, MEM_EFFECTS> life, maxLife;
+    TaggedVector<float, MEM_EFFECTS> size;
+    TaggedVector<Color, MEM_EFFECTS> color;
+    int count;
+    int spawnedThisFrame;
+    unsigned int rngState;
+    Texture2D texture;        // Мягкий круг для всех частиц
+    bool ownsTexture;         // false - текстура из пакета ресурсов
+};
+
+ParticleSystem CreateParticleSystem() {
+    ParticleSystem particles;
+    particles.x.resize(MAX_PARTICLES);
+    particles.y.resize(MAX_PARTICLES);
+    particles.vx.resize(MAX_PARTICLES);
+    particles.vy.resize(MAX_PARTICLES);
+    particles.life.resize(MAX_PARTICLES);
+    particles.maxLife.resize(MAX_PARTICLES);
+    particles.size.resize(MAX_PARTICLES);
+    particles.color.resize(MAX_PARTICLES);
+    particles.count = 0;
+    particles.spawnedThisFrame = 0;
+    particles.rngState = 0x9e3779b9u;
+
+    // Запасная текстура, пока пакет ресурсов не загружен (или если его нет)
+    Image image = GenImageGradientRadial(32, 32, 0.0f, WHITE, BLANK);
+    particles.texture = LoadTextureFromImage(image);
+    particles.ownsTexture = true;
+    UnloadImage(image);
+    return particles;
+}
+
+void UseParticleTexture(ParticleSystem& particles, Texture2D texture) {
+    if (particles.ownsTexture) {
+        UnloadTexture(particles.texture);
+    }
+    particles.texture = texture;
+    particles.ownsTexture = false;
+}
+
+void UnloadParticleSystem(ParticleSystem& particles) {
+    if (particles.ownsTexture) {
+        UnloadTexture(particles.texture);
+    }
+    particles.count = 0;
+}
+
+// Собственный генератор, чтобы эффекты не сбивали игровой GetRandomValue
+float ParticleRandom(ParticleSystem& particles) {
+    unsigned int value = particles.rngState;
+    value ^= value << 13;
+    value ^= value >> 17;
+    value ^= value << 5;
+    particles.rngState = value;
+    return (value & 0xFFFFFF) / (float)0x1000000;
+}
+
+// Возвращает false, если бюджет частиц исчерпан
+bool EmitParticle(ParticleSystem& particles, Vector2 position, Vector2 velocity, float life, float size, Color color) {
+    if (particles.count >= MAX_PARTICLES || particles.spawnedThisFrame >= MAX_PARTICLE_SPAWNS_PER_FRAME) {
+        return false;
+    }
+
+    int i = particles.count++;
+    particles.x[i] = position.x;
+    particles.y[i] = position.y;
+    particles.vx[i] = velocity.x;
+    particles.vy[i] = velocity.y;
+    particles.life[i] = life;
+    particles.maxLife[i] = life;
+    particles.size[i] = size;
+    particles.color[i] = color;
+    particles.spawnedThisFrame++;
+    return true;
+}
+
+// Разлет частиц по кругу (взрывы, смерть врага)
+void EmitBurst(ParticleSystem& particles, Vector2 position, float radius, int count, Color color) {
+    for (int i = 0; i < count; i++) {
+        float angle = ParticleRandom(particles) * 6.2831853f;
+        float speed = radius * (1.5f + ParticleRandom(particles) * 2.0f);
+        Vector2 velocity = { cosf(angle) * speed, sinf(angle) * speed };
+        float size = radius * (0.15f + ParticleRandom(particles) * 0.2f);
+        if (!EmitParticle(particles, position, velocity, 0.35f + ParticleRandom(particles) * 0.25f, size, color)) {
+            return;
+        }
+    }
+}
+
+// Шлейф фаерболов
+void EmitFireballTrails(ParticleSystem& particles, const ComponentPool<Fireball>& fireballs) {
+    for (const auto& fireball : fireballs) {
+        if (fireball.exploded) continue;
+
+        Vector2 velocity = {
+            -fireball.velocity.x * 6.0f + (ParticleRandom(particles) - 0.5f) * 40.0f,
+            -fireball.velocity.y * 6.0f + (ParticleRandom(particles) - 0.5f) * 40.0f
+        };
+        float size = fireball.radius * (0.7f + ParticleRandom(particles) * 0.3f);
+        EmitParticle(particles, fireball.position, velocity, 0.25f, size, COLOR_FIREBALL_EXPLOSION);
+    }
+}
+
+// Потребитель событий: взрывы и смерти врагов
+void ConsumeEffectEvents(const EventBatch& batch, ParticleSystem& particles) {
+    for (const auto& event : batch) {
+        if (event.type == EVENT_EXPLOSION) {
+            float radius = (float)event.amount;
+            int count = std::min(96, 16 + (int)(radius / 4.0f));
+            Color color = event.subtype == EXPLOSION_BOMB ? COLOR_EXPLOSION : COLOR_FIREBALL_EXPLOSION;
+            EmitBurst(particles, event.position, radius * 0.5f, count, color);
+        }
+        else if (event.type == EVENT_ENEMY_KILLED) {
+            Color color = COLOR_GREEN_ENEMY;
+            if (event.subtype == ENEMY_PURPLE) color = COLOR_PURPLE_ENEMY;
+            if (event.subtype == ENEMY_RED) color = COLOR_RED_ENEMY;
+            EmitBurst(particles, event.position, 15.0f * SIZE_MULTIPLIER, 8, color);
+        }
+    }
+}
+
+void UpdateParticles(ParticleSystem& particles, float deltaTime) {
+    int count = particles.count;
+    float* x = particles.x.data();
+    float* y = particles.y.data();
+    float* vx = particles.vx.data();
+    float* vy = particles.vy.data();
+    float* life = particles.life.data();
+    float drag = std::max(0.0f, 1.0f - PARTICLE_DRAG * deltaTime);
+
+    int i = 0;
+#if PARTICLES_USE_SSE
+    __m128 dt4 = _mm_set1_ps(deltaTime);
+    __m128 drag4 = _mm_set1_ps(drag);
+    for (; i + 4 <= count; i += 4) {
+        __m128 px = _mm_loadu_ps(x + i);
+        __m128 py = _mm_loadu_ps(y + i);
+        __m128 pvx = _mm_loadu_ps(vx + i);
+        __m128 pvy = _mm_loadu_ps(vy + i);
+        __m128 plife = _mm_loadu_ps(life + i);
+
+        px = _mm_add_ps(px, _mm_mul_ps(pvx, dt4));
+        py = _mm_add_ps(py, _mm_mul_ps(pvy, dt4));
+        pvx = _mm_mul_ps(pvx, drag4);
+        pvy = _mm_mul_ps(pvy, drag4);
+        plife = _mm_sub_ps(plife, dt4);
+
+        _mm_storeu_ps(x + i, px);
+        _mm_storeu_ps(y + i, py);
+        _mm_storeu_ps(vx + i, pvx);
+        _mm_storeu_ps(vy + i, pvy);
+        _mm_storeu_ps(life + i, plife);
+    }
+#endif
+    for (; i < count; i++) {
+        x[i] += vx[i] * deltaTime;
+        y[i] += vy[i] * deltaTime;
+        vx[i] *= drag;
+        vy[i] *= drag;
+        life[i] -= deltaTime;
+    }
+
+    // Удаление погибших частиц перестановкой последней на их место
+    for (int j = 0; j < particles.count;) {
+        if (particles.life[j] > 0.0f) {
+            j++;
+            continue;
+        }
+
+        int last = --particles.count;
+        particles.x[j] = particles.x[last];
+        particles.y[j] = particles.y[last];
+        particles.vx[j] = particles.vx[last];
+        particles.vy[j] = particles.vy[last];
+        particles.life[j] = particles.life[last];
+        particles.maxLife[j] = particles.maxLife[last];
+        particles.size[j] = particles.size[last];
+        particles.color[j] = particles.color[last];
+    }
+
+    particles.spawnedThisFrame = 0;
+}
+
+// Все частицы - текстурированные квады одной текстуры, поэтому rlgl сливает их в один вызов отрисовки
+void DrawParticles(const ParticleSystem& particles, const Rectangle& view) {
+    if (particles.count == 0) return;
+
+    for (int first = 0; first < particles.count; first += PARTICLE_DRAW_CHUNK) {
+        int last = std::min(particles.count, first + PARTICLE_DRAW_CHUNK);
+        rlCheckRenderBatchLimit(4 * (last - first));
+
+        rlSetTexture(particles.texture.id);
+        rlBegin(RL_QUADS);
+        rlNormal3f(0.0f, 0.0f, 1.0f);
+
+        for (int i = first; i < last; i++) {
+            float half = particles.size[i];
+            float px = particles.x[i];
+            float py = particles.y[i];
+            if (px + half < view.x || px - half > view.x + view.width ||
+                py + half < view.y || py - half > view.y + view.height) {
+                continue;
+            }
+
+            Color color = particles.color[i];
+            float fade = particles.life[i] / particles.maxLife[i];
+            rlColor4ub(color.r, color.g, color.b, (unsigned char)(color.a * fade));
+
+            rlTexCoord2f(0.0f, 0.0f);
+            rlVertex2f(px - half, py - half);
+            rlTexCoord2f(0.0f, 1.0f);
+            rlVertex2f(px - half, py + half);
+            rlTexCoord2f(1.0f, 1.0f);
+            rlVertex2f(px + half, py + half);
+            rlTexCoord2f(1.0f, 0.0f);
+            rlVertex2f(px + half, py - half);
+        }
+
+        rlEnd();
+        rlSetTexture(0);
+    }
+}
+
+// Генератор случайных чисел симуляции (xorshift32)
+// Состояние входит в состояние забега: одинаковое зерно дает одинаковую игру на всех машинах,
+// а откат состояния откатывает и генератор
+struct SimRandom {
+    unsigned int state;
+};
+
+SimRandom CreateSimRandom(unsigned int seed) {
+    SimRandom random;
+    random.state = seed != 0 ? seed : 0x9E3779B9u;
+    return random;
+}
+
+int SimRandomValue(SimRandom& random, int min, int max) {
+    unsigned int x = random.state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    random.state = x;
+    return min + (int)(x % (unsigned int)(max - min + 1));
+}
+
+// Функции для врагов (бесконечное усложнение)
+EnemyStats ComputeEnemyStats(EnemyType type, float difficultyScale, int waveNumber) {
+    const TuningConfig& tuning = GetTuning();
+    EnemyStats stats;
+
+    // Сложность ступенчатая: волна дает не больше трех архетипов на ступень, и таблица
+    // архетипов не растет с каждым врагом
+    difficultyScale = std::floor(difficultyScale * ENEMY_DIFFICULTY_STEPS) / ENEMY_DIFFICULTY_STEPS;
+
+    // Бесконечное масштабирование сложности
+    float waveMultiplier = 1.0f + (waveNumber * tuning.enemyWaveScale); // +10% за каждую волну
+    float healthMultiplier = 1.0f + difficultyScale * tuning.enemyHealthDifficulty + (waveNumber * tuning.enemyHealthWave);
+    float damageMultiplier = 1.0f + difficultyScale * tuning.enemyDamageDifficulty + (waveNumber * tuning.enemyDamageWave);
+    float speedMultiplier = 1.0f + difficultyScale * tuning.enemySpeedDifficulty + (waveNumber * tuning.enemySpeedWave);
+
+    const EnemyTuning& base = tuning.enemies[type <= ENEMY_RED ? type : ENEMY_RED];
+    stats.speed = base.speed * speedMultiplier;
+    stats.health = std::max(1, (int)(base.health * healthMultiplier * waveMultiplier));
+    stats.damage = std::max(1, (int)(base.damage * damageMultiplier * waveMultiplier));
+    stats.attackRange = base.attackRange * SIZE_MULTIPLIER;
+
+    stats.attackCooldown = 1.0f / waveMultiplier;
+    return stats;
+}
+
+bool IsSameArchetype(const EnemyArchetype& archetype, EnemyType type, const EnemyStats& stats) {
+    return archetype.type == type && archetype.speed == stats.speed && archetype.maxHealth == stats.health &&
+        archetype.damage == stats.damage && archetype.attackRange == stats.attackRange &&
+        archetype.attackCooldownTicks == SecondsToTicks(stats.attackCooldown);
+}
+
+// Регистрация архетипа. Одинаковые характеристики идут подряд (после выхода сложности
+// на максимум волна состоит из трех архетипов), поэтому поиск идет только по последним записям
+unsigned short RegisterEnemyArchetype(EnemyArchetypeTable& archetypes, EnemyType type, const EnemyStats& stats) {
+    size_t count = archetypes.size();
+    size_t first = count > ENEMY_ARCHETYPE_SEARCH ? count - ENEMY_ARCHETYPE_SEARCH : 0;
+    for (size_t i = count; i-- > first;) {
+        if (IsSameArchetype(archetypes[i], type, stats)) return (unsigned short)i;
+    }
+
+    // Переполнение таблицы - ошибка: подмена архетипа дала бы врагу чужие здоровье, скорость и урон
+    if (count >= ENEMY_ARCHETYPE_LIMIT) {
+        TraceLog(LOG_FATAL, "ENEMIES: archetype table is full (%d entries)", (int)count);
+        abort();
+    }
+
+    EnemyArchetype archetype;
+    archetype.type = type;
+    switch (type) {
+    case ENEMY_GREEN: archetype.color = COLOR_GREEN_ENEMY; break;
+    case ENEMY_PURPLE: archetype.color = COLOR_PURPLE_ENEMY; break;
+    case ENEMY_RED: default: archetype.color = COLOR_RED_ENEMY; break;
+    }
+
+    archetype.speed = stats.speed;
+    archetype.attackRange = stats.attackRange;
+    archetype.maxHealth = stats.health;
+    archetype.damage = stats.damage;
+    archetype.attackCooldownTicks = SecondsToTicks(stats.attackCooldown);
+    archetype.isRanged = (type == ENEMY_PURPLE);
+
+    archetype.healthShift = 0;
+    while ((stats.health >> archetype.healthShift) > ENEMY_HEALTH_LIMIT) {
+        archetype.healthShift++;
+    }
+    archetype.healthUnits = (unsigned short)std::max(1, stats.health >> archetype.healthShift);
+
+    archetypes.push_back(archetype);
+    return (unsigned short)count;
+}
+
+Enemy CreateEnemyFromArchetype(const EnemyArchetypeTable& archetypes, unsigned short archetype, Vector2 position) {
+    Enemy enemy;
+    SetEnemyPosition(enemy, position);
+    enemy.attackReadyTick = 0;
+    enemy.health = archetypes[archetype].healthUnits;
+    enemy.archetype = archetype;
+    enemy.lod = LOD_FULL;
+    enemy.flags = 0;
+    return enemy;
+}
+
+Enemy CreateEnemy(EnemyArchetypeTable& archetypes, EnemyType type, Vector2 position, float difficultyScale, int waveNumber) {
+    unsigned short archetype = RegisterEnemyArchetype(archetypes, type, ComputeEnemyStats(type, difficultyScale, waveNumber));
+    return CreateEnemyFromArchetype(archetypes, archetype, position);
+}
+
+// Планировщик волн
+// Расписание волны (время, сторона и архетип врага) считается целиком
+// при ее начале, поэтому спавн в кадре - это только сдвиг курсора по очереди
+void PlanWave(WavePlan& plan, EnemyArchetypeTable& archetypes, SimRandom& random, int waveNumber, int enemyCount, unsigned int startTick,
+    double& spawnCooldown, bool spawnImmediately) {
+    plan.entries.clear();
+    plan.entries.reserve(enemyCount);
+    plan.next = 0;
+    plan.startTick = startTick;
+    double startTime = startTick * SIM_TICK_SECONDS;
+
+    double offset = spawnImmediately ? 0.0 : spawnCooldown;
+    for (int i = 0; i < enemyCount; i++) {
+        SpawnEntry entry;
+        entry.tick = (unsigned int)(offset * SIM_TICK_RATE + 0.5);
+        EnemyType type = (EnemyType)SimRandomValue(random, 0, 2);
+        entry.side = (unsigned char)SimRandomValue(random, 0, 3);
+        entry.edge = (unsigned short)SimRandomValue(random, 0, 65535);
+
+        // Сложность на момент спавна известна заранее: она зависит только от игрового времени
+        float difficultyScale = std::min(1.0f, (float)(startTime + offset) / 300.0f);
+        entry.archetype = RegisterEnemyArchetype(archetypes, type, ComputeEnemyStats(type, difficultyScale, waveNumber));
+        plan.entries.push_back(entry);
+
+        spawnCooldown = std::max(0.3, spawnCooldown * 0.99);
+        offset += spawnCooldown;
+    }
+}
+
+bool IsWaveSpawning(const WavePlan& plan) {
+    return plan.next < plan.entries.size();
+}
+
+// Точка спавна за краем видимой области
+Vector2 GetSpawnPosition(const SpawnEntry& entry, const Rectangle& view) {
+    float along = entry.edge / 65535.0f;
+    switch (entry.side) {
+    case 0: return { view.x + along * view.width, view.y - 20.0f };
+    case 1: return { view.x + view.width + 20.0f, view.y + along * view.height };
+    case 2: return { view.x + along * view.width, view.y + view.height + 20.0f };
+    default: return { view.x - 20.0f, view.y + along * view.height };
+    }
+}
+
+// Тик следующей записи расписания (для таймера TIMER_WAVE_SPAWN)
+unsigned int GetNextSpawnTick(const WavePlan& plan) {
+    return plan.startTick + plan.entries[plan.next].tick;
+}
+
+// Спавн всех записей, тик которых наступил (любое количество за тик).
+// Записи раздаются по видимым областям игроков по очереди
+void SpawnDueEnemies(WavePlan& plan, const EnemyArchetypeTable& archetypes, unsigned int tick, const Rectangle* views, int viewCount,
+    ComponentPool<Enemy>& enemies) {
+    unsigned int waveTick = tick - plan.startTick;
+    const SpawnEntry* entry = plan.entries.data() + plan.next;
+    const SpawnEntry* last = plan.entries.data() + plan.entries.size();
+
+    while (entry != last && entry->tick <= waveTick) {
+        const Rectangle& view = views[(entry - plan.entries.data()) % viewCount];
+        enemies.push_back(CreateEnemyFromArchetype(archetypes, entry->archetype, GetSpawnPosition(*entry, view)));
+        ++entry;
+    }
+
+    STAT_ADD(STAT_ENEMY_SPAWNS, (entry - plan.entries.data()) - plan.next);
+    plan.next = entry - plan.entries.data();
+}
+
+// Враг идет к ближайшему игроку
+int FindNearestPlayer(const Player* players, int playerCount, Vector2 position) {
+    int nearest = 0;
+    float nearestDistance = FLT_MAX;
+    for (int i = 0; i < playerCount; i++) {
+        Vector2 delta = Vector2Subtract(players[i].position, position);
+        float distance = delta.x * delta.x + delta.y * delta.y;
+        if (distance < nearestDistance) {
+            nearestDistance = distance;
+            nearest = i;
+        }
+    }
+    return nearest;
+}
+
+// Снаряды врагов летят каждый кадр независимо от детализации владельца,
+// но пропадают, когда владелец убит или уснул в дальнем чанке
+void UpdateEnemyProjectiles(ComponentPool<EnemyProjectile>& projectiles, const ComponentPool<Enemy>& enemies, const Rectangle& activeArea) {
+    for (auto it = projectiles.begin(); it != projectiles.end();) {
+        const Enemy* owner = enemies.Get(it->owner);
+        if (owner == nullptr || owner->lod == LOD_DORMANT) {
+            it = projectiles.erase(it);
+            continue;
+        }
+
+        it->position.x += it->velocity.x;
+        it->position.y += it->velocity.y;
+
+        if (!IsPointInRect(it->position, activeArea)) {
+            it = projectiles.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+// Полное обновление врага в активном чанке
+// Замороженный враг стоит (moveScale = 0) и не атакует: заморозка сдвигает attackReadyTick
+void UpdateEnemyFull(Enemy& enemy, EntityHandle handle, const EnemyArchetypeTable& archetypes, const Player* players, int playerCount,
+    unsigned int tick, float moveScale, ComponentPool<EnemyProjectile>& projectiles, EventBus& events) {
+    const EnemyArchetype& archetype = GetEnemyArchetype(archetypes, enemy);
+    Vector2 position = GetEnemyPosition(enemy);
+
+    int playerIndex = FindNearestPlayer(players, playerCount, position);
+    const Player& player = players[playerIndex];
+    Vector2 direction = Vector2Subtract(player.position, position);
+    float distance = Vector2Length(direction);
+
+    if (distance > archetype.attackRange) {
+        if (distance > 0) {
+            direction.x /= distance;
+            direction.y /= distance;
+        }
+
+        position.x += direction.x * archetype.speed * moveScale;
+        position.y += direction.y * archetype.speed * moveScale;
+        SetEnemyPosition(enemy, position);
+    }
+    else if (tick >= enemy.attackReadyTick) {
+        if (archetype.isRanged) {
+            Vector2 projDirection = Vector2Normalize(direction);
+            EnemyProjectile projectile;
+            projectile.position = position;
+            projectile.velocity.x = projDirection.x * 4.0f;
+            projectile.velocity.y = projDirection.y * 4.0f;
+            projectile.radius = 7.0f * SIZE_MULTIPLIER;
+            projectile.damage = archetype.damage;
+            projectile.owner = handle;
+
+            projectiles.push_back(projectile);
+        }
+        else {
+            HitPlayer(playerIndex, player, archetype.damage, events);
+        }
+
+        enemy.attackReadyTick = tick + archetype.attackCooldownTicks;
+    }
+}
+
+// Постановка врага пониженной детализации в пакет движения
+void QueueEnemyMove(EnemyMoveBatch& batch, int index, const Enemy& enemy, const EnemyArchetype& archetype, Vector2 target, int ticks,
+    float moveScale) {
+    batch.index.push_back(index);
+    batch.x.push_back(FromFixed(enemy.x));
+    batch.y.push_back(FromFixed(enemy.y));
+    batch.targetX.push_back(target.x);
+    batch.targetY.push_back(target.y);
+    batch.step.push_back(archetype.speed * ticks * moveScale);
+    batch.range.push_back(archetype.attackRange);
+}
+
+// Движение пакета к игрокам одним проходом по плотным массивам
+void MoveEnemyBatch(EnemyMoveBatch& batch, ComponentPool<Enemy>& enemies) {
+    size_t count = batch.index.size();
+    float* x = batch.x.data();
+    float* y = batch.y.data();
+    const float* targetX = batch.targetX.data();
+    const float* targetY = batch.targetY.data();
+    const float* step = batch.step.data();
+    const float* range = batch.range.data();
+
+    for (size_t i = 0; i < count; i++) {
+        float dx = targetX[i] - x[i];
+        float dy = targetY[i] - y[i];
+        float distance = sqrtf(dx * dx + dy * dy);
+        float move = std::min(step[i], distance - range[i]);
+        float scale = (move > 0 && distance > 0) ? move / distance : 0.0f;
+        x[i] += dx * scale;
+        y[i] += dy * scale;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        Enemy& enemy = enemies[batch.index[i]];
+        enemy.x = ToFixed(x[i]);
+        enemy.y = ToFixed(y[i]);
+    }
+
+    batch.index.clear();
+    batch.x.clear();
+    batch.y.clear();
+    batch.targetX.clear();
+    batch.targetY.clear();
+    batch.step.clear();
+    batch.range.clear();
+}
+
+// Раскладка врагов по чанкам (сортировка подсчетом)
+void BuildChunkGrid(ChunkGrid& grid, const ComponentPool<Enemy>& enemies) {
+    int chunkCount = grid.columns * grid.rows;
+    grid.chunkStart.assign(chunkCount + 1, 0);
+    grid.enemyChunk.resize(enemies.size());
+    grid.enemyOrder.resize(enemies.size());
+
+    for (size_t i = 0; i < enemies.size(); i++) {
+        int chunkX = GetChunkCoord(FromFixed(enemies[i].x), grid.columns);
+        int chunkY = GetChunkCoord(FromFixed(enemies[i].y), grid.rows);
+        int chunk = chunkY * grid.columns + chunkX;
+        grid.enemyChunk[i] = chunk;
+        grid.chunkStart[chunk + 1]++;
+    }
+
+    for (int chunk = 0; chunk < chunkCount; chunk++) {
+        grid.chunkStart[chunk + 1] += grid.chunkStart[chunk];
+    }
+
+    grid.cursor.assign(grid.chunkStart.begin(), grid.chunkStart.end() - 1);
+    for (size_t i = 0; i < enemies.size(); i++) {
+        grid.enemyOrder[grid.cursor[grid.enemyChunk[i]]++] = (int)i;
+    }
+}
+
+// Эффекты состояний
+// Каждый эффект - своя плотная таблица (SoA) строк "враг под эффектом" с ключом - дескриптором
+// врага. Враг хранит только класс движения в flags, поэтому новые эффекты его не утяжеляют.
+// Конец эффекта снимает таймер TIMER_STATUS_FREEZE + тип. Продление срока таймер не переставляет:
+// сработав раньше срока, таймер ставится заново на остаток, так что на строку приходится один таймер
+enum StatusEffectType {
+    STATUS_FREEZE,      // Стоит и не атакует (область заморозки)
+    STATUS_SLOW,        // Движется медленнее (после оттаивания)
+    STATUS_BURN,        // Урон по времени (взрыв фаербола)
+    STATUS_POISON,      // Урон по времени (взрыв бомбы)
+    STATUS_COUNT
+};
+
+const unsigned int STATUS_DOT_INTERVAL = SIM_TICK_RATE / 2; // Период урона по времени (тики)
+
+struct StatusTable {
+    TaggedVector<EntityHandle, MEM_ENEMIES> target;
+    TaggedVector<unsigned int, MEM_ENEMIES> expireTick;
+    TaggedVector<int, MEM_ENEMIES> damage;        // Урон за STATUS_DOT_INTERVAL (горение, яд)
+    TaggedVector<int, MEM_ENEMIES> rowOfSlot;     // Слот врага -> строка или -1 (строка может быть от умершего врага слота)
+};
+
+struct StatusEffects {
+    StatusTable tables[STATUS_COUNT];
+    TaggedVector<int, MEM_ENEMIES> enemyIndex;    // Рабочие массивы тика урона
+    TaggedVector<EntityHandle, MEM_ENEMIES> killed;
+};
+
+int FindStatusRow(const StatusTable& table, EntityHandle handle) {
+    if (handle.slot >= table.rowOfSlot.size()) return -1;
+    int row = table.rowOfSlot[handle.slot];
+    if (row < 0 || table.target[row].generation != handle.generation) return -1;
+    return row;
+}
+
+// Удаление строки перестановкой последней на ее место
+void RemoveStatusRow(StatusTable& table, int row) {
+    int last = (int)table.target.size() - 1;
+    table.rowOfSlot[table.target[row].slot] = -1;
+    if (row != last) {
+        table.target[row] = table.target[last];
+        table.expireTick[row] = table.expireTick[last];
+        table.damage[row] = table.damage[last];
+        table.rowOfSlot[table.target[row].slot] = row;
+    }
+    table.target.pop_back();
+    table.expireTick.pop_back();
+    table.damage.pop_back();
+}
+
+// Класс движения: заморозка важнее замедления
+void UpdateEnemyMoveClass(const StatusEffects& statuses, Enemy& enemy, EntityHandle handle) {
+    unsigned char moveClass = ENEMY_MOVE_NORMAL;
+    if (FindStatusRow(statuses.tables[STATUS_SLOW], handle) >= 0) moveClass = ENEMY_MOVE_SLOWED;
+    if (FindStatusRow(statuses.tables[STATUS_FREEZE], handle) >= 0) moveClass = ENEMY_MOVE_STOPPED;
+    enemy.flags = (unsigned char)((enemy.flags & ~ENEMY_MOVE_MASK) | moveClass);
+}
+
+// Наложение эффекта. Повторное наложение продлевает срок и берет больший урон
+void ApplyStatus(StatusEffects& statuses, ComponentPool<Enemy>& enemies, TimerWheel& timers, StatusEffectType type,
+    EntityHandle handle, unsigned int tick, unsigned int durationTicks, int damage) {
+    Enemy* enemy = enemies.Get(handle);
+    if (enemy == nullptr) return;
+
+    StatusTable& table = statuses.tables[type];
+    unsigned int expireTick = tick + std::max(1u, durationTicks);
+    if (handle.slot >= table.rowOfSlot.size()) {
+        table.rowOfSlot.resize(handle.slot + 1, -1);
+    }
+
+    int row = table.rowOfSlot[handle.slot];
+    if (row >= 0 && table.target[row].generation == handle.generation) {
+        table.expireTick[row] = std::max(table.expireTick[row], expireTick);
+        table.damage[row] = std::max(table.damage[row], damage);
+    }
+    else {
+        // Строку умершего врага этого слота занимает новый; таймер старой строки не совпадет по поколению
+        if (row < 0) {
+            row = (int)table.target.size();
+            table.target.push_back(handle);
+            table.expireTick.push_back(expireTick);
+            table.damage.push_back(damage);
+            table.rowOfSlot[handle.slot] = row;
+        }
+        table.target[row] = handle;
+        table.expireTick[row] = expireTick;
+        table.damage[row] = damage;
+        ScheduleTimer(timers, expireTick - tick, (TimerKind)(TIMER_STATUS_FREEZE + type), handle);
+    }
+
+    if (type == STATUS_FREEZE) {
+        enemy->attackReadyTick = std::max(enemy->attackReadyTick, table.expireTick[row]);
+    }
+    UpdateEnemyMoveClass(statuses, *enemy, handle);
+}
+
+// Таймер конца эффекта (главный поток). Оттаявший враг еще какое-то время замедлен
+void ExpireStatus(StatusEffects& statuses, ComponentPool<Enemy>& enemies, TimerWheel& timers, StatusEffectType type,
+    EntityHandle handle, unsigned int tick) {
+    StatusTable& table = statuses.tables[type];
+    int row = FindStatusRow(table, handle);
+    if (row < 0) return;
+
+    if (table.expireTick[row] > tick) {
+        ScheduleTimer(timers, table.expireTick[row] - tick, (TimerKind)(TIMER_STATUS_FREEZE + type), handle);
+        return;
+    }
+
+    RemoveStatusRow(table, row);
+    Enemy* enemy = enemies.Get(handle);
+    if (enemy == nullptr) return;
+
+    if (type == STATUS_FREEZE) {
+        ApplyStatus(statuses, enemies, timers, STATUS_SLOW, handle, tick, SecondsToTicks(GetTuning().thawSlowDuration), 0);
+    }
+    UpdateEnemyMoveClass(statuses, *enemy, handle);
+}
+
+// Заморозка врагов в областях. Кандидаты - враги чанков, пересекающих область,
+// поэтому цена зависит от числа врагов рядом, а не от размера волны
+void ApplyFreezeAreas(StatusEffects& statuses, ComponentPool<Enemy>& enemies, const ComponentPool<FreezeArea>& freezeAreas,
+    const ChunkGrid& grid, TimerWheel& timers, unsigned int tick) {
+    long long tests = 0;
+    for (const auto& freeze : freezeAreas) {
+        if (freeze.expireTick <= tick) continue;
+
+        int minX = GetChunkCoord(freeze.position.x - freeze.radius, grid.columns);
+        int maxX = GetChunkCoord(freeze.position.x + freeze.radius, grid.columns);
+        int minY = GetChunkCoord(freeze.position.y - freeze.radius, grid.rows);
+        int maxY = GetChunkCoord(freeze.position.y + freeze.radius, grid.rows);
+        for (int chunkY = minY; chunkY <= maxY; chunkY++) {
+            for (int chunkX = minX; chunkX <= maxX; chunkX++) {
+                int chunk = chunkY * grid.columns + chunkX;
+                for (int i = grid.chunkStart[chunk]; i < grid.chunkStart[chunk + 1]; i++) {
+                    int index = grid.enemyOrder[i];
+                    tests++;
+                    if (Vector2Distance(GetEnemyPosition(enemies[index]), freeze.position) <= freeze.radius) {
+                        ApplyStatus(statuses, enemies, timers, STATUS_FREEZE, enemies.HandleAt(index), tick,
+                            freeze.expireTick - tick, 0);
+                    }
+                }
+            }
+        }
+    }
+    STAT_ADD(STAT_FREEZE_TESTS, tests);
+}
+
+// Урон по времени: раз в STATUS_DOT_INTERVAL тиков таблицы горения и яда проходятся пакетом.
+// Сначала дескрипторы переводятся в индексы врагов, затем урон наносится одним проходом.
+// Строки умерших врагов выбрасываются, убитые удаляются из пула после прохода по таблицам
+void TickDamageStatuses(StatusEffects& statuses, ComponentPool<Enemy>& enemies, const EnemyArchetypeTable& archetypes,
+    EventBus& events, unsigned int tick) {
+    if (tick % STATUS_DOT_INTERVAL != 0) return;
+
+    const StatusEffectType damageTypes[] = { STATUS_BURN, STATUS_POISON };
+    statuses.killed.clear();
+    for (StatusEffectType type : damageTypes) {
+        StatusTable& table = statuses.tables[type];
+        int count = (int)table.target.size();
+        statuses.enemyIndex.resize(count);
+        int* enemyIndex = statuses.enemyIndex.data();
+
+        for (int row = 0; row < count; row++) {
+            EntityHandle handle = table.target[row];
+            enemyIndex[row] = enemies.IsAlive(handle) ? (int)enemies.slotIndex[handle.slot] : -1;
+        }
+
+        for (int row = 0; row < count; row++) {
+            int index = enemyIndex[row];
+            if (index < 0 || enemies[index].health == 0) continue;
+            if (DamageEnemy(enemies[index], archetypes, table.damage[row], events)) {
+                statuses.killed.push_back(table.target[row]);
+            }
+        }
+
+        for (int row = count - 1; row >= 0; row--) {
+            if (enemyIndex[row] < 0) {
+                RemoveStatusRow(table, row);
+            }
+        }
+    }
+
+    for (EntityHandle handle : statuses.killed) {
+        enemies.Remove(handle);
+    }
+}
+
+// Запросы областей действия (взрывы, ударные волны)
+// Круг или расширяющееся кольцо проверяется против раскладки врагов по чанкам. Чанки одной
+// строки сетки лежат в enemyOrder подряд, поэтому кандидаты области - несколько отрезков
+// (по одному на строку чанков), и точная проверка расстояния идет только по ним
+struct AoeSpan {
+    int first;      // Отрезок [first, last) в grid.enemyOrder
+    int last;
+};
+
+struct AoeQuery {
+    TaggedVector<AoeSpan, MEM_ENEMIES> spans;
+    TaggedVector<int, MEM_ENEMIES> hits;            // Индексы врагов в области
+    TaggedVector<EntityHandle, MEM_ENEMIES> killed; // Убитые за проход, удаляются в конце
+};
+
+// Попадание волны во врага: враг получает урон от волны один раз
+struct AoeHit {
+    EntityHandle source;
+    EntityHandle enemy;
+};
+
+bool AoeHitBefore(const AoeHit& a, const AoeHit& b) {
+    if (a.source.slot != b.source.slot) return a.source.slot < b.source.slot;
+    if (a.source.generation != b.source.generation) return a.source.generation < b.source.generation;
+    if (a.enemy.slot != b.enemy.slot) return a.enemy.slot < b.enemy.slot;
+    return a.enemy.generation < b.enemy.generation;
+}
+
+// Раскладка строится до движения врагов: за тик враг смещается не дальше шага самого
+// быстрого архетипа за COARSE_TICK_INTERVAL кадров, на столько расширяется поиск чанков
+float GetEnemyMoveSlack(const EnemyArchetypeTable& archetypes) {
+    float speed = 0.0f;
+    for (const auto& archetype : archetypes) {
+        speed = std::max(speed, archetype.speed);
+    }
+    return speed * COARSE_TICK_INTERVAL;
+}
+
+void GatherAoeSpans(const ChunkGrid& grid, Vector2 center, float radius, AoeQuery& query) {
+    query.spans.clear();
+    int minX = GetChunkCoord(center.x - radius, grid.columns);
+    int maxX = GetChunkCoord(center.x + radius, grid.columns);
+    int minY = GetChunkCoord(center.y - radius, grid.rows);
+    int maxY = GetChunkCoord(center.y + radius, grid.rows);
+    for (int chunkY = minY; chunkY <= maxY; chunkY++) {
+        int first = grid.chunkStart[chunkY * grid.columns + minX];
+        int last = grid.chunkStart[chunkY * grid.columns + maxX + 1];
+        if (first < last) {
+            query.spans.push_back({ first, last });
+        }
+    }
+}
+
+// Враги с центром в кольце innerRadius <= r < outerRadius (круг - кольцо с innerRadius = 0)
+void QueryEnemyRing(const ChunkGrid& grid, const ComponentPool<Enemy>& enemies, float moveSlack, Vector2 center,
+    float innerRadius, float outerRadius, AoeQuery& query) {
+    GatherAoeSpans(grid, center, outerRadius + moveSlack, query);
+    float inner = innerRadius * innerRadius;
+    float outer = outerRadius * outerRadius;
+    long long tests = 0;
+
+    query.hits.clear();
+    for (const AoeSpan& span : query.spans) {
+        for (int i = span.first; i < span.last; i++) {
+            int index = grid.enemyOrder[i];
+            Vector2 delta = Vector2Subtract(GetEnemyPosition(enemies[index]), center);
+            float distance = delta.x * delta.x + delta.y * delta.y;
+            if (distance >= inner && distance < outer) {
+                query.hits.push_back(index);
+            }
+        }
+        tests += span.last - span.first;
+    }
+    STAT_ADD(STAT_AOE_TESTS, tests);
+}
+
+// Урон врагу из запроса. Убитый остается в пуле с нулевым здоровьем до конца прохода,
+// чтобы индексы раскладки не сдвигались; возвращает true, если враг жив
+bool HitAreaEnemy(ComponentPool<Enemy>& enemies, int index, const EnemyArchetypeTable& archetypes, int damage, AoeQuery& query,
+    EventBus& events) {
+    Enemy& enemy = enemies[index];
+    if (enemy.health == 0) return false;
+    if (DamageEnemy(enemy, archetypes, damage, events)) {
+        query.killed.push_back(enemies.HandleAt(index));
+        return false;
+    }
+    return true;
+}
+
+// Урон областей, каждый враг получает его один раз за срабатывание:
+// - бомба и фаербол бьют кругом один раз в тик взрыва;
+// - волна бьет кольцо между фронтом прошлого запроса и текущим фронтом. Кольцо расширено внутрь
+//   на сдвиг центра и врагов, повторные попадания отсекает отсортированный список shockwaveHits
+void ResolveAreaEffects(ComponentPool<Enemy>& enemies, const EnemyArchetypeTable& archetypes, const ChunkGrid& grid,
+    ComponentPool<Shockwave>& shockwaves, ComponentPool<Bomb>& bombs, ComponentPool<Fireball>& fireballs,
+    TaggedVector<AoeHit, MEM_EFFECTS>& shockwaveHits, AoeQuery& query, StatusEffects& statuses, TimerWheel& timers,
+    unsigned int tick, EventBus& events) {
+    const TuningConfig& tuning = GetTuning();
+    float moveSlack = GetEnemyMoveSlack(archetypes);
+    long long erases = 0;
+    query.killed.clear();
+
+    for (auto it = bombs.begin(); it != bombs.end();) {
+        if (!it->exploded) {
+            ++it;
+            continue;
+        }
+
+        QueryEnemyRing(grid, enemies, moveSlack, it->position, 0.0f, it->explosionRadius + ENEMY_RADIUS, query);
+        for (int index : query.hits) {
+            if (HitAreaEnemy(enemies, index, archetypes, it->damage, query, events)) {
+                ApplyStatus(statuses, enemies, timers, STATUS_POISON, enemies.HandleAt(index), tick,
+                    SecondsToTicks(tuning.poisonDuration), tuning.poisonDamage);
+            }
+        }
+        erases++;
+        it = bombs.erase(it);
+    }
+
+    for (auto& fireball : fireballs) {
+        if (!fireball.exploded || fireball.detonated) continue;
+        fireball.detonated = true;
+
+        QueryEnemyRing(grid, enemies, moveSlack, fireball.position, 0.0f, fireball.explosionRadius + ENEMY_RADIUS, query);
+        for (int index : query.hits) {
+            if (HitAreaEnemy(enemies, index, archetypes, fireball.damage, query, events)) {
+                ApplyStatus(statuses, enemies, timers, STATUS_BURN, enemies.HandleAt(index), tick,
+                    SecondsToTicks(tuning.burnDuration), tuning.burnDamage);
+            }
+        }
+    }
+
+    // Попадания исчезнувших волн больше не нужны
+    shockwaveHits.erase(std::remove_if(shockwaveHits.begin(), shockwaveHits.end(),
+        [&](const AoeHit& hit) { return !shockwaves.IsAlive(hit.source); }), shockwaveHits.end());
+
+    for (size_t i = 0; i < shockwaves.size(); i++) {
+        Shockwave& wave = shockwaves[i];
+        EntityHandle source = shockwaves.HandleAt(i);
+        float innerRadius = 0.0f;
+        if (wave.sweptRadius > 0.0f) {
+            innerRadius = std::max(0.0f, wave.sweptRadius + ENEMY_RADIUS - Vector2Distance(wave.position, wave.sweptPosition) - moveSlack);
+        }
+        wave.sweptPosition = wave.position;
+        wave.sweptRadius = wave.radius;
+
+        QueryEnemyRing(grid, enemies, moveSlack, wave.position, innerRadius, wave.radius + ENEMY_RADIUS, query);
+        size_t known = shockwaveHits.size();
+        for (int index : query.hits) {
+            AoeHit hit = { source, enemies.HandleAt(index) };
+            if (std::binary_search(shockwaveHits.begin(), shockwaveHits.begin() + known, hit, AoeHitBefore)) continue;
+            shockwaveHits.push_back(hit);
+            HitAreaEnemy(enemies, index, archetypes, wave.damage, query, events);
+        }
+        std::sort(shockwaveHits.begin() + known, shockwaveHits.end(), AoeHitBefore);
+        std::inplace_merge(shockwaveHits.begin(), shockwaveHits.begin() + known, shockwaveHits.end(), AoeHitBefore);
+    }
+
+    for (EntityHandle handle : query.killed) {
+        enemies.Remove(handle);
+    }
+    STAT_ADD(STAT_ERASES, erases + (long long)query.killed.size());
+}
+
+void ClearStatusEffects(StatusEffects& statuses) {
+    for (StatusTable& table : statuses.tables) {
+        table.target.clear();
+        table.expireTick.clear();
+        table.damage.clear();
+        table.rowOfSlot.clear();
+    }
+}
+
+// Детализация врагов:
+// - в видимой области с запасом (fullDetailArea) враг обновляется полностью каждый кадр;
+// - в остальных активных чанках только движется раз в LOD_REDUCED_INTERVAL кадров;
+// - в дальних чанках только движется раз в COARSE_TICK_INTERVAL кадров.
+// Пропущенные кадры компенсируются длиной шага, фаза тика сдвинута по номеру чанка,
+// чтобы нагрузка распределялась по кадрам. Запас LOD_PROMOTION_MARGIN больше пути
+// за пропущенные кадры, поэтому враг повышается до полной детализации до появления на экране
+// Эффекты состояний влияют только через класс движения: множитель скорости берется из таблицы
+void UpdateEnemies(ComponentPool<Enemy>& enemies, const EnemyArchetypeTable& archetypes, const Player* players, int playerCount,
+    ComponentPool<EnemyProjectile>& projectiles, const ChunkGrid& grid, EnemyMoveBatch& batch, long long frameIndex, EventBus& events) {
+    long long fullUpdates = 0;
+    const float moveScale[ENEMY_MOVE_MASK + 1] = { 1.0f, GetTuning().slowSpeedScale, 0.0f, 0.0f };
+
+    for (int chunkY = 0; chunkY < grid.rows; chunkY++) {
+        for (int chunkX = 0; chunkX < grid.columns; chunkX++) {
+            int chunk = chunkY * grid.columns + chunkX;
+            int first = grid.chunkStart[chunk];
+            int last = grid.chunkStart[chunk + 1];
+            if (first == last) continue;
+
+            if (IsChunkActive(grid, chunkX, chunkY)) {
+                bool reducedTick = (frameIndex + chunk) % LOD_REDUCED_INTERVAL == 0;
+                for (int i = first; i < last; i++) {
+                    int index = grid.enemyOrder[i];
+                    Enemy& enemy = enemies[index];
+
+                    if (IsCircleVisible(GetEnemyPosition(enemy), ENEMY_RADIUS, grid.fullDetailArea)) {
+                        enemy.lod = LOD_FULL;
+                        UpdateEnemyFull(enemy, enemies.HandleAt(index), archetypes, players, playerCount, (unsigned int)frameIndex,
+                            moveScale[enemy.flags & ENEMY_MOVE_MASK], projectiles, events);
+                        fullUpdates++;
+                        continue;
+                    }
+
+                    enemy.lod = LOD_REDUCED;
+                    if (reducedTick) {
+                        Vector2 target = players[FindNearestPlayer(players, playerCount, GetEnemyPosition(enemy))].position;
+                        QueueEnemyMove(batch, index, enemy, GetEnemyArchetype(archetypes, enemy), target, LOD_REDUCED_INTERVAL,
+                            moveScale[enemy.flags & ENEMY_MOVE_MASK]);
+                    }
+                }
+            }
+            else if ((frameIndex + chunk) % COARSE_TICK_INTERVAL == 0) {
+                for (int i = first; i < last; i++) {
+                    int index = grid.enemyOrder[i];
+                    Enemy& enemy = enemies[index];
+                    enemy.lod = LOD_DORMANT;
+                    Vector2 target = players[FindNearestPlayer(players, playerCount, GetEnemyPosition(enemy))].position;
+                    QueueEnemyMove(batch, index, enemy, GetEnemyArchetype(archetypes, enemy), target, COARSE_TICK_INTERVAL,
+                        moveScale[enemy.flags & ENEMY_MOVE_MASK]);
+                }
+            }
+        }
+    }
+
+    STAT_ADD(STAT_ENEMY_FULL_UPDATES, fullUpdates);
+    STAT_ADD(STAT_ENEMY_BATCH_MOVES, batch.index.size());
+    MoveEnemyBatch(batch, enemies);
+}
+
+void DrawEnemyProjectiles(const ComponentPool<EnemyProjectile>& projectiles, const Rectangle& view) {
+    for (const auto& projectile : projectiles) {
+        if (!IsCircleVisible(projectile.position, projectile.radius, view)) continue;
+        DrawCircleV(projectile.position, projectile.radius, COLOR_PROJECTILE);
+    }
+}
+
+void DrawEnemies(const ComponentPool<Enemy>& enemies, const EnemyArchetypeTable& archetypes, const Rectangle& view) {
+    for (const auto& enemy : enemies) {
+        Vector2 position = GetEnemyPosition(enemy);
+        if (!IsCircleVisible(position, ENEMY_RADIUS + 12.0f * SIZE_MULTIPLIER, view)) continue;
+
+        const EnemyArchetype& archetype = GetEnemyArchetype(archetypes, enemy);
+        Color enemyColor = archetype.color;
+        if ((enemy.flags & ENEMY_MOVE_MASK) == ENEMY_MOVE_STOPPED) {
+            enemyColor = BLUE;
+        }
+        else if ((enemy.flags & ENEMY_MOVE_MASK) == ENEMY_MOVE_SLOWED) {
+            enemyColor = SKYBLUE;
+        }
+
+        DrawCircleV(position, ENEMY_RADIUS, enemyColor);
+
+        // Полоска здоровья только у врагов полной детализации
+        if (enemy.lod != LOD_FULL) continue;
+
+        float healthBarWidth = 30.0f * SIZE_MULTIPLIER;
+        float healthBarHeight = 4.0f * SIZE_MULTIPLIER;
+        Vector2 healthBarPos = {
+                position.x - healthBarWidth / 2,
+                position.y - ENEMY_RADIUS - 12.0f * SIZE_MULTIPLIER
+        };
+
+        DrawRectangle((int)healthBarPos.x, (int)healthBarPos.y, (int)healthBarWidth, (int)healthBarHeight, RED);
+        DrawRectangle((int)healthBarPos.x, (int)healthBarPos.y, (int)(healthBarWidth * (enemy.health / (float)archetype.healthUnits)), (int)healthBarHeight, GREEN);
+    }
+}
+
+// Горение и яд - кольцо вокруг врага (проход по строкам таблиц, а не по всем врагам)
+void DrawStatusEffects(const StatusEffects& statuses, const ComponentPool<Enemy>& enemies, const Rectangle& view) {
+    const StatusEffectType types[] = { STATUS_BURN, STATUS_POISON };
+    const Color colors[] = { ORANGE, LIME };
+    for (int i = 0; i < 2; i++) {
+        const StatusTable& table = statuses.tables[types[i]];
+        for (EntityHandle handle : table.target) {
+            const Enemy* enemy = enemies.Get(handle);
+            if (enemy == nullptr) continue;
+            Vector2 position = GetEnemyPosition(*enemy);
+            if (!IsCircleVisible(position, ENEMY_RADIUS + 3.0f * (i + 1), view)) continue;
+            DrawCircleLinesV(position, ENEMY_RADIUS + 3.0f * (i + 1), colors[i]);
+        }
+    }
+}
+
+// Функции для улучшений
+Upgrade CreateUpgrade(Vector2 position, SimRandom& random) {
+    Upgrade upgrade;
+    upgrade.position = position;
+    upgrade.radius = 10.0f * SIZE_MULTIPLIER;
+
+    upgrade.type = (UpgradeType)SimRandomValue(random, 0, UPGRADE_COUNT - 1);
+    switch (upgrade.type) {
+    case UPGRADE_HEALTH:
+        upgrade.color = COLOR_UPGRADE_HEALTH;
+        break;
+    case UPGRADE_ATTACK_SPEED:
+        upgrade.color = COLOR_UPGRADE_ATTACK_SPEED;
+        break;
+    case UPGRADE_DAMAGE:
+        upgrade.color = COLOR_UPGRADE_DAMAGE;
+        break;
+    case UPGRADE_SPEED:
+        upgrade.color = COLOR_UPGRADE_SPEED;
+        break;
+    case UPGRADE_DOUBLE_SHOT:
+        upgrade.color = COLOR_UPGRADE_DOUBLE_SHOT;
+        break;
+    case UPGRADE_PROJECTILE_COUNT:
+        upgrade.color = COLOR_PROJECTILE_COUNT;
+        break;
+    default:
+        // Улучшение способности - цвета ее строки HUD
+        ForEachAbility([&](auto ability) {
+            typedef decltype(ability) Ability;
+            if (upgrade.type == AbilityUpgradeOf<Ability>()) upgrade.color = Ability::HudColor();
+        });
+        break;
+    }
+
+    return upgrade;
+}
+
+void ApplyUpgrade(Upgrade& upgrade, Player& player) {
+    const TuningConfig& tuning = GetTuning();
+    switch (upgrade.type) {
+    case UPGRADE_HEALTH:
+        player.maxHealth += tuning.upgradeMaxHealth;
+        player.health = std::min(player.maxHealth, player.health + tuning.upgradeHeal);
+        break;
+
+    case UPGRADE_ATTACK_SPEED:
+        player.attackSpeed += tuning.upgradeAttackSpeed;
+        break;
+
+    case UPGRADE_DAMAGE:
+        player.damage += tuning.upgradeDamage;
+        break;
+
+    case UPGRADE_SPEED:
+        player.speed += tuning.upgradeSpeed;
+        break;
+
+    case UPGRADE_DOUBLE_SHOT:
+        player.hasDoubleShot = true;
+        break;
+
+    case UPGRADE_PROJECTILE_COUNT:
+        player.projectileCount++;
+        break;
+
+    default:
+        // Улучшения способностей: первый подбор открывает способность, следующие усиливают
+        ForEachAbility([&](auto ability) {
+            typedef decltype(ability) Ability;
+            if (upgrade.type != AbilityUpgradeOf<Ability>()) return;
+            typename Ability::State& state = GetAbilityState<Ability>(player);
+            if (!state.owned) {
+                state.owned = true;
+            }
+            else {
+                Ability::Upgrade(state, tuning);
+            }
+        });
+        break;
+    }
+}
+
+void DrawUpgrades(const ComponentPool<Upgrade>& upgrades, const Rectangle& view) {
+    for (const auto& upgrade : upgrades) {
+        if (!IsCircleVisible(upgrade.position, upgrade.radius, view)) continue;
+        if (upgrade.type >= UPGRADE_DOUBLE_SHOT) {
+            DrawRectangle((int)(upgrade.position.x - upgrade.radius), (int)(upgrade.position.y - upgrade.radius),
+                (int)(upgrade.radius * 2), (int)(upgrade.radius * 2), upgrade.color);
+        }
+        else {
+            DrawCircleV(upgrade.position, upgrade.radius, upgrade.color);
+        }
+    }
+}
+
+// Сетка чанков и граница мира (только видимая часть)
+void DrawWorldBackground(const Rectangle& view) {
+    Color gridColor = { 30, 30, 30, 255 };
+
+    int firstX = std::max(0, (int)floorf(view.x / CHUNK_SIZE));
+    int lastX = std::min((int)ceilf(WORLD_WIDTH / CHUNK_SIZE), (int)ceilf((view.x + view.width) / CHUNK_SIZE));
+    for (int i = firstX; i <= lastX; i++) {
+        float x = i * CHUNK_SIZE;
+        DrawLineV({ x, std::max(0.0f, view.y) }, { x, std::min(WORLD_HEIGHT, view.y + view.height) }, gridColor);
+    }
+
+    int firstY = std::max(0, (int)floorf(view.y / CHUNK_SIZE));
+    int lastY = std::min((int)ceilf(WORLD_HEIGHT / CHUNK_SIZE), (int)ceilf((view.y + view.height) / CHUNK_SIZE));
+    for (int i = firstY; i <= lastY; i++) {
+        float y = i * CHUNK_SIZE;
+        DrawLineV({ std::max(0.0f, view.x), y }, { std::min(WORLD_WIDTH, view.x + view.width), y }, gridColor);
+    }
+
+    DrawRectangleLinesEx({ 0, 0, WORLD_WIDTH, WORLD_HEIGHT }, 4, DARKGRAY);
+}
+
+// Безопасная проверка коллизий
+// Урон взрывов и волн наносит ResolveAreaEffects
+void CheckCollisions(const Player* players, int playerCount, ComponentPool<Bullet>& bullets, ComponentPool<Enemy>& enemies,
+    const EnemyArchetypeTable& archetypes,
+    ComponentPool<EnemyProjectile>& projectiles, ComponentPool<Upgrade>& upgrades,
+    ComponentPool<Fireball>& fireballs, TimerWheel& timers, EventBus& events) {
+    long long tests = 0;
+    long long hits = 0;
+    long long erases = 0;
+
+    // Пули - враги
+    for (auto bulletIt = bullets.begin(); bulletIt != bullets.end();) {
+        bool bulletHit = false;
+
+        for (auto enemyIt = enemies.begin(); enemyIt != enemies.end();) {
+            if (bulletIt == bullets.end() || enemyIt == enemies.end()) break;
+
+            float distance = Vector2Distance(bulletIt->position, GetEnemyPosition(*enemyIt));
+            tests++;
+
+            if (distance < bulletIt->radius + ENEMY_RADIUS) {
+                hits++;
+                bulletHit = true;
+                if (DamageEnemy(*enemyIt, archetypes, bulletIt->damage, events)) {
+                    erases++;
+                    enemyIt = enemies.erase(enemyIt);
+                    continue;
+                }
+                else {
+                    ++enemyIt;
+                }
+                break;
+            }
+            else {
+                ++enemyIt;
+            }
+        }
+
+        if (bulletHit) {
+            erases++;
+            bulletIt = bullets.erase(bulletIt);
+        }
+        else {
+            ++bulletIt;
+        }
+    }
+
+    // Фаерболы - враги (прямое попадание; взрыв бьет ResolveAreaEffects)
+    for (auto fireballIt = fireballs.begin(); fireballIt != fireballs.end();) {
+        if (fireballIt->exploded) {
+            ++fireballIt;
+        }
+        else {
+            bool hitEnemy = false;
+            for (auto enemyIt = enemies.begin(); enemyIt != enemies.end();) {
+                if (fireballIt == fireballs.end() || enemyIt == enemies.end()) break;
+
+                float distance = Vector2Distance(fireballIt->position, GetEnemyPosition(*enemyIt));
+                tests++;
+
+                if (distance < fireballIt->radius + ENEMY_RADIUS) {
+                    hits++;
+                    hitEnemy = true;
+                    if (DamageEnemy(*enemyIt, archetypes, fireballIt->damage, events)) {
+                        erases++;
+                        enemyIt = enemies.erase(enemyIt);
+                        continue;
+                    }
+                    break;
+                }
+                ++enemyIt;
+            }
+
+            if (hitEnemy) {
+                ExplodeFireball(fireballs, fireballIt - fireballs.begin(), timers, events);
+                ++fireballIt;
+            }
+            else {
+                ++fireballIt;
+            }
+        }
+    }
+
+    // Вражеские снаряды - игроки (снаряд достается первому задетому)
+    for (auto projIt = projectiles.begin(); projIt != projectiles.end();) {
+        bool projectileHit = false;
+        for (int i = 0; i < playerCount && !projectileHit; i++) {
+            float distance = Vector2Distance(projIt->position, players[i].position);
+            tests++;
+
+            if (distance < projIt->radius + players[i].radius) {
+                hits++;
+                HitPlayer(i, players[i], projIt->damage, events);
+                projectileHit = true;
+            }
+        }
+
+        if (projectileHit) {
+            erases++;
+            projIt = projectiles.erase(projIt);
+        }
+        else {
+            ++projIt;
+        }
+    }
+
+    // Враги - игроки (ближний бой)
+    for (auto& enemy : enemies) {
+        Vector2 enemyPosition = GetEnemyPosition(enemy);
+        for (int i = 0; i < playerCount; i++) {
+            float distance = Vector2Distance(enemyPosition, players[i].position);
+            tests++;
+
+            if (distance < ENEMY_RADIUS + players[i].radius) {
+                hits++;
+                HitPlayer(i, players[i], GetEnemyArchetype(archetypes, enemy).damage, events);
+            }
+        }
+    }
+
+    // Улучшения - игроки
+    for (auto upgradeIt = upgrades.begin(); upgradeIt != upgrades.end();) {
+        int collector = -1;
+        for (int i = 0; i < playerCount && collector < 0; i++) {
+            float distance = Vector2Distance(upgradeIt->position, players[i].position);
+            tests++;
+
+            if (distance < upgradeIt->radius + players[i].radius) {
+                collector = i;
+            }
+        }
+
+        if (collector >= 0) {
+            hits++;
+            RecordEvent(events, { EVENT_UPGRADE_COLLECTED, (unsigned char)upgradeIt->type, collector, upgradeIt->position });
+            erases++;
+            upgradeIt = upgrades.erase(upgradeIt);
+        }
+        else {
+            ++upgradeIt;
+        }
+    }
+
+    STAT_ADD(STAT_COLLISION_TESTS, tests);
+    STAT_ADD(STAT_COLLISION_HITS, hits);
+    STAT_ADD(STAT_ERASES, erases);
+}
+
+// Потребители событий (вызываются пачкой после симуляции)
+int GetKillReward(EnemyType type) {
+    switch (type) {
+    case ENEMY_GREEN: return 10;
+    case ENEMY_PURPLE: return 20;
+    case ENEMY_RED: return 50;
+    }
+    return 0;
+}
+
+void ConsumeScoreEvents(const EventBatch& batch, int& score) {
+    for (const auto& event : batch) {
+        if (event.type == EVENT_ENEMY_KILLED) {
+            score += GetKillReward((EnemyType)event.subtype);
+        }
+    }
+}
+
+void ConsumePlayerEvents(const EventBatch& batch, Player* players) {
+    for (const auto& event : batch) {
+        if (event.type == EVENT_PLAYER_HIT) {
+            players[event.subtype].health -= event.amount;
+        }
+        else if (event.type == EVENT_UPGRADE_COLLECTED) {
+            Upgrade upgrade;
+            upgrade.position = event.position;
+            upgrade.type = (UpgradeType)event.subtype;
+            ApplyUpgrade(upgrade, players[event.amount]);
+        }
+    }
+}
+
+void ConsumeStatsEvents(const EventBatch& batch, RunStats& stats) {
+    for (const auto& event : batch) {
+        switch (event.type) {
+        case EVENT_DAMAGE_DEALT: stats.damageDealt += event.amount; break;
+        case EVENT_ENEMY_KILLED: stats.kills[event.subtype]++; break;
+        case EVENT_PLAYER_HIT: stats.damageTaken += event.amount; break;
+        case EVENT_UPGRADE_COLLECTED: stats.upgradesCollected++; break;
+        default: break;
+        }
+    }
+}
+
+// Трассировка кадров (Chrome trace / Perfetto)
+// Включается параметром --trace файл.json. Начало и конец каждого Update*/Draw* и
+// счетчики сущностей пишутся в кольцевой буфер атомарным сдвигом позиции записи
+// (без блокировок, из любого потока). Сброс в файл идет в главном потоке в конце кадра,
+// когда рабочие потоки стоят на барьере
+const int TRACE_BUFFER_SIZE = 1 << 16;
+
+enum TracePhase : char {
+    TRACE_BEGIN = 'B',
+    TRACE_END = 'E',
+    TRACE_COUNTER = 'C'
+};
+
+struct TraceEvent {
+    const char* name;  // Строковый литерал
+    double timestamp;  // Микросекунды от открытия трассы
+    long long value;   // Значение счетчика
+    int thread;
+    TracePhase phase;
+};
+
+struct TraceBuffer {
+    TraceEvent events[TRACE_BUFFER_SIZE];
+    std::atomic<unsigned long long> writePos;
+    unsigned long long readPos;
+    unsigned long long dropped;
+    bool enabled;
+    bool firstEvent;
+    int threadCount;
+    FILE* file;
+    std::chrono::steady_clock::time_point start;
+};
+
+TraceBuffer traceBuffer;
+
+bool OpenTrace(const char* path) {
+    traceBuffer.file = fopen(path, "w");
+    if (traceBuffer.file == nullptr) return false;
+
+    traceBuffer.writePos = 0;
+    traceBuffer.readPos = 0;
+    traceBuffer.dropped = 0;
+    traceBuffer.firstEvent = true;
+    traceBuffer.threadCount = 1;
+    traceBuffer.start = std::chrono::steady_clock::now();
+    traceBuffer.enabled = true;
+    fprintf(traceBuffer.file, "{\"traceEvents\":[\n");
+    return true;
+}
+
+void PushTraceEvent(const char* name, TracePhase phase, long long value) {
+    if (!traceBuffer.enabled) return;
+
+    unsigned long long pos = traceBuffer.writePos.fetch_add(1, std::memory_order_relaxed);
+    TraceEvent& event = traceBuffer.events[pos & (TRACE_BUFFER_SIZE - 1)];
+    event.name = name;
+    event.timestamp = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - traceBuffer.start).count();
+    event.value = value;
+    event.thread = threadIndex;
+    event.phase = phase;
+}
+
+void TraceBegin(const char* name) {
+    PushTraceEvent(name, TRACE_BEGIN, 0);
+}
+
+void TraceEnd(const char* name) {
+    PushTraceEvent(name, TRACE_END, 0);
+}
+
+void TraceCounter(const char* name, long long value) {
+    PushTraceEvent(name, TRACE_COUNTER, value);
+}
+
+// Вызывается только когда другие потоки не пишут в буфер
+void FlushTrace() {
+    if (!traceBuffer.enabled) return;
+
+    unsigned long long writePos = traceBuffer.writePos.load();
+    if (writePos - traceBuffer.readPos > (unsigned long long)TRACE_BUFFER_SIZE) {
+        traceBuffer.dropped += writePos - traceBuffer.readPos - TRACE_BUFFER_SIZE;
+        traceBuffer.readPos = writePos - TRACE_BUFFER_SIZE;
+    }
+
+    for (; traceBuffer.readPos < writePos; traceBuffer.readPos++) {
+        const TraceEvent& event = traceBuffer.events[traceBuffer.readPos & (TRACE_BUFFER_SIZE - 1)];
+        traceBuffer.threadCount = std::max(traceBuffer.threadCount, event.thread + 1);
+
+        fprintf(traceBuffer.file, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%d",
+            traceBuffer.firstEvent ? "" : ",\n", event.name, (char)event.phase, event.timestamp, event.thread);
+        if (event.phase == TRACE_COUNTER) {
+            fprintf(traceBuffer.file, ",\"args\":{\"value\":%lld}", event.value);
+        }
+        fprintf(traceBuffer.file, "}");
+        traceBuffer.firstEvent = false;
+    }
+}
+
+void CloseTrace() {
+    if (!traceBuffer.enabled) return;
+
+    FlushTrace();
+    for (int thread = 0; thread < traceBuffer.threadCount; thread++) {
+        fprintf(traceBuffer.file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+            traceBuffer.firstEvent ? "" : ",\n", thread, thread == 0 ? "main" : TextFormat("worker %d", thread));
+        traceBuffer.firstEvent = false;
+    }
+    fprintf(traceBuffer.file, "\n]}\n");
+    fclose(traceBuffer.file);
+
+    if (traceBuffer.dropped > 0) {
+        TraceLog(LOG_WARNING, "TRACE: %llu events dropped (buffer overflow)", traceBuffer.dropped);
+    }
+    traceBuffer.enabled = false;
+}
+
+// Мир и системы
+// Все игровые сущности хранятся в пулах компонентов одного мира. Каждая система объявляет,
+// какие компоненты читает и какие пишет; планировщик раскладывает системы по стадиям так,
+// что системы одной стадии не конфликтуют, а конфликтующие выполняются в порядке регистрации.
+// Шина событий допускает запись из нескольких потоков и конфликтом не считается
+enum ComponentMask : unsigned int {
+    COMP_PLAYER            = 1 << 0,
+    COMP_BULLETS           = 1 << 1,
+    COMP_ENEMIES           = 1 << 2,
+    COMP_ENEMY_PROJECTILES = 1 << 3,
+    COMP_UPGRADES          = 1 << 4,
+    COMP_SHOCKWAVES        = 1 << 5,
+    COMP_BOMBS             = 1 << 6,
+    COMP_FREEZE_AREAS      = 1 << 7,
+    COMP_FIREBALLS         = 1 << 8,
+    COMP_CAMERA            = 1 << 9,
+    COMP_CHUNKS            = 1 << 10,
+    COMP_STATUS            = 1 << 11
+};
+
+const int MAX_PLAYERS = 4;
+
+struct World {
+    Player players[MAX_PLAYERS];
+    int playerCount;
+    EnemyArchetypeTable archetypes;
+    Camera2D camera;
+    ComponentPool<Bullet> bullets;
+    ComponentPool<Enemy> enemies;
+    ComponentPool<EnemyProjectile> enemyProjectiles;
+    ComponentPool<Upgrade> upgrades;
+    ComponentPool<Shockwave> shockwaves;
+    ComponentPool<Bomb> bombs;
+    ComponentPool<FreezeArea> freezeAreas;
+    ComponentPool<Fireball> fireballs;
+    StatusEffects statuses;
+    TaggedVector<AoeHit, MEM_EFFECTS> shockwaveHits; // Попадания живых волн (отсортированы)
+    ChunkGrid chunkGrid;
+    AoeQuery aoeQuery;              // Рабочий буфер ResolveAreaEffects
+    EnemyMoveBatch enemyMoveBatch;  // Рабочий буфер UpdateEnemies
+    EventBus events;
+    TimerWheel timers;              // Свой замок: таймеры ставятся из любых систем
+};
+
+// Данные тика, общие для всех систем
+struct FrameContext {
+    unsigned int tick;
+    double deltaTime;               // Всегда SIM_TICK_SECONDS
+    const PlayerInput* inputs;      // По одному на игрока
+};
+
+typedef void (*SystemFunction)(World& world, const FrameContext& frame);
+
+struct SystemDesc {
+    const char* name;
+    unsigned int reads;
+    unsigned int writes;
+    SystemFunction run;
+};
+
+// Время выполнения системы в последнем кадре (для выгрузки графа)
+struct SystemTiming {
+    double startMs;  // От начала RunSchedule
+    double endMs;
+    int worker;      // 0 - главный поток
+};
+
+typedef TaggedVector<int, MEM_SYSTEMS> SystemList;
+
+struct SystemScheduler {
+    TaggedVector<SystemDesc, MEM_SYSTEMS> systems;
+    TaggedVector<SystemList, MEM_SYSTEMS> stages;        // Индексы систем по стадиям
+    TaggedVector<SystemList, MEM_SYSTEMS> dependencies;  // Более ранние конфликтующие системы
+    SystemList systemStage;
+    TaggedVector<SystemTiming, MEM_SYSTEMS> lastRun;
+};
+
+// Пул рабочих потоков
+// Стадия раздается задачами по атомарному счетчику; главный поток тоже берет задачи,
+// а возврат из RunTasks - это барьер: все задачи пачки выполнены
+typedef void (*TaskFunction)(void* context, int index, int worker);
+
+struct TaskPool {
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    TaskFunction function;
+    void* context;
+    int taskCount;
+    std::atomic<int> nextTask;
+    std::atomic<int> remainingTasks;
+    int busyWorkers;
+    unsigned long long generation;
+    bool stopping;
+};
+
+void RunPendingTasks(TaskPool& pool, int worker) {
+    for (;;) {
+        int index = pool.nextTask.fetch_add(1);
+        if (index >= pool.taskCount) break;
+
+        pool.function(pool.context, index, worker);
+        if (pool.remainingTasks.fetch_sub(1) == 1) {
+            std::lock_guard<std::mutex> lock(pool.mutex);
+            pool.done.notify_all();
+        }
+    }
+}
+
+void TaskWorkerLoop(TaskPool* pool, int worker) {
+    threadIndex = worker;
+    unsigned long long seenGeneration = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(pool->mutex);
+            pool->wake.wait(lock, [&] { return pool->stopping || pool->generation != seenGeneration; });
+            if (pool->stopping) return;
+            seenGeneration = pool->generation;
+            pool->busyWorkers++;
+        }
+
+        RunPendingTasks(*pool, worker);
+
+        std::lock_guard<std::mutex> lock(pool->mutex);
+        pool->busyWorkers--;
+        pool->done.notify_all();
+    }
+}
+
+void StartTaskPool(TaskPool& pool, int workerCount) {
+    pool.function = nullptr;
+    pool.context = nullptr;
+    pool.taskCount = 0;
+    pool.nextTask = 0;
+    pool.remainingTasks = 0;
+    pool.busyWorkers = 0;
+    pool.generation = 0;
+    pool.stopping = false;
+
+    for (int i = 0; i < workerCount; i++) {
+        pool.workers.push_back(std::thread(TaskWorkerLoop, &pool, i + 1));
+    }
+}
+
+// По числу ядер без главного потока: он тоже берет задачи
+int GetDefaultWorkerCount() {
+    return GetThreadCount() - 1;
+}
+
+void StopTaskPool(TaskPool& pool) {
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        pool.stopping = true;
+    }
+    pool.wake.notify_all();
+    for (auto& worker : pool.workers) {
+        worker.join();
+    }
+    pool.workers.clear();
+}
+
+void RunTasks(TaskPool& pool, TaskFunction function, void* context, int count) {
+    if (pool.workers.empty() || count <= 1) {
+        for (int i = 0; i < count; i++) {
+            function(context, i, 0);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        pool.function = function;
+        pool.context = context;
+        pool.taskCount = count;
+        pool.remainingTasks = count;
+        pool.nextTask = 0;
+        pool.generation++;
+    }
+    pool.wake.notify_all();
+
+    RunPendingTasks(pool, 0);
+
+    std::unique_lock<std::mutex> lock(pool.mutex);
+    pool.done.wait(lock, [&] { return pool.remainingTasks == 0 && pool.busyWorkers == 0; });
+}
+
+bool SystemsConflict(const SystemDesc& a, const SystemDesc& b) {
+    return (a.writes & (b.reads | b.writes)) != 0 || (b.writes & a.reads) != 0;
+}
+
+void AddSystem(SystemScheduler& scheduler, const char* name, unsigned int reads, unsigned int writes, SystemFunction run) {
+    scheduler.systems.push_back({ name, reads, writes, run });
+}
+
+// Система попадает в стадию сразу после последней стадии с конфликтующей системой
+void BuildSchedule(SystemScheduler& scheduler) {
+    size_t count = scheduler.systems.size();
+    scheduler.stages.clear();
+    scheduler.dependencies.assign(count, SystemList());
+    scheduler.systemStage.assign(count, 0);
+    scheduler.lastRun.assign(count, { 0.0, 0.0, 0 });
+
+    for (size_t i = 0; i < count; i++) {
+        int stage = 0;
+        for (size_t j = 0; j < i; j++) {
+            if (SystemsConflict(scheduler.systems[i], scheduler.systems[j])) {
+                stage = std::max(stage, scheduler.systemStage[j] + 1);
+                scheduler.dependencies[i].push_back((int)j);
+            }
+        }
+
+        scheduler.systemStage[i] = stage;
+        if (stage >= (int)scheduler.stages.size()) {
+            scheduler.stages.resize(stage + 1);
+        }
+        scheduler.stages[stage].push_back((int)i);
+    }
+}
+
+// Задача стадии: одна система
+struct StageTasks {
+    SystemScheduler* scheduler;
+    const SystemList* stage;
+    World* world;
+    const FrameContext* frame;
+    std::chrono::steady_clock::time_point start;
+};
+
+void RunStageTask(void* context, int index, int worker) {
+    StageTasks& tasks = *(StageTasks*)context;
+    int system = (*tasks.stage)[index];
+    SystemTiming& timing = tasks.scheduler->lastRun[system];
+
+    timing.startMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tasks.start).count();
+    TraceBegin(tasks.scheduler->systems[system].name);
+    eventSource = (unsigned int)system + 1;
+    tasks.scheduler->systems[system].run(*tasks.world, *tasks.frame);
+    eventSource = 0;
+    TraceEnd(tasks.scheduler->systems[system].name);
+    timing.endMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tasks.start).count();
+    timing.worker = worker;
+}
+
+// Системы одной стадии выполняются параллельно, между стадиями - барьер
+void RunSchedule(SystemScheduler& scheduler, TaskPool& pool, World& world, const FrameContext& frame) {
+    StageTasks tasks = { &scheduler, nullptr, &world, &frame, std::chrono::steady_clock::now() };
+    for (const auto& stage : scheduler.stages) {
+        tasks.stage = &stage;
+        RunTasks(pool, RunStageTask, &tasks, (int)stage.size());
+    }
+}
+
+// Граф последнего выполненного кадра в формате Graphviz: стадии, зависимости,
+// время и поток каждой системы
+bool WriteScheduleGraph(const SystemScheduler& scheduler, const char* path) {
+    FILE* file = fopen(path, "w");
+    if (file == nullptr) return false;
+
+    fprintf(file, "digraph schedule {\n    rankdir=LR;\n    node [shape=box];\n");
+    for (size_t stage = 0; stage < scheduler.stages.size(); stage++) {
+        fprintf(file, "    subgraph cluster_stage%d {\n        label=\"stage %d\";\n", (int)stage, (int)stage);
+        for (int system : scheduler.stages[stage]) {
+            const SystemTiming& timing = scheduler.lastRun[system];
+            fprintf(file, "        s%d [label=\"%s\\n%.3f ms @ %.3f ms\\nworker %d\"];\n", system,
+                scheduler.systems[system].name, timing.endMs - timing.startMs, timing.startMs, timing.worker);
+        }
+        fprintf(file, "    }\n");
+    }
+
+    for (size_t system = 0; system < scheduler.dependencies.size(); system++) {
+        for (int dependency : scheduler.dependencies[system]) {
+            fprintf(file, "    s%d -> s%d;\n", dependency, (int)system);
+        }
+    }
+
+    fprintf(file, "}\n");
+    fclose(file);
+    return true;
+}
+
+// Игроки стоят рядом в центре мира, у каждого свои мета-улучшения
+void ResetWorld(World& world, const MetaProgression* metas, int playerCount) {
+    world.playerCount = playerCount;
+    for (int i = 0; i < playerCount; i++) {
+        world.players[i] = CreatePlayer(metas[i]);
+        world.players[i].position.x += (i - (playerCount - 1) * 0.5f) * 60.0f * SIZE_MULTIPLIER;
+    }
+    UpdateCamera(world.camera, world.players[0].position);
+    world.bullets.clear();
+    world.enemies.clear();
+    world.enemyProjectiles.clear();
+    world.upgrades.clear();
+    world.shockwaves.clear();
+    world.bombs.clear();
+    world.freezeAreas.clear();
+    world.fireballs.clear();
+    ClearStatusEffects(world.statuses);
+    world.shockwaveHits.clear();
+    ResetTimers(world.timers, 0);
+
+    // Враги прошлого забега удалены, архетипы можно регистрировать заново
+    world.archetypes.clear();
+}
+
+// Обработка сработавших таймеров мира (главный поток, до запуска систем тика).
+// Таймеры волны обрабатывает забег
+void DispatchWorldTimers(World& world, const TimerBatch& fired) {
+    for (const Timer& timer : fired) {
+        switch (timer.kind) {
+        case TIMER_ABILITY_READY:
+            world.players[timer.target.slot / ABILITY_COUNT].abilityReady |= 1u << (timer.target.slot % ABILITY_COUNT);
+            break;
+
+        case TIMER_BOMB_FUSE: {
+            Bomb* bomb = world.bombs.Get(timer.target);
+            if (bomb != nullptr) {
+                ExplodeBomb(*bomb, world.events);
+            }
+            break;
+        }
+
+        case TIMER_FREEZE_EXPIRE:
+            world.freezeAreas.Remove(timer.target);
+            break;
+
+        case TIMER_FIREBALL_CLEAR:
+            world.fireballs.Remove(timer.target);
+            break;
+
+        case TIMER_STATUS_FREEZE:
+        case TIMER_STATUS_SLOW:
+        case TIMER_STATUS_BURN:
+        case TIMER_STATUS_POISON:
+            ExpireStatus(world.statuses, world.enemies, world.timers, (StatusEffectType)(timer.kind - TIMER_STATUS_FREEZE),
+                timer.target, timer.tick);
+            break;
+
+        default:
+            break;
+        }
+    }
+}
+
+// Сжатие контейнеров на границе волны: возвращается емкость, намного превышающая
+// живые сущности (пик прошлой волны). enemyKeep - размер новой волны, его емкость остается
+void CompactWorld(World& world, size_t enemyKeep) {
+    world.bullets.compact(0);
+    world.enemies.compact(enemyKeep);
+    world.enemyProjectiles.compact(0);
+    world.upgrades.compact(0);
+    world.shockwaves.compact(0);
+    world.bombs.compact(0);
+    world.freezeAreas.compact(0);
+    world.fireballs.compact(0);
+    for (StatusTable& table : world.statuses.tables) {
+        CompactVector(table.target, 0);
+        CompactVector(table.expireTick, 0);
+        CompactVector(table.damage, 0);
+    }
+    CompactVector(world.statuses.enemyIndex, enemyKeep);
+    CompactVector(world.statuses.killed, 0);
+    CompactVector(world.shockwaveHits, 0);
+    CompactVector(world.aoeQuery.hits, 0);
+    CompactVector(world.aoeQuery.killed, 0);
+    CompactVector(world.chunkGrid.enemyOrder, enemyKeep);
+    CompactVector(world.chunkGrid.enemyChunk, enemyKeep);
+    CompactVector(world.enemyMoveBatch.index, enemyKeep);
+    CompactVector(world.enemyMoveBatch.x, enemyKeep);
+    CompactVector(world.enemyMoveBatch.y, enemyKeep);
+    CompactVector(world.enemyMoveBatch.targetX, enemyKeep);
+    CompactVector(world.enemyMoveBatch.targetY, enemyKeep);
+    CompactVector(world.enemyMoveBatch.step, enemyKeep);
+    CompactVector(world.enemyMoveBatch.range, enemyKeep);
+}
+
+void PlayerSystem(World& world, const FrameContext& frame) {
+    for (int i = 0; i < world.playerCount; i++) {
+        UpdatePlayer(i, world.players[i], frame.inputs[i], world.timers, world.bullets, world.enemies,
+            world.shockwaves, world.bombs, world.freezeAreas, world.fireballs, world.events);
+    }
+}
+
+// Видимая область игрока: у первого это вид камеры, у остальных - экран с центром на игроке
+Rectangle GetPlayerView(const World& world, int playerIndex) {
+    Rectangle view = GetCameraView(world.camera);
+    if (playerIndex == 0) return view;
+    Vector2 position = world.players[playerIndex].position;
+    return { position.x - view.width / 2, position.y - view.height / 2, view.width, view.height };
+}
+
+// Камера следует за первым игроком, активные чанки покрывают области всех игроков
+void ChunkSystem(World& world, const FrameContext& frame) {
+    UpdateCamera(world.camera, world.players[0].position);
+
+    Rectangle area = GetCameraView(world.camera);
+    for (int i = 1; i < world.playerCount; i++) {
+        Rectangle view = GetPlayerView(world, i);
+        float right = std::max(area.x + area.width, view.x + view.width);
+        float bottom = std::max(area.y + area.height, view.y + view.height);
+        area.x = std::min(area.x, view.x);
+        area.y = std::min(area.y, view.y);
+        area.width = right - area.x;
+        area.height = bottom - area.y;
+    }
+    SetActiveChunks(world.chunkGrid, area);
+    BuildChunkGrid(world.chunkGrid, world.enemies);
+}
+
+void BulletSystem(World& world, const FrameContext& frame) {
+    UpdateBullets(world.bullets, GetActiveArea(world.chunkGrid));
+}
+
+// Заморозка накладывается до движения врагов, пока индексы раскладки по чанкам верны
+void StatusAreaSystem(World& world, const FrameContext& frame) {
+    ApplyFreezeAreas(world.statuses, world.enemies, world.freezeAreas, world.chunkGrid, world.timers, frame.tick);
+}
+
+void EnemySystem(World& world, const FrameContext& frame) {
+    UpdateEnemies(world.enemies, world.archetypes, world.players, world.playerCount, world.enemyProjectiles,
+        world.chunkGrid, world.enemyMoveBatch, frame.tick, world.events);
+}
+
+void EnemyProjectileSystem(World& world, const FrameContext& frame) {
+    UpdateEnemyProjectiles(world.enemyProjectiles, world.enemies, GetActiveArea(world.chunkGrid));
+}
+
+void ShockwaveSystem(World& world, const FrameContext& frame) {
+    UpdateShockwaves(world.shockwaves, GetActiveArea(world.chunkGrid));
+}
+
+void FireballSystem(World& world, const FrameContext& frame) {
+    UpdateFireballs(world.fireballs, world.enemies, GetActiveArea(world.chunkGrid), world.timers, world.events);
+}
+
+// Раскладка по чанкам еще верна: до этой системы враги только двигались
+void AreaEffectSystem(World& world, const FrameContext& frame) {
+    ResolveAreaEffects(world.enemies, world.archetypes, world.chunkGrid, world.shockwaves, world.bombs, world.fireballs,
+        world.shockwaveHits, world.aoeQuery, world.statuses, world.timers, frame.tick, world.events);
+}
+
+void CollisionSystem(World& world, const FrameContext& frame) {
+    CheckCollisions(world.players, world.playerCount, world.bullets, world.enemies, world.archetypes, world.enemyProjectiles, world.upgrades,
+        world.fireballs, world.timers, world.events);
+}
+
+// Урон по времени удаляет убитых врагов, поэтому идет последним
+void StatusSystem(World& world, const FrameContext& frame) {
+    TickDamageStatuses(world.statuses, world.enemies, world.archetypes, world.events, frame.tick);
+}
+
+// Порядок регистрации задает порядок выполнения конфликтующих систем
+SystemScheduler CreateGameplaySchedule() {
+    SystemScheduler scheduler;
+    AddSystem(scheduler, "UpdatePlayer", COMP_ENEMIES,
+        COMP_PLAYER | COMP_BULLETS | COMP_SHOCKWAVES | COMP_BOMBS | COMP_FREEZE_AREAS | COMP_FIREBALLS, PlayerSystem);
+    AddSystem(scheduler, "UpdateChunks", COMP_PLAYER | COMP_ENEMIES, COMP_CAMERA | COMP_CHUNKS, ChunkSystem);
+    AddSystem(scheduler, "UpdateBullets", COMP_CHUNKS, COMP_BULLETS, BulletSystem);
+    AddSystem(scheduler, "ApplyFreezeAreas", COMP_FREEZE_AREAS | COMP_CHUNKS, COMP_ENEMIES | COMP_STATUS, StatusAreaSystem);
+    AddSystem(scheduler, "UpdateEnemies", COMP_PLAYER | COMP_CHUNKS,
+        COMP_ENEMIES | COMP_ENEMY_PROJECTILES, EnemySystem);
+    AddSystem(scheduler, "UpdateEnemyProjectiles", COMP_ENEMIES | COMP_CHUNKS, COMP_ENEMY_PROJECTILES, EnemyProjectileSystem);
+    AddSystem(scheduler, "UpdateShockwaves", COMP_CHUNKS, COMP_SHOCKWAVES, ShockwaveSystem);
+    AddSystem(scheduler, "UpdateFireballs", COMP_ENEMIES | COMP_CHUNKS, COMP_FIREBALLS, FireballSystem);
+    AddSystem(scheduler, "ResolveAreaEffects", COMP_CHUNKS,
+        COMP_ENEMIES | COMP_SHOCKWAVES | COMP_BOMBS | COMP_FIREBALLS | COMP_STATUS, AreaEffectSystem);
+    AddSystem(scheduler, "CheckCollisions", COMP_PLAYER,
+        COMP_BULLETS | COMP_ENEMIES | COMP_ENEMY_PROJECTILES | COMP_UPGRADES | COMP_FIREBALLS, CollisionSystem);
+    AddSystem(scheduler, "UpdateStatusEffects", 0, COMP_ENEMIES | COMP_STATUS, StatusSystem);
+    BuildSchedule(scheduler);
+    return scheduler;
+}
+
+// Забег: волны, счет и статистика поверх мира. Один шаг забега общий для окна
+// и безголовых режимов; эффекты и отрисовку вызывающий делает сам по eventBatch
+struct GameSession {
+    WavePlan wavePlan;
+    SimRandom random;
+    double enemySpawnCooldown;
+    int score;
+    RunStats runStats;
+    unsigned int tick;         // Единственные часы симуляции
+    double gameTime;           // tick * SIM_TICK_SECONDS
+    double tickAccumulator;    // Время кадров, еще не отданное тикам (окно)
+    int waveNumber;
+    int enemiesPerWave;
+    EventBatch eventBatch;     // События последнего шага
+    TimerBatch firedTimers;    // Таймеры, сработавшие в последнем шаге
+};
+
+// Таймер спавна ставится только на ближайшую запись расписания
+void ScheduleWaveSpawn(GameSession& session, World& world) {
+    if (!IsWaveSpawning(session.wavePlan)) return;
+    unsigned int spawnTick = GetNextSpawnTick(session.wavePlan);
+    ScheduleTimer(world.timers, spawnTick > session.tick ? spawnTick - session.tick : 1, TIMER_WAVE_SPAWN, { 0, 0 });
+}
+
+// Мета-очки за забег
+int GetPointsEarned(int score) {
+    return std::max(1, score / 10);
+}
+
+void StartGameSession(GameSession& session, World& world, const MetaProgression* metas, int playerCount, unsigned int seed) {
+    ResetWorld(world, metas, playerCount);
+    session.random = CreateSimRandom(seed);
+    session.enemySpawnCooldown = 2.0;
+    session.score = 0;
+    session.runStats = { { 0, 0, 0 }, 0, 0, 0 };
+    session.tick = 0;
+    session.gameTime = 0;
+    session.tickAccumulator = 0;
+    session.waveNumber = 1;
+    session.enemiesPerWave = 5;
+    session.eventBatch.clear();
+    PlanWave(session.wavePlan, world.archetypes, session.random, session.waveNumber, session.enemiesPerWave, session.tick,
+        session.enemySpawnCooldown, true);
+    ScheduleWaveSpawn(session, world);
+}
+
+// Один тик симуляции фиксированной длины.
+// stats == nullptr - счетчики тика не сводятся (параллельные забеги: сведение трогает блоки всех потоков)
+void StepGameSession(GameSession& session, World& world, SystemScheduler& schedule, TaskPool& pool,
+    const PlayerInput* inputs, StatsState* stats) {
+    session.tick++;
+    session.gameTime = session.tick * SIM_TICK_SECONDS;
+    AdvanceTimers(world.timers, session.tick, session.firedTimers);
+
+    // Система волн с бесконечным усложнением
+    if (world.enemies.empty() && !IsWaveSpawning(session.wavePlan)) {
+        session.waveNumber++;
+        session.enemiesPerWave = 5 + session.waveNumber * 2;
+        PlanWave(session.wavePlan, world.archetypes, session.random, session.waveNumber, session.enemiesPerWave, session.tick,
+            session.enemySpawnCooldown, false);
+        ScheduleWaveSpawn(session, world);
+        CompactWorld(world, session.enemiesPerWave);
+        CompactVector(session.eventBatch, 0);
+        world.enemies.reserve(session.enemiesPerWave);
+    }
+
+    Rectangle views[MAX_PLAYERS];
+    for (int i = 0; i < world.playerCount; i++) {
+        views[i] = GetPlayerView(world, i);
+    }
+
+    // Спавн врагов в волнах (за краем видимых областей) и остальные таймеры
+    for (const Timer& timer : session.firedTimers) {
+        if (timer.kind != TIMER_WAVE_SPAWN) continue;
+        SpawnDueEnemies(session.wavePlan, world.archetypes, session.tick, views, world.playerCount, world.enemies);
+        ScheduleWaveSpawn(session, world);
+    }
+    DispatchWorldTimers(world, session.firedTimers);
+
+    // Спавн улучшений (в видимой области одного из игроков по очереди)
+    if (SimRandomValue(session.random, 0, 1000) < 2) {
+        const Rectangle& view = views[session.tick % world.playerCount];
+        Vector2 spawnPos = {
+            (float)SimRandomValue(session.random, (int)view.x + 50, (int)(view.x + view.width) - 50),
+            (float)SimRandomValue(session.random, (int)view.y + 50, (int)(view.y + view.height) - 50)
+        };
+        world.upgrades.push_back(CreateUpgrade(spawnPos, session.random));
+        STAT_ADD(STAT_UPGRADE_SPAWNS, 1);
+    }
+
+    // Обновление игровых объектов (системы мира)
+    FrameContext frame = { session.tick, SIM_TICK_SECONDS, inputs };
+    RunSchedule(schedule, pool, world, frame);
+
+    // Обработка событий кадра пачкой
+    DrainEvents(world.events, session.eventBatch);
+    ConsumeScoreEvents(session.eventBatch, session.score);
+    ConsumePlayerEvents(session.eventBatch, world.players);
+    ConsumeStatsEvents(session.eventBatch, session.runStats);
+    if (stats) EndStatsTick(*stats, SIM_TICK_SECONDS);
+
+    // Очко за каждую полную секунду выживания
+    if (session.tick % SIM_TICK_RATE == 0) {
+        session.score++;
+    }
+}
+
+// Сетевая игра: детерминированный lockstep с откатом
+// Пиры шлют только свой ввод по тикам (дельтами к предыдущему тику) через ретранслятор.
+// Чужой ввод, которого еще нет, предсказывается повтором последнего подтвержденного;
+// если подтвержденный ввод разошелся с предсказанием, мир откатывается к снимку
+// перед этим тиком и пересчитывается. Трафик не зависит от числа врагов.
+const int NET_INPUT_DELAY = 2;              // Свой ввод применяется через N тиков (меньше откатов)
+const int ROLLBACK_WINDOW = 8;              // Насколько тиков можно уйти вперед подтвержденного
+const int NET_INPUT_HISTORY = 64;           // Кольцо ввода (степень двойки)
+const int NET_MAX_INPUTS_PER_PACKET = 32;   // Бит на тик в маске изменений
+const int NET_MAX_PACKET = 16 + MAX_PLAYERS * 4 + NET_MAX_INPUTS_PER_PACKET * 2;
+
+static_assert(NET_INPUT_HISTORY >= NET_MAX_INPUTS_PER_PACKET + ROLLBACK_WINDOW + NET_INPUT_DELAY + 2,
+    "Input history must cover unacknowledged and predicted ticks");
+
+enum NetPacketType : unsigned char {
+    NET_PACKET_INPUT = 1,       // Ввод пира (lockstep)
+    NET_PACKET_CLIENT_INPUT,    // Ввод и вид клиента авторитетного сервера
+    NET_PACKET_SNAPSHOT         // Снимок сущностей от сервера
+};
+
+// UDP-сокет на 127.0.0.1 (неблокирующий)
+struct UdpSocket {
+    NetSocketHandle handle;
+};
+
+NetAddress MakeLoopbackAddress(unsigned short port) {
+    NetAddress address;
+    memset(&address, 0, sizeof(address));
+#if defined(_WIN32)
+    address.family = NET_AF_INET;
+    address.port = (unsigned short)((port >> 8) | (port << 8));
+    address.address = 0x0100007F;
+#else
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+#endif
+    return address;
+}
+
+unsigned short GetAddressPort(const NetAddress& address) {
+#if defined(_WIN32)
+    return (unsigned short)((address.port >> 8) | (address.port << 8));
+#else
+    return ntohs(address.sin_port);
+#endif
+}
+
+bool OpenUdpSocket(UdpSocket& udp) {
+#if defined(_WIN32)
+    static bool started = false;
+    if (!started) {
+        WinsockData data;
+        if (WSAStartup(0x0202, &data) != 0) return false;
+        started = true;
+    }
+    udp.handle = socket(NET_AF_INET, NET_SOCK_DGRAM, 0);
+#else
+    udp.handle = socket(AF_INET, SOCK_DGRAM, 0);
+#endif
+    if (udp.handle == INVALID_NET_SOCKET) return false;
+
+    NetAddress address = MakeLoopbackAddress(0);
+    bool ok = bind(udp.handle, (const sockaddr*)&address, sizeof(address)) == 0;
+#if defined(_WIN32)
+    unsigned long nonBlocking = 1;
+    ok = ok && ioctlsocket(udp.handle, NET_FIONBIO, &nonBlocking) == 0;
+#else
+    ok = ok && fcntl(udp.handle, F_SETFL, fcntl(udp.handle, F_GETFL, 0) | O_NONBLOCK) == 0;
+#endif
+    return ok;
+}
+
+void CloseUdpSocket(UdpSocket& udp) {
+    if (udp.handle == INVALID_NET_SOCKET) return;
+#if defined(_WIN32)
+    closesocket(udp.handle);
+#else
+    close(udp.handle);
+#endif
+    udp.handle = INVALID_NET_SOCKET;
+}
+
+unsigned short GetUdpPort(const UdpSocket& udp) {
+    NetAddress address;
+#if defined(_WIN32)
+    int length = sizeof(address);
+#else
+    socklen_t length = sizeof(address);
+#endif
+    if (getsockname(udp.handle, (sockaddr*)&address, &length) != 0) return 0;
+    return GetAddressPort(address);
+}
+
+bool SendUdp(const UdpSocket& udp, unsigned short port, const unsigned char* data, int size) {
+    NetAddress address = MakeLoopbackAddress(port);
+    return sendto(udp.handle, (const char*)data, size, 0, (const sockaddr*)&address, sizeof(address)) == size;
+}
+
+// Размер принятого пакета или -1, если очередь пуста
+int ReceiveUdp(const UdpSocket& udp, unsigned char* buffer, int capacity, unsigned short& fromPort) {
+    NetAddress address;
+#if defined(_WIN32)
+    int length = sizeof(address);
+#else
+    socklen_t length = sizeof(address);
+#endif
+    int size = (int)recvfrom(udp.handle, (char*)buffer, capacity, 0, (sockaddr*)&address, &length);
+    if (size < 0) return -1;
+    fromPort = GetAddressPort(address);
+    return size;
+}
+
+// Запись и чтение полей пакета (little-endian, без выравнивания)
+void WriteU8(unsigned char*& cursor, unsigned int value) {
+    *cursor++ = (unsigned char)value;
+}
+
+void WriteU32(unsigned char*& cursor, unsigned int value) {
+    for (int i = 0; i < 4; i++) *cursor++ = (unsigned char)(value >> (i * 8));
+}
+
+unsigned int ReadU8(const unsigned char*& cursor) {
+    return *cursor++;
+}
+
+unsigned int ReadU32(const unsigned char*& cursor) {
+    unsigned int value = 0;
+    for (int i = 0; i < 4; i++) value |= (unsigned int)*cursor++ << (i * 8);
+    return value;
+}
+
+// Пакет ввода:
+//   u8 тип, u8 игрок, u8 число игроков, u8 число тиков
+//   u32 первый тик, u32 подтвержденный тик ввода каждого игрока (ack)
+//   u32 маска изменений, затем moveX/moveY только изменившихся тиков
+// Ввод первого тика сравнивается с тиком перед ним: отправитель начинает с тика,
+// следующего за подтвержденным всеми, поэтому базу получатель уже знает
+struct NetInputPacket {
+    int player;
+    int playerCount;
+    unsigned int firstTick;
+    int count;
+    unsigned int ack[MAX_PLAYERS];
+    PlayerInput inputs[NET_MAX_INPUTS_PER_PACKET];
+};
+
+int WriteInputPacket(const NetInputPacket& packet, PlayerInput base, unsigned char* buffer) {
+    unsigned char* cursor = buffer;
+    WriteU8(cursor, NET_PACKET_INPUT);
+    WriteU8(cursor, packet.player);
+    WriteU8(cursor, packet.playerCount);
+    WriteU8(cursor, packet.count);
+    WriteU32(cursor, packet.firstTick);
+    for (int i = 0; i < packet.playerCount; i++) {
+        WriteU32(cursor, packet.ack[i]);
+    }
+
+    unsigned char* maskCursor = cursor;
+    cursor += 4;
+    unsigned int changed = 0;
+    PlayerInput previous = base;
+    for (int i = 0; i < packet.count; i++) {
+        if (packet.inputs[i] == previous) continue;
+        changed |= 1u << i;
+        WriteU8(cursor, (unsigned char)packet.inputs[i].moveX);
+        WriteU8(cursor, (unsigned char)packet.inputs[i].moveY);
+        previous = packet.inputs[i];
+    }
+    WriteU32(maskCursor, changed);
+    return (int)(cursor - buffer);
+}
+
+// Разбор заголовка; ввод восстанавливается ApplyInputPacket, когда известна база
+bool ReadInputPacketHeader(const unsigned char* buffer, int size, NetInputPacket& packet, const unsigned char*& body) {
+    const unsigned char* cursor = buffer;
+    if (size < 8 || ReadU8(cursor) != NET_PACKET_INPUT) return false;
+    packet.player = (int)ReadU8(cursor);
+    packet.playerCount = (int)ReadU8(cursor);
+    packet.count = (int)ReadU8(cursor);
+    if (packet.player >= MAX_PLAYERS || packet.playerCount > MAX_PLAYERS || packet.player >= packet.playerCount ||
+        packet.count > NET_MAX_INPUTS_PER_PACKET || size < 8 + packet.playerCount * 4 + 4) {
+        return false;
+    }
+    packet.firstTick = ReadU32(cursor);
+    for (int i = 0; i < packet.playerCount; i++) {
+        packet.ack[i] = ReadU32(cursor);
+    }
+    body = cursor;
+    return true;
+}
+
+bool ReadInputPacketBody(const unsigned char* body, const unsigned char* end, PlayerInput base, NetInputPacket& packet) {
+    const unsigned char* cursor = body;
+    unsigned int changed = ReadU32(cursor);
+    PlayerInput previous = base;
+    for (int i = 0; i < packet.count; i++) {
+        if (changed & (1u << i)) {
+            if (end - cursor < 2) return false;
+            previous.moveX = (signed char)ReadU8(cursor);
+            previous.moveY = (signed char)ReadU8(cursor);
+        }
+        packet.inputs[i] = previous;
+    }
+    return true;
+}
+
+// Снимок состояния симуляции для отката. Рабочие буферы (чанки, пакет движения, шина
+// событий) пересчитываются каждый тик и в снимок не входят
+struct SimSnapshot {
+    Player players[MAX_PLAYERS];
+    EnemyArchetypeTable archetypes;
+    Camera2D camera;
+    ComponentPool<Bullet> bullets;
+    ComponentPool<Enemy> enemies;
+    ComponentPool<EnemyProjectile> enemyProjectiles;
+    ComponentPool<Upgrade> upgrades;
+    ComponentPool<Shockwave> shockwaves;
+    ComponentPool<Bomb> bombs;
+    ComponentPool<FreezeArea> freezeAreas;
+    ComponentPool<Fireball> fireballs;
+    StatusEffects statuses;
+    TaggedVector<AoeHit, MEM_EFFECTS> shockwaveHits;
+    TaggedVector<Timer, MEM_SYSTEMS> timerNodes;
+    TaggedVector<int, MEM_SYSTEMS> timerSlots;
+    int timerFreeNode;
+    unsigned int timerTick;
+    WavePlan wavePlan;
+    SimRandom random;
+    double enemySpawnCooldown;
+    int score;
+    RunStats runStats;
+    unsigned int tick;
+    int waveNumber;
+    int enemiesPerWave;
+};
+
+// Копирование в уже выделенные массивы снимка: в установившемся режиме без аллокаций
+void SaveSnapshot(SimSnapshot& snapshot, const World& world, const GameSession& session) {
+    for (int i = 0; i < world.playerCount; i++) {
+        snapshot.players[i] = world.players[i];
+    }
+    snapshot.archetypes = world.archetypes;
+    snapshot.camera = world.camera;
+    snapshot.bullets = world.bullets;
+    snapshot.enemies = world.enemies;
+    snapshot.enemyProjectiles = world.enemyProjectiles;
+    snapshot.upgrades = world.upgrades;
+    snapshot.shockwaves = world.shockwaves;
+    snapshot.bombs = world.bombs;
+    snapshot.freezeAreas = world.freezeAreas;
+    snapshot.fireballs = world.fireballs;
+    snapshot.statuses = world.statuses;
+    snapshot.shockwaveHits = world.shockwaveHits;
+    snapshot.timerNodes = world.timers.nodes;
+    snapshot.timerSlots = world.timers.slots;
+    snapshot.timerFreeNode = world.timers.freeNode;
+    snapshot.timerTick = world.timers.currentTick;
+    snapshot.wavePlan = session.wavePlan;
+    snapshot.random = session.random;
+    snapshot.enemySpawnCooldown = session.enemySpawnCooldown;
+    snapshot.score = session.score;
+    snapshot.runStats = session.runStats;
+    snapshot.tick = session.tick;
+    snapshot.waveNumber = session.waveNumber;
+    snapshot.enemiesPerWave = session.enemiesPerWave;
+}
+
+void RestoreSnapshot(const SimSnapshot& snapshot, World& world, GameSession& session) {
+    for (int i = 0; i < world.playerCount; i++) {
+        world.players[i] = snapshot.players[i];
+    }
+    world.archetypes = snapshot.archetypes;
+    world.camera = snapshot.camera;
+    world.bullets = snapshot.bullets;
+    world.enemies = snapshot.enemies;
+    world.enemyProjectiles = snapshot.enemyProjectiles;
+    world.upgrades = snapshot.upgrades;
+    world.shockwaves = snapshot.shockwaves;
+    world.bombs = snapshot.bombs;
+    world.freezeAreas = snapshot.freezeAreas;
+    world.fireballs = snapshot.fireballs;
+    world.statuses = snapshot.statuses;
+    world.shockwaveHits = snapshot.shockwaveHits;
+    world.timers.nodes = snapshot.timerNodes;
+    world.timers.slots = snapshot.timerSlots;
+    world.timers.freeNode = snapshot.timerFreeNode;
+    world.timers.currentTick = snapshot.timerTick;
+    session.wavePlan = snapshot.wavePlan;
+    session.random = snapshot.random;
+    session.enemySpawnCooldown = snapshot.enemySpawnCooldown;
+    session.score = snapshot.score;
+    session.runStats = snapshot.runStats;
+    session.tick = snapshot.tick;
+    session.gameTime = snapshot.tick * SIM_TICK_SECONDS;
+    session.waveNumber = snapshot.waveNumber;
+    session.enemiesPerWave = snapshot.enemiesPerWave;
+}
+
+// Контрольная сумма состояния (FNV-1a по полям: в структурах есть выравнивание)
+void HashBytes(unsigned long long& hash, const void* data, size_t size) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+    }
+}
+
+template <typename T>
+void HashValue(unsigned long long& hash, const T& value) {
+    HashBytes(hash, &value, sizeof(value));
+}
+
+unsigned long long ComputeWorldChecksum(const World& world, const GameSession& session) {
+    unsigned long long hash = 0xCBF29CE484222325ull;
+    HashValue(hash, session.tick);
+    HashValue(hash, session.random.state);
+    HashValue(hash, session.score);
+    HashValue(hash, session.waveNumber);
+    for (int i = 0; i < world.playerCount; i++) {
+        const Player& player = world.players[i];
+        HashValue(hash, player.position.x);
+        HashValue(hash, player.position.y);
+        HashValue(hash, player.health);
+        HashValue(hash, player.abilityReady);
+    }
+    for (const auto& enemy : world.enemies) {
+        HashValue(hash, enemy.x);
+        HashValue(hash, enemy.y);
+        HashValue(hash, enemy.attackReadyTick);
+        HashValue(hash, enemy.health);
+        HashValue(hash, enemy.archetype);
+        HashValue(hash, enemy.flags);
+    }
+    for (const auto& bullet : world.bullets) {
+        HashValue(hash, bullet.position.x);
+        HashValue(hash, bullet.position.y);
+    }
+    for (const auto& projectile : world.enemyProjectiles) {
+        HashValue(hash, projectile.position.x);
+        HashValue(hash, projectile.position.y);
+    }
+    HashValue(hash, world.upgrades.size());
+    HashValue(hash, world.shockwaves.size());
+    HashValue(hash, world.bombs.size());
+    HashValue(hash, world.freezeAreas.size());
+    HashValue(hash, world.fireballs.size());
+    for (const StatusTable& table : world.statuses.tables) {
+        for (size_t row = 0; row < table.target.size(); row++) {
+            HashValue(hash, table.target[row].slot);
+            HashValue(hash, table.target[row].generation);
+            HashValue(hash, table.expireTick[row]);
+            HashValue(hash, table.damage[row]);
+        }
+    }
+    HashValue(hash, world.shockwaveHits.size());
+    return hash;
+}
+
+// Ввод тика, к которому применяется кольцо истории
+PlayerInput& GetHistoryInput(PlayerInput (&history)[NET_INPUT_HISTORY], unsigned int tick) {
+    return history[tick & (NET_INPUT_HISTORY - 1)];
+}
+
+// Участник сетевой игры: своя копия мира, кольцо ввода всех игроков и кольцо снимков
+struct NetPeer {
+    int index;
+    int playerCount;
+    UdpSocket socket;
+    unsigned short relayPort;
+
+    World world;
+    GameSession session;
+    Joystick joystick;                                       // Автопилот или экранный джойстик
+
+    PlayerInput inputs[MAX_PLAYERS][NET_INPUT_HISTORY];      // Подтвержденный или предсказанный ввод
+    unsigned int confirmedTick[MAX_PLAYERS];                 // Ввод игрока известен по этот тик включительно
+    unsigned int ackedBy[MAX_PLAYERS];                       // Докуда игрок подтвердил наш ввод
+    unsigned int rollbackTick;                               // Первый тик с ошибкой предсказания (0 - нет)
+    unsigned int verifiedTick;                               // Последний тик с окончательной суммой
+    SimSnapshot snapshots[ROLLBACK_WINDOW + 1];              // Состояние перед тиком (tick % размер)
+    unsigned long long checksums[NET_INPUT_HISTORY];
+
+    long long bytesSent;
+    long long packetsSent;
+    long long packetsReceived;
+    int rollbacks;
+    long long resimulatedTicks;
+    long long stalls;
+};
+
+bool StartNetPeer(NetPeer& peer, int index, int playerCount, unsigned short relayPort, const MetaProgression* metas,
+    unsigned int seed) {
+    peer.index = index;
+    peer.playerCount = playerCount;
+    peer.relayPort = relayPort;
+    peer.world.camera = { { 0, 0 }, { WORLD_WIDTH / 2.0f, WORLD_HEIGHT / 2.0f }, 0.0f, 1.0f };
+    peer.world.chunkGrid = CreateChunkGrid();
+    StartGameSession(peer.session, peer.world, metas, playerCount, seed);
+    peer.joystick = CreateJoystick();
+
+    // Первые NET_INPUT_DELAY тиков у всех нулевой ввод
+    for (int player = 0; player < MAX_PLAYERS; player++) {
+        for (int i = 0; i < NET_INPUT_HISTORY; i++) {
+            peer.inputs[player][i] = { 0, 0 };
+        }
+        peer.confirmedTick[player] = NET_INPUT_DELAY;
+        peer.ackedBy[player] = NET_INPUT_DELAY;
+    }
+    peer.rollbackTick = 0;
+    peer.verifiedTick = 0;
+    peer.bytesSent = 0;
+    peer.packetsSent = 0;
+    peer.packetsReceived = 0;
+    peer.rollbacks = 0;
+    peer.resimulatedTicks = 0;
+    peer.stalls = 0;
+    return OpenUdpSocket(peer.socket);
+}
+
+unsigned int GetMinConfirmedTick(const NetPeer& peer) {
+    unsigned int tick = peer.confirmedTick[0];
+    for (int i = 1; i < peer.playerCount; i++) {
+        tick = std::min(tick, peer.confirmedTick[i]);
+    }
+    return tick;
+}
+
+// Докуда наш ввод подтвердили все остальные
+unsigned int GetMinAckedTick(const NetPeer& peer) {
+    unsigned int tick = peer.confirmedTick[peer.index];
+    for (int i = 0; i < peer.playerCount; i++) {
+        if (i != peer.index) tick = std::min(tick, peer.ackedBy[i]);
+    }
+    return tick;
+}
+
+// Прием ввода от ретранслятора: новые тики подтверждаются, расхождение с уже
+// использованным предсказанием ставит откат
+void ReceiveNetInputs(NetPeer& peer) {
+    unsigned char buffer[NET_MAX_PACKET];
+    unsigned short fromPort;
+    int size;
+    while ((size = ReceiveUdp(peer.socket, buffer, sizeof(buffer), fromPort)) >= 0) {
+        NetInputPacket packet;
+        const unsigned char* body;
+        if (!ReadInputPacketHeader(buffer, size, packet, body)) continue;
+        if (packet.player == peer.index || packet.playerCount != peer.playerCount) continue;
+        peer.packetsReceived++;
+
+        int sender = packet.player;
+        peer.ackedBy[sender] = std::max(peer.ackedBy[sender], packet.ack[peer.index]);
+
+        // База дельт - ввод перед первым тиком пакета; без нее пакет не разобрать
+        if (packet.firstTick == 0 || packet.firstTick - 1 > peer.confirmedTick[sender]) continue;
+        PlayerInput base = GetHistoryInput(peer.inputs[sender], packet.firstTick - 1);
+        if (!ReadInputPacketBody(body, buffer + size, base, packet)) continue;
+
+        for (int i = 0; i < packet.count; i++) {
+            unsigned int tick = packet.firstTick + i;
+            if (tick <= peer.confirmedTick[sender]) continue;
+
+            PlayerInput& slot = GetHistoryInput(peer.inputs[sender], tick);
+            if (tick <= peer.session.tick && slot != packet.inputs[i] &&
+                (peer.rollbackTick == 0 || tick < peer.rollbackTick)) {
+                peer.rollbackTick = tick;
+            }
+            slot = packet.inputs[i];
+            peer.confirmedTick[sender] = tick;
+        }
+    }
+}
+
+// Ввод тика: подтвержденный или повтор последнего подтвержденного (записывается в историю,
+// чтобы при подтверждении было с чем сравнить)
+void GatherTickInputs(NetPeer& peer, unsigned int tick, PlayerInput* inputs) {
+    for (int i = 0; i < peer.playerCount; i++) {
+        PlayerInput& slot = GetHistoryInput(peer.inputs[i], tick);
+        if (tick > peer.confirmedTick[i]) {
+            slot = GetHistoryInput(peer.inputs[i], peer.confirmedTick[i]);
+        }
+        inputs[i] = slot;
+    }
+}
+
+void SimulateNetTick(NetPeer& peer, SystemScheduler& schedule, TaskPool& pool, StatsState& stats) {
+    unsigned int tick = peer.session.tick + 1;
+    SaveSnapshot(peer.snapshots[tick % (ROLLBACK_WINDOW + 1)], peer.world, peer.session);
+
+    PlayerInput inputs[MAX_PLAYERS];
+    GatherTickInputs(peer, tick, inputs);
+    StepGameSession(peer.session, peer.world, schedule, pool, inputs, &stats);
+    peer.checksums[tick & (NET_INPUT_HISTORY - 1)] = ComputeWorldChecksum(peer.world, peer.session);
+}
+
+// Откат к снимку перед первым ошибочным тиком и пересчет до текущего тика
+void ResolveRollback(NetPeer& peer, SystemScheduler& schedule, TaskPool& pool, StatsState& stats) {
+    if (peer.rollbackTick == 0) return;
+    unsigned int targetTick = peer.session.tick;
+    RestoreSnapshot(peer.snapshots[peer.rollbackTick % (ROLLBACK_WINDOW + 1)], peer.world, peer.session);
+    peer.rollbacks++;
+    while (peer.session.tick < targetTick) {
+        SimulateNetTick(peer, schedule, pool, stats);
+        peer.resimulatedTicks++;
+    }
+    peer.rollbackTick = 0;
+}
+
+// Свой ввод на тик через задержку и пакет со всем, что еще не подтвердили все пиры
+void SendNetInputs(NetPeer& peer) {
+    NetInputPacket packet;
+    packet.player = peer.index;
+    packet.playerCount = peer.playerCount;
+    packet.firstTick = GetMinAckedTick(peer) + 1;
+    packet.count = (int)std::min<unsigned int>(NET_MAX_INPUTS_PER_PACKET, peer.confirmedTick[peer.index] + 1 - packet.firstTick);
+    for (int i = 0; i < peer.playerCount; i++) {
+        packet.ack[i] = peer.confirmedTick[i];
+    }
+    for (int i = 0; i < packet.count; i++) {
+        packet.inputs[i] = GetHistoryInput(peer.inputs[peer.index], packet.firstTick + i);
+    }
+
+    unsigned char buffer[NET_MAX_PACKET];
+    int size = WriteInputPacket(packet, GetHistoryInput(peer.inputs[peer.index], packet.firstTick - 1), buffer);
+    if (SendUdp(peer.socket, peer.relayPort, buffer, size)) {
+        peer.bytesSent += size;
+        peer.packetsSent++;
+    }
+}
+
+// Один шаг пира: прием, откат, не больше одного нового тика, отправка.
+// Пир стоит, если ушел на ROLLBACK_WINDOW вперед подтвержденного ввода или
+// неподтвержденный свой ввод перестал помещаться в пакет
+void UpdateNetPeer(NetPeer& peer, SystemScheduler& schedule, TaskPool& pool, StatsState& stats, bool autopilot) {
+    ReceiveNetInputs(peer);
+    ResolveRollback(peer, schedule, pool, stats);
+
+    unsigned int nextTick = peer.session.tick + 1;
+    unsigned int inputTick = nextTick + NET_INPUT_DELAY;
+    bool canAdvance = nextTick <= GetMinConfirmedTick(peer) + ROLLBACK_WINDOW &&
+        inputTick <= GetMinAckedTick(peer) + NET_MAX_INPUTS_PER_PACKET;
+    if (canAdvance) {
+        Player& player = peer.world.players[peer.index];
+        if (autopilot) {
+            UpdateAutopilot(peer.joystick, player, peer.world.archetypes, peer.world.enemies,
+                peer.world.enemyProjectiles, peer.world.upgrades);
+        }
+        GetHistoryInput(peer.inputs[peer.index], inputTick) = SamplePlayerInput(peer.joystick, false);
+        peer.confirmedTick[peer.index] = inputTick;
+        SimulateNetTick(peer, schedule, pool, stats);
+    }
+    else {
+        peer.stalls++;
+    }
+
+    SendNetInputs(peer);
+}
+
+// Тики, ввод которых подтвержден всеми и которые уже посчитаны, больше не изменятся
+unsigned int GetFinalTick(const NetPeer& peer) {
+    return std::min(GetMinConfirmedTick(peer), peer.session.tick);
+}
+
+void StopNetPeer(NetPeer& peer) {
+    CloseUdpSocket(peer.socket);
+}
+
+// Ретранслятор в процессе: пакет от пира рассылается всем остальным.
+// Задержка (в шагах) и потери пакетов задаются для проверки отката и повторной отправки
+struct NetRelayPacket {
+    long long deliverStep;
+    unsigned short targetPort;
+    int size;
+    unsigned char data[NET_MAX_PACKET];
+};
+
+struct NetRelay {
+    UdpSocket socket;
+    unsigned short peerPorts[MAX_PLAYERS];   // 0 - пир еще не писал
+    std::vector<NetRelayPacket> queue;
+    long long step;
+    int latencySteps;
+    int lossPercent;
+    SimRandom random;                        // Свой генератор: потери не зависят от игры
+    long long bytesForwarded;
+    long long packetsDropped;
+};
+
+bool StartNetRelay(NetRelay& relay, int latencySteps, int lossPercent, unsigned int seed) {
+    for (int i = 0; i < MAX_PLAYERS; i++) relay.peerPorts[i] = 0;
+    relay.queue.clear();
+    relay.step = 0;
+    relay.latencySteps = latencySteps;
+    relay.lossPercent = lossPercent;
+    relay.random = CreateSimRandom(seed);
+    relay.bytesForwarded = 0;
+    relay.packetsDropped = 0;
+    return OpenUdpSocket(relay.socket);
+}
+
+void UpdateNetRelay(NetRelay& relay) {
+    relay.step++;
+
+    NetRelayPacket packet;
+    unsigned short fromPort;
+    while ((packet.size = ReceiveUdp(relay.socket, packet.data, sizeof(packet.data), fromPort)) >= 0) {
+        if (packet.size < 4 || packet.data[0] != NET_PACKET_INPUT) continue;
+        int sender = packet.data[1];
+        int playerCount = packet.data[2];
+        if (sender >= MAX_PLAYERS || playerCount > MAX_PLAYERS) continue;
+        relay.peerPorts[sender] = fromPort;
+
+        packet.deliverStep = relay.step + relay.latencySteps;
+        for (int i = 0; i < playerCount; i++) {
+            if (i == sender || relay.peerPorts[i] == 0) continue;
+            if (SimRandomValue(relay.random, 0, 99) < relay.lossPercent) {
+                relay.packetsDropped++;
+                continue;
+            }
+            packet.targetPort = relay.peerPorts[i];
+            relay.queue.push_back(packet);
+        }
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < relay.queue.size(); i++) {
+        const NetRelayPacket& queued = relay.queue[i];
+        if (queued.deliverStep <= relay.step) {
+            if (SendUdp(relay.socket, queued.targetPort, queued.data, queued.size)) {
+                relay.bytesForwarded += queued.size;
+            }
+        }
+        else {
+            relay.queue[kept++] = queued;
+        }
+    }
+    relay.queue.resize(kept);
+}
+
+void StopNetRelay(NetRelay& relay) {
+    CloseUdpSocket(relay.socket);
+}
+
+// Авторитетный сервер
+// Сервер считает мир сам и каждый тик шлет каждому клиенту снимок сущностей в его виде.
+// Снимок квантован (позиция - 1/8 пикселя в u16, здоровье - доля в байте) и закодирован
+// дельтой к последнему снимку, который клиент подтвердил. В снимок попадает не больше
+// MAX_SNAPSHOT_ENTITIES ближайших к центру вида сущностей, поэтому размер пакета
+// ограничен при любом числе врагов
+const int SNAPSHOT_HISTORY = 32;                // Кольцо снимков на клиента (степень двойки)
+const int MAX_SNAPSHOT_ENTITIES = 192;
+const float SNAPSHOT_POSITION_SCALE = 8.0f;     // 8000 * 8 помещается в u16
+const float SNAPSHOT_VIEW_MARGIN = 64.0f;       // Запас вокруг вида против появления на краю
+const float SNAPSHOT_MAX_VIEW = 4096.0f;        // Больший вид клиент не получит
+// Заголовок: u8 тип, u8 игрок и шесть u32 (см. WriteSnapshotPacket)
+const int SNAPSHOT_HEADER_SIZE = 2 * sizeof(unsigned char) + 6 * sizeof(unsigned int);
+// На сущность не больше 5 (id) + 1 (маска) + 3 + 3 (позиция) + 1 (здоровье) + 1 (вид) байт, удаление - 5 байт
+const int SNAPSHOT_MAX_ENTITY_SIZE = 5 + 1 + 3 + 3 + 1 + 1;
+const int SNAPSHOT_MAX_REMOVED_SIZE = 5;
+const int NET_MAX_SNAPSHOT = SNAPSHOT_HEADER_SIZE + MAX_SNAPSHOT_ENTITIES * (SNAPSHOT_MAX_ENTITY_SIZE + SNAPSHOT_MAX_REMOVED_SIZE);
+
+enum SnapshotKind : unsigned char {
+    SNAPSHOT_PLAYER,
+    SNAPSHOT_ENEMY,
+    SNAPSHOT_ENEMY_PROJECTILE,
+    SNAPSHOT_BULLET,
+    SNAPSHOT_UPGRADE,
+    SNAPSHOT_KIND_COUNT
+};
+
+// Поля изменившейся сущности
+enum SnapshotField : unsigned char {
+    SNAPSHOT_FIELD_X = 1,
+    SNAPSHOT_FIELD_Y = 2,
+    SNAPSHOT_FIELD_HEALTH = 4,
+    SNAPSHOT_FIELD_KIND = 8,
+    SNAPSHOT_FIELD_NEW = 16     // Нет в базовом снимке: все поля целиком
+};
+
+struct SnapshotEntity {
+    unsigned int id;            // Слот * SNAPSHOT_KIND_COUNT + вид
+    unsigned short x;
+    unsigned short y;
+    unsigned char kind;         // SnapshotKind | подтип << 3
+    unsigned char health;       // Доля от максимума, 0-255
+};
+
+typedef TaggedVector<SnapshotEntity, MEM_SYSTEMS> SnapshotEntities;
+
+struct EntitySnapshot {
+    unsigned int sequence;      // Тик сервера, 0 - пусто
+    int score;
+    int waveNumber;
+    SnapshotEntities entities;  // По возрастанию id
+};
+
+bool SnapshotIdLess(const SnapshotEntity& a, const SnapshotEntity& b) {
+    return a.id < b.id;
+}
+
+unsigned short QuantizeCoord(float value) {
+    float scaled = value * SNAPSHOT_POSITION_SCALE + 0.5f;
+    return (unsigned short)std::max(0.0f, std::min(65535.0f, scaled));
+}
+
+unsigned char QuantizeFraction(int value, int maximum) {
+    if (maximum <= 0 || value <= 0) return 0;
+    return (unsigned char)std::min(255, value * 255 / maximum);
+}
+
+SnapshotEntity MakeSnapshotEntity(unsigned int slot, SnapshotKind kind, unsigned int subtype, Vector2 position, unsigned char health) {
+    SnapshotEntity entity;
+    entity.id = slot * SNAPSHOT_KIND_COUNT + kind;
+    entity.x = QuantizeCoord(position.x);
+    entity.y = QuantizeCoord(position.y);
+    entity.kind = (unsigned char)(kind | (subtype << 3));
+    entity.health = health;
+    return entity;
+}
+
+float GetSnapshotDistance(const SnapshotEntity& entity, Vector2 center) {
+    float dx = entity.x / SNAPSHOT_POSITION_SCALE - center.x;
+    float dy = entity.y / SNAPSHOT_POSITION_SCALE - center.y;
+    return dx * dx + dy * dy;
+}
+
+// Сущности в области вида: враги берутся из чанков, остальные пулы малы и просматриваются целиком.
+// Сетка чанков должна быть построена по текущим врагам
+void CollectSnapshotEntities(const World& world, const Rectangle& view, SnapshotEntities& entities) {
+    entities.clear();
+    Vector2 center = { view.x + view.width / 2, view.y + view.height / 2 };
+
+    for (int i = 0; i < world.playerCount; i++) {
+        const Player& player = world.players[i];
+        entities.push_back(MakeSnapshotEntity(i, SNAPSHOT_PLAYER, 0, player.position,
+            QuantizeFraction(player.health, player.maxHealth)));
+    }
+    size_t playerCount = entities.size();
+
+    const ChunkGrid& grid = world.chunkGrid;
+    int minX = GetChunkCoord(view.x, grid.columns);
+    int minY = GetChunkCoord(view.y, grid.rows);
+    int maxX = GetChunkCoord(view.x + view.width, grid.columns);
+    int maxY = GetChunkCoord(view.y + view.height, grid.rows);
+    for (int chunkY = minY; chunkY <= maxY; chunkY++) {
+        for (int chunkX = minX; chunkX <= maxX; chunkX++) {
+            int chunk = chunkY * grid.columns + chunkX;
+            for (int order = grid.chunkStart[chunk]; order < grid.chunkStart[chunk + 1]; order++) {
+                int index = grid.enemyOrder[order];
+                const Enemy& enemy = world.enemies[index];
+                Vector2 position = GetEnemyPosition(enemy);
+                if (!CheckCollisionPointRec(position, view)) continue;
+                const EnemyArchetype& archetype = GetEnemyArchetype(world.archetypes, enemy);
+                entities.push_back(MakeSnapshotEntity(world.enemies.HandleAt(index).slot, SNAPSHOT_ENEMY, archetype.type, position,
+                    QuantizeFraction(enemy.health, archetype.healthUnits)));
+            }
+        }
+    }
+
+    for (size_t i = 0; i < world.enemyProjectiles.size(); i++) {
+        Vector2 position = world.enemyProjectiles[i].position;
+        if (!CheckCollisionPointRec(position, view)) continue;
+        entities.push_back(MakeSnapshotEntity(world.enemyProjectiles.HandleAt(i).slot, SNAPSHOT_ENEMY_PROJECTILE, 0, position, 0));
+    }
+    for (size_t i = 0; i < world.bullets.size(); i++) {
+        Vector2 position = world.bullets[i].position;
+        if (!CheckCollisionPointRec(position, view)) continue;
+        entities.push_back(MakeSnapshotEntity(world.bullets.HandleAt(i).slot, SNAPSHOT_BULLET, 0, position, 0));
+    }
+    for (size_t i = 0; i < world.upgrades.size(); i++) {
+        Vector2 position = world.upgrades[i].position;
+        if (!CheckCollisionPointRec(position, view)) continue;
+        entities.push_back(MakeSnapshotEntity(world.upgrades.HandleAt(i).slot, SNAPSHOT_UPGRADE, world.upgrades[i].type, position, 0));
+    }
+
+    // Игроки остаются всегда, из остального - ближайшие к центру вида
+    if (entities.size() > (size_t)MAX_SNAPSHOT_ENTITIES) {
+        auto first = entities.begin() + playerCount;
+        std::nth_element(first, entities.begin() + MAX_SNAPSHOT_ENTITIES, entities.end(),
+            [center](const SnapshotEntity& a, const SnapshotEntity& b) {
+                return GetSnapshotDistance(a, center) < GetSnapshotDistance(b, center);
+            });
+        entities.resize(MAX_SNAPSHOT_ENTITIES);
+    }
+    std::sort(entities.begin(), entities.end(), SnapshotIdLess);
+}
+
+// Целые переменной длины (по 7 бит) и зигзаг для знаковых дельт
+void WriteVarint(unsigned char*& cursor, unsigned int value) {
+    while (value >= 0x80) {
+        *cursor++ = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    *cursor++ = (unsigned char)value;
+}
+
+bool ReadVarint(const unsigned char*& cursor, const unsigned char* end, unsigned int& value) {
+    value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (cursor >= end) return false;
+        unsigned int byte = *cursor++;
+        value |= (byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+unsigned int ZigZag(int value) {
+    return ((unsigned int)value << 1) ^ (unsigned int)(value >> 31);
+}
+
+int UnZigZag(unsigned int value) {
+    return (int)(value >> 1) ^ -(int)(value & 1);
+}
+
+void WriteSnapshotEntity(unsigned char*& cursor, const SnapshotEntity& entity, const SnapshotEntity* base) {
+    unsigned int mask = SNAPSHOT_FIELD_NEW;
+    if (base) {
+        mask = 0;
+        if (entity.x != base->x) mask |= SNAPSHOT_FIELD_X;
+        if (entity.y != base->y) mask |= SNAPSHOT_FIELD_Y;
+        if (entity.health != base->health) mask |= SNAPSHOT_FIELD_HEALTH;
+        if (entity.kind != base->kind) mask |= SNAPSHOT_FIELD_KIND;
+    }
+    WriteU8(cursor, mask);
+
+    if (mask & SNAPSHOT_FIELD_NEW) {
+        WriteVarint(cursor, entity.x);
+        WriteVarint(cursor, entity.y);
+        WriteU8(cursor, entity.health);
+        WriteU8(cursor, entity.kind);
+        return;
+    }
+    if (mask & SNAPSHOT_FIELD_X) WriteVarint(cursor, ZigZag((int)entity.x - (int)base->x));
+    if (mask & SNAPSHOT_FIELD_Y) WriteVarint(cursor, ZigZag((int)entity.y - (int)base->y));
+    if (mask & SNAPSHOT_FIELD_HEALTH) WriteU8(cursor, entity.health);
+    if (mask & SNAPSHOT_FIELD_KIND) WriteU8(cursor, entity.kind);
+}
+
+bool ReadSnapshotEntity(const unsigned char*& cursor, const unsigned char* end, SnapshotEntity& entity, const SnapshotEntity* base) {
+    if (cursor >= end) return false;
+    unsigned int mask = ReadU8(cursor);
+    unsigned int value;
+
+    if (mask & SNAPSHOT_FIELD_NEW) {
+        if (!ReadVarint(cursor, end, value)) return false;
+        entity.x = (unsigned short)value;
+        if (!ReadVarint(cursor, end, value)) return false;
+        entity.y = (unsigned short)value;
+        if (end - cursor < 2) return false;
+        entity.health = (unsigned char)ReadU8(cursor);
+        entity.kind = (unsigned char)ReadU8(cursor);
+        return true;
+    }
+    if (!base) return false;
+
+    entity.x = base->x;
+    entity.y = base->y;
+    entity.health = base->health;
+    entity.kind = base->kind;
+    if (mask & SNAPSHOT_FIELD_X) {
+        if (!ReadVarint(cursor, end, value)) return false;
+        entity.x = (unsigned short)(base->x + UnZigZag(value));
+    }
+    if (mask & SNAPSHOT_FIELD_Y) {
+        if (!ReadVarint(cursor, end, value)) return false;
+        entity.y = (unsigned short)(base->y + UnZigZag(value));
+    }
+    if (mask & SNAPSHOT_FIELD_HEALTH) {
+        if (cursor >= end) return false;
+        entity.health = (unsigned char)ReadU8(cursor);
+    }
+    if (mask & SNAPSHOT_FIELD_KIND) {
+        if (cursor >= end) return false;
+        entity.kind = (unsigned char)ReadU8(cursor);
+    }
+    return true;
+}
 
-        if (!joystick.isActive && distance < joystick.outerRadius * 1.5f) {
-            joystick.isActive = true;
+// Пакет снимка:
+//   u8 тип, u8 игрок клиента, u32 номер, u32 номер базового снимка (0 - без базы),
+//   u32 счет, u32 волна, u32 число удаленных, u32 число изменившихся,
+//   удаленные id (разности по возрастанию), изменившиеся (разность id, маска, поля).
+// Не изменившиеся с базы сущности не передаются вовсе
+int WriteSnapshotPacket(const EntitySnapshot& snapshot, const EntitySnapshot* baseline, int player, unsigned char* buffer,
+    TaggedVector<unsigned int, MEM_SYSTEMS>& removed) {
+    static const SnapshotEntities noEntities;
+    const SnapshotEntities& base = baseline ? baseline->entities : noEntities;
+    const SnapshotEntities& current = snapshot.entities;
+    // Размер буфера NET_MAX_SNAPSHOT рассчитан на это число сущностей в снимке и базе
+    assert(current.size() <= (size_t)MAX_SNAPSHOT_ENTITIES && base.size() <= (size_t)MAX_SNAPSHOT_ENTITIES);
+
+    removed.clear();
+    int changedCount = 0;
+    for (size_t b = 0, c = 0; b < base.size() || c < current.size();) {
+        if (c == current.size() || (b < base.size() && base[b].id < current[c].id)) {
+            removed.push_back(base[b++].id);
+        }
+        else if (b == base.size() || current[c].id < base[b].id) {
+            changedCount++;
+            c++;
+        }
+        else {
+            const SnapshotEntity& a = base[b++];
+            const SnapshotEntity& e = current[c++];
+            if (a.x != e.x || a.y != e.y || a.health != e.health || a.kind != e.kind) changedCount++;
         }
+    }
 
-        if (joystick.isActive) {
-            Vector2 direction = { touchPos.x - joystick.position.x, touchPos.y - joystick.position.y };
-            float dist = Vector2Length(direction);
+    unsigned char* cursor = buffer;
+    WriteU8(cursor, NET_PACKET_SNAPSHOT);
+    WriteU8(cursor, player);
+    WriteU32(cursor, snapshot.sequence);
+    WriteU32(cursor, baseline ? baseline->sequence : 0);
+    WriteU32(cursor, (unsigned int)snapshot.score);
+    WriteU32(cursor, (unsigned int)snapshot.waveNumber);
+    WriteU32(cursor, (unsigned int)removed.size());
+    WriteU32(cursor, (unsigned int)changedCount);
+    assert(cursor - buffer == SNAPSHOT_HEADER_SIZE);
+
+    unsigned int previousId = 0;
+    for (unsigned int id : removed) {
+        WriteVarint(cursor, id - previousId);
+        previousId = id;
+    }
 
-            float maxDistance = joystick.outerRadius - joystick.innerRadius * 0.3f;
-            if (dist > maxDistance) {
-                float scale = maxDistance / dist;
-                direction = Vector2Scale(direction, scale);
-            }
+    previousId = 0;
+    size_t b = 0;
+    for (const SnapshotEntity& entity : current) {
+        while (b < base.size() && base[b].id < entity.id) b++;
+        const SnapshotEntity* match = b < base.size() && base[b].id == entity.id ? &base[b] : nullptr;
+        if (match && match->x == entity.x && match->y == entity.y && match->health == entity.health && match->kind == entity.kind) {
+            continue;
+        }
+        WriteVarint(cursor, entity.id - previousId);
+        previousId = entity.id;
+        WriteSnapshotEntity(cursor, entity, match);
+    }
+    assert(cursor - buffer <= NET_MAX_SNAPSHOT);
+    return (int)(cursor - buffer);
+}
 
-            joystick.touchPosition = Vector2Add(joystick.position, direction);
+// Клиент синтетический: своих решений не принимает, только собирает снимки и шлет ввод
+struct SnapshotClient {
+    UdpSocket socket;
+    unsigned short serverPort;
+    int player;
+    PlayerInput input;
+    float viewWidth;
+    float viewHeight;
+    EntitySnapshot received[SNAPSHOT_HISTORY];
+    unsigned int latestSequence;
+    TaggedVector<unsigned int, MEM_SYSTEMS> removed;   // Рабочий буфер разбора
+
+    long long bytesReceived;
+    long long packetsReceived;
+    long long fullSnapshots;                           // Пришли без базы
+    long long decodeErrors;
+};
 
-            if (dist > 5.0f) {
-                joystick.direction = Vector2Normalize(direction);
+// Разбор снимка поверх базы из кольца клиента
+bool ReadSnapshotPacket(SnapshotClient& client, const unsigned char* buffer, int size) {
+    const unsigned char* cursor = buffer;
+    const unsigned char* end = buffer + size;
+    if (size < SNAPSHOT_HEADER_SIZE || ReadU8(cursor) != NET_PACKET_SNAPSHOT) return false;
+    int player = (int)ReadU8(cursor);
+    unsigned int sequence = ReadU32(cursor);
+    unsigned int baseSequence = ReadU32(cursor);
+    int score = (int)ReadU32(cursor);
+    int waveNumber = (int)ReadU32(cursor);
+    unsigned int removedCount = ReadU32(cursor);
+    unsigned int changedCount = ReadU32(cursor);
+    if (sequence == 0 || sequence <= client.latestSequence) return true;   // Устаревший пакет не ошибка
+
+    const EntitySnapshot* baseline = nullptr;
+    if (baseSequence != 0) {
+        baseline = &client.received[baseSequence & (SNAPSHOT_HISTORY - 1)];
+        if (baseline->sequence != baseSequence) return false;
+    }
+    if (removedCount > (unsigned int)size || changedCount > (unsigned int)size) return false;
+
+    client.removed.clear();
+    unsigned int id = 0;
+    for (unsigned int i = 0; i < removedCount; i++) {
+        unsigned int gap;
+        if (!ReadVarint(cursor, end, gap)) return false;
+        id += gap;
+        client.removed.push_back(id);
+    }
+
+    // База уже подтверждена, поэтому в кольце она не совпадает со слотом нового снимка
+    EntitySnapshot& snapshot = client.received[sequence & (SNAPSHOT_HISTORY - 1)];
+    if (baseline == &snapshot) return false;
+    snapshot.sequence = 0;
+    snapshot.entities.clear();
+
+    static const SnapshotEntities noEntities;
+    const SnapshotEntities& base = baseline ? baseline->entities : noEntities;
+    size_t b = 0;
+    size_t r = 0;
+    unsigned int changedId = 0;
+    unsigned int changedLeft = changedCount;
+    bool haveChanged = false;
+    for (;;) {
+        if (!haveChanged && changedLeft > 0) {
+            unsigned int gap;
+            if (!ReadVarint(cursor, end, gap)) return false;
+            changedId += gap;
+            changedLeft--;
+            haveChanged = true;
+        }
+        if (b == base.size() && !haveChanged) break;
+
+        if (b < base.size() && (!haveChanged || base[b].id < changedId)) {
+            if (r < client.removed.size() && client.removed[r] == base[b].id) {
+                r++;
             }
             else {
-                joystick.direction = { 0, 0 };
+                snapshot.entities.push_back(base[b]);
             }
+            b++;
+            continue;
         }
+
+        const SnapshotEntity* match = b < base.size() && base[b].id == changedId ? &base[b] : nullptr;
+        SnapshotEntity entity;
+        entity.id = changedId;
+        if (!ReadSnapshotEntity(cursor, end, entity, match)) return false;
+        snapshot.entities.push_back(entity);
+        if (match) b++;
+        haveChanged = false;
     }
-    else {
-        joystick.isActive = false;
-        joystick.touchPosition = joystick.position;
-        joystick.direction = { 0, 0 };
+    if (r != client.removed.size()) return false;
+
+    snapshot.sequence = sequence;
+    snapshot.score = score;
+    snapshot.waveNumber = waveNumber;
+    client.latestSequence = sequence;
+    client.player = player;
+    if (!baseline) client.fullSnapshots++;
+    return true;
+}
+
+bool StartSnapshotClient(SnapshotClient& client, unsigned short serverPort, float viewWidth, float viewHeight) {
+    client.serverPort = serverPort;
+    client.player = -1;
+    client.input = { 0, 0 };
+    client.viewWidth = viewWidth;
+    client.viewHeight = viewHeight;
+    for (int i = 0; i < SNAPSHOT_HISTORY; i++) {
+        client.received[i].sequence = 0;
+        client.received[i].entities.clear();
     }
+    client.latestSequence = 0;
+    client.bytesReceived = 0;
+    client.packetsReceived = 0;
+    client.fullSnapshots = 0;
+    client.decodeErrors = 0;
+    return OpenUdpSocket(client.socket);
 }
 
-void DrawJoystick(const Joystick& joystick) {
-    DrawCircleV(joystick.position, joystick.outerRadius, COLOR_JOYSTICK_BG);
-    DrawCircleV(joystick.touchPosition, joystick.innerRadius, COLOR_JOYSTICK);
+// Прием снимков. lossPercent имитирует потери: пакет отбрасывается до разбора
+void ReceiveSnapshots(SnapshotClient& client, SimRandom& random, int lossPercent) {
+    unsigned char buffer[NET_MAX_SNAPSHOT];
+    unsigned short fromPort;
+    int size;
+    while ((size = ReceiveUdp(client.socket, buffer, sizeof(buffer), fromPort)) >= 0) {
+        if (fromPort != client.serverPort) continue;
+        if (SimRandomValue(random, 0, 99) < lossPercent) continue;
+        client.bytesReceived += size;
+        client.packetsReceived++;
+        if (!ReadSnapshotPacket(client, buffer, size)) client.decodeErrors++;
+    }
 }
 
-// Функции для игрока
-Player CreatePlayer(const MetaProgression& meta) {
-    Player player;
+// Пакет клиента: u8 тип, u32 последний принятый снимок, i8 moveX, i8 moveY, u16 ширина и высота вида
+void SendClientInput(SnapshotClient& client) {
+    unsigned char buffer[16];
+    unsigned char* cursor = buffer;
+    WriteU8(cursor, NET_PACKET_CLIENT_INPUT);
+    WriteU32(cursor, client.latestSequence);
+    WriteU8(cursor, (unsigned char)client.input.moveX);
+    WriteU8(cursor, (unsigned char)client.input.moveY);
+    WriteU8(cursor, (unsigned int)client.viewWidth & 0xFF);
+    WriteU8(cursor, (unsigned int)client.viewWidth >> 8);
+    WriteU8(cursor, (unsigned int)client.viewHeight & 0xFF);
+    WriteU8(cursor, (unsigned int)client.viewHeight >> 8);
+    SendUdp(client.socket, client.serverPort, buffer, (int)(cursor - buffer));
+}
 
-    int screenWidth = GetScreenWidth();
-    int screenHeight = GetScreenHeight();
+void StopSnapshotClient(SnapshotClient& client) {
+    CloseUdpSocket(client.socket);
+}
 
-    player.position = { screenWidth / 2.0f, screenHeight / 2.0f };
-    player.radius = 15.0f * SIZE_MULTIPLIER;
+// Клиент на стороне сервера: последний ввод, вид и отправленные снимки (базы для дельт)
+struct ServerClient {
+    unsigned short port;
+    PlayerInput input;
+    float viewWidth;
+    float viewHeight;
+    unsigned int ackSequence;
+    EntitySnapshot sent[SNAPSHOT_HISTORY];
+    long long bytesSent;
+    int maxPacket;
+};
 
-    float baseSpeed = 5.0f;
-    int baseHealth = 100;
-    int baseDamage = 20;
-    float baseAttackSpeed = 1.0f;
+struct SnapshotServer {
+    UdpSocket socket;
+    World world;
+    GameSession session;
+    ServerClient clients[MAX_PLAYERS];
+    int clientCount;
+    int maxClients;
+    TaggedVector<unsigned int, MEM_SYSTEMS> removed;   // Рабочий буфер кодирования
+};
 
-    player.speed = std::max(1.0f, baseSpeed * meta.GetSpeedBonus());
-    player.maxHealth = std::max(50, (int)(baseHealth * meta.GetHealthBonus()));
-    player.health = player.maxHealth;
-    player.damage = std::max(5, (int)(baseDamage * meta.GetDamageBonus()));
-    player.attackSpeed = std::max(0.1f, baseAttackSpeed * meta.GetAttackSpeedBonus());
-    player.projectileCount = meta.GetProjectileCount();
+bool StartSnapshotServer(SnapshotServer& server, int maxClients, const MetaProgression* metas, unsigned int seed) {
+    server.maxClients = maxClients;
+    server.clientCount = 0;
+    server.world.camera = { { 0, 0 }, { WORLD_WIDTH / 2.0f, WORLD_HEIGHT / 2.0f }, 0.0f, 1.0f };
+    server.world.chunkGrid = CreateChunkGrid();
+    StartGameSession(server.session, server.world, metas, maxClients, seed);
+    return OpenUdpSocket(server.socket);
+}
 
-    player.lastShotTime = -1.0;
+// Прием ввода. Новый порт занимает свободного игрока
+void ReceiveClientInputs(SnapshotServer& server) {
+    unsigned char buffer[64];
+    unsigned short fromPort;
+    int size;
+    while ((size = ReceiveUdp(server.socket, buffer, sizeof(buffer), fromPort)) >= 0) {
+        const unsigned char* cursor = buffer;
+        if (size < 11 || ReadU8(cursor) != NET_PACKET_CLIENT_INPUT) continue;
+
+        int index = 0;
+        while (index < server.clientCount && server.clients[index].port != fromPort) index++;
+        if (index == server.clientCount) {
+            if (server.clientCount == server.maxClients) continue;
+            ServerClient& joined = server.clients[server.clientCount++];
+            joined.port = fromPort;
+            joined.ackSequence = 0;
+            for (int i = 0; i < SNAPSHOT_HISTORY; i++) {
+                joined.sent[i].sequence = 0;
+            }
+            joined.bytesSent = 0;
+            joined.maxPacket = 0;
+        }
 
-    player.hasWaveAttack = meta.hasWaveAbility;
-    player.waveCooldown = 45.0;
-    player.lastWaveTime = -45.0;
-    player.waveDamage = 50;
+        ServerClient& client = server.clients[index];
+        unsigned int ack = ReadU32(cursor);
+        client.ackSequence = std::max(client.ackSequence, ack);
+        client.input.moveX = (signed char)ReadU8(cursor);
+        client.input.moveY = (signed char)ReadU8(cursor);
+        unsigned int width = ReadU8(cursor);
+        width |= ReadU8(cursor) << 8;
+        unsigned int height = ReadU8(cursor);
+        height |= ReadU8(cursor) << 8;
+        client.viewWidth = std::min(SNAPSHOT_MAX_VIEW, (float)width);
+        client.viewHeight = std::min(SNAPSHOT_MAX_VIEW, (float)height);
+    }
+}
 
-    player.hasDoubleShot = false;
+// Снимок каждому клиенту: дельта к подтвержденному снимку, если он еще в кольце
+void SendSnapshots(SnapshotServer& server) {
+    World& world = server.world;
+    BuildChunkGrid(world.chunkGrid, world.enemies);   // Системы тика могли удалить врагов
+
+    unsigned char buffer[NET_MAX_SNAPSHOT];
+    for (int i = 0; i < server.clientCount; i++) {
+        ServerClient& client = server.clients[i];
+        Vector2 position = world.players[i].position;
+        Rectangle view = ExpandRect({ position.x - client.viewWidth / 2, position.y - client.viewHeight / 2,
+            client.viewWidth, client.viewHeight }, SNAPSHOT_VIEW_MARGIN);
+
+        EntitySnapshot& snapshot = client.sent[server.session.tick & (SNAPSHOT_HISTORY - 1)];
+        snapshot.sequence = server.session.tick;
+        snapshot.score = server.session.score;
+        snapshot.waveNumber = server.session.waveNumber;
+        CollectSnapshotEntities(world, view, snapshot.entities);
+
+        const EntitySnapshot* baseline = nullptr;
+        if (client.ackSequence != 0 && client.ackSequence != snapshot.sequence) {
+            const EntitySnapshot& acked = client.sent[client.ackSequence & (SNAPSHOT_HISTORY - 1)];
+            if (acked.sequence == client.ackSequence) baseline = &acked;
+        }
+
+        int size = WriteSnapshotPacket(snapshot, baseline, i, buffer, server.removed);
+        if (SendUdp(server.socket, client.port, buffer, size)) {
+            client.bytesSent += size;
+            client.maxPacket = std::max(client.maxPacket, size);
+        }
+    }
+}
 
-    player.hasBombAttack = meta.hasBombAbility;
-    player.bombCooldown = 15.0;
-    player.lastBombTime = -15.0;
-    player.bombDamage = 40;
-    player.bombRadius = 80.0f * SIZE_MULTIPLIER;
-
-    player.hasFreezeAttack = meta.hasFreezeAbility;
-    player.freezeCooldown = 25.0;
-    player.lastFreezeTime = -25.0;
-    player.freezeDuration = 3.0f;
-    player.freezeRadius = 100.0f * SIZE_MULTIPLIER;
-
-    player.hasFireballAttack = false;
-    player.fireballCooldown = 8.0;
-    player.lastFireballTime = -8.0;
-    player.fireballDamage = 30 + player.damage / 2;
-    player.fireballExplosionRadius = 60.0f * SIZE_MULTIPLIER;
-    player.fireballSpeed = 8.0f;
+// Тик сервера: ввод клиентов, шаг забега, снимки
+void UpdateSnapshotServer(SnapshotServer& server, SystemScheduler& schedule, TaskPool& pool, StatsState& stats) {
+    ReceiveClientInputs(server);
 
-    return player;
+    PlayerInput inputs[MAX_PLAYERS];
+    for (int i = 0; i < server.maxClients; i++) {
+        inputs[i] = i < server.clientCount ? server.clients[i].input : PlayerInput{ 0, 0 };
+    }
+    StepGameSession(server.session, server.world, schedule, pool, inputs, &stats);
+    SendSnapshots(server);
 }
 
-void UpdatePlayer(Player& player, const Joystick& joystick, double currentTime, std::vector<Bullet>& bullets, std::vector<Enemy>& enemies, std::vector<Shockwave>& shockwaves, std::vector<Bomb>& bombs, std::vector<FreezeArea>& freezeAreas, std::vector<Fireball>& fireballs) {
-    Vector2 movement = { 0, 0 };
+void StopSnapshotServer(SnapshotServer& server) {
+    CloseUdpSocket(server.socket);
+}
 
-    int screenWidth = GetScreenWidth();
-    int screenHeight = GetScreenHeight();
+// Функции для меню улучшений (расширенное с бесконечной прокачкой)
+// Статичная часть меню (заголовки, кнопки без наведения, бонусы) рисуется один раз
+// в текстуру; каждый кадр поверх нее дорисовывается только кнопка под курсором
+const int UPGRADE_MENU_BUTTON_COUNT = 10;
+const int UPGRADE_MENU_LABEL_SIZE = 64;
+
+// Вид кнопки меню улучшений
+enum UpgradeButtonStyle {
+    BUTTON_STYLE_ACTIVE,     // Можно купить (подсвечивается при наведении)
+    BUTTON_STYLE_LOCKED,     // Не хватает очков
+    BUTTON_STYLE_PURCHASED   // Премиум способность уже куплена
+};
 
-    if (IsKeyDown(KEY_A) && player.position.x - player.speed > 0) movement.x -= 1;
-    if (IsKeyDown(KEY_D) && player.position.x + player.speed < screenWidth) movement.x += 1;
-    if (IsKeyDown(KEY_W) && player.position.y - player.speed > 0) movement.y -= 1;
-    if (IsKeyDown(KEY_S) && player.position.y + player.speed < screenHeight) movement.y += 1;
+struct UpgradeMenuCache {
+    RenderTexture2D staticLayer;
+    bool hasTexture;
+    bool valid;                     // Статичный слой актуален
+    int width;
+    int height;
+    TaggedVector<char, MEM_UI> labels;  // UPGRADE_MENU_LABEL_SIZE на кнопку
+    UpgradeButtonStyle styles[UPGRADE_MENU_BUTTON_COUNT];
+    long long staticRedraws;        // Сколько раз перерисовывался статичный слой
+};
 
-    if (joystick.isActive) {
-        movement.x += joystick.direction.x;
-        movement.y += joystick.direction.y;
-    }
+UpgradeMenuCache CreateUpgradeMenuCache() {
+    UpgradeMenuCache cache;
+    cache.staticLayer = RenderTexture2D{};
+    cache.hasTexture = false;
+    cache.valid = false;
+    cache.width = 0;
+    cache.height = 0;
+    cache.labels.assign(UPGRADE_MENU_BUTTON_COUNT * UPGRADE_MENU_LABEL_SIZE, '\0');
+    memset(cache.styles, 0, sizeof(cache.styles));
+    cache.staticRedraws = 0;
+    return cache;
+}
 
-    if (movement.x != 0 || movement.y != 0) {
-        float length = sqrtf(movement.x * movement.x + movement.y * movement.y);
-        movement.x /= length;
-        movement.y /= length;
+// Вызывается при покупке, сбросе прогресса и начислении очков
+void InvalidateUpgradeMenu(UpgradeMenuCache& cache) {
+    cache.valid = false;
+}
 
-        player.position.x += movement.x * player.speed;
-        player.position.y += movement.y * player.speed;
+void UnloadUpgradeMenuCache(UpgradeMenuCache& cache) {
+    if (cache.hasTexture) {
+        UnloadRenderTexture(cache.staticLayer);
+        cache.hasTexture = false;
+    }
+    cache.valid = false;
+}
 
-        player.position.x = std::max(player.radius, std::min(screenWidth - player.radius, player.position.x));
-        player.position.y = std::max(player.radius, std::min(screenHeight - player.radius, player.position.y));
+// Раскладка кнопок и подписей (нужна и для отрисовки, и для проверки нажатий)
+void LayoutUpgradeButton(UpgradeMenuCache& cache, int index, Button& button, float y, const char* label, UpgradeButtonStyle style) {
+    int screenWidth = GetScreenWidth();
+    button.bounds = { static_cast<float>(screenWidth) / 2 - 150, y, 300, 40 };
+    char* text = &cache.labels[index * UPGRADE_MENU_LABEL_SIZE];
+    strncpy(text, label, UPGRADE_MENU_LABEL_SIZE - 1);
+    text[UPGRADE_MENU_LABEL_SIZE - 1] = '\0';
+    button.text = text;
+    cache.styles[index] = style;
+}
+
+void LayoutUpgradeMenu(const MetaProgression& meta, Button* buttons[UPGRADE_MENU_BUTTON_COUNT], UpgradeMenuCache& cache) {
+    int screenWidth = GetScreenWidth();
+    float yPos = 160;
+
+    // Бесконечные улучшения
+    const char* names[5] = { "Health", "Damage", "Speed", "Attack Speed", "Projectiles" };
+    int levels[5] = { meta.healthLevel, meta.damageLevel, meta.speedLevel, meta.attackSpeedLevel, meta.projectileCountLevel };
+    int costs[5] = { meta.GetHealthCost(), meta.GetDamageCost(), meta.GetSpeedCost(), meta.GetAttackSpeedCost(), meta.GetProjectileCountCost() };
+
+    for (int i = 0; i < 5; i++) {
+        bool affordable = meta.availablePoints >= costs[i];
+        const char* label = TextFormat("%s (Level %d) - %s: %d", names[i], levels[i], affordable ? "Cost" : "Need", costs[i]);
+        LayoutUpgradeButton(cache, i, *buttons[i], yPos, label, affordable ? BUTTON_STYLE_ACTIVE : BUTTON_STYLE_LOCKED);
+        yPos += 50;
     }
+    yPos += 10 + 35;
 
-    // Автоматическая стрельба по ближайшему врагу
-    if (currentTime - player.lastShotTime > 1.0 / player.attackSpeed) {
-        float min_distance = FLT_MAX;
-        Enemy* nearest_enemy = nullptr;
-        for (auto& enemy : enemies) {
-            float distance = Vector2Distance(player.position, enemy.position);
-            if (distance < min_distance) {
-                min_distance = distance;
-                nearest_enemy = &enemy;
-            }
+    // Премиум способности (покупаются один раз)
+    const char* premiumNames[3] = { "Bomb Ability", "Freeze Ability", "Wave Ability" };
+    bool owned[3] = { meta.hasBombAbility, meta.hasFreezeAbility, meta.hasWaveAbility };
+    int premiumCosts[3] = { meta.GetBombAbilityCost(), meta.GetFreezeAbilityCost(), meta.GetWaveAbilityCost() };
+
+    for (int i = 0; i < 3; i++) {
+        if (owned[i]) {
+            LayoutUpgradeButton(cache, 5 + i, *buttons[5 + i], yPos, TextFormat("%s - PURCHASED", premiumNames[i]), BUTTON_STYLE_PURCHASED);
         }
+        else {
+            bool affordable = meta.availablePoints >= premiumCosts[i];
+            const char* label = TextFormat("%s - %s: %d", premiumNames[i], affordable ? "Cost" : "Need", premiumCosts[i]);
+            LayoutUpgradeButton(cache, 5 + i, *buttons[5 + i], yPos, label, affordable ? BUTTON_STYLE_ACTIVE : BUTTON_STYLE_LOCKED);
+        }
+        yPos += 50;
+    }
+    yPos += 20;
 
-        if (nearest_enemy != nullptr) {
-            Vector2 direction = Vector2Subtract(nearest_enemy->position, player.position);
-            float length = Vector2Length(direction);
+    // Кнопка сброса прогресса
+    LayoutUpgradeButton(cache, 8, *buttons[8], yPos, "Reset Progress (Get 50% points back)", BUTTON_STYLE_ACTIVE);
+    yPos += 60;
 
-            if (length > 0) {
-                direction.x /= length;
-                direction.y /= length;
+    // Кнопка назад
+    LayoutUpgradeButton(cache, 9, *buttons[9], yPos, "Back to Menu", BUTTON_STYLE_ACTIVE);
+    buttons[9]->bounds = { static_cast<float>(screenWidth) / 2 - 100, yPos, 200, 50 };
+}
 
-                // Создаем снаряды в зависимости от их количества
-                for (int i = 0; i < player.projectileCount; i++) {
-                    Bullet bullet;
-                    bullet.position = player.position;
+void DrawUpgradeMenuButton(const Button& button, UpgradeButtonStyle style) {
+    if (style == BUTTON_STYLE_ACTIVE) {
+        Button copy = button;
+        DrawButton(copy);
+        return;
+    }
 
-                    if (player.projectileCount == 1) {
-                        // Один снаряд - летит прямо
-                        bullet.velocity.x = direction.x * 10.0f;
-                        bullet.velocity.y = direction.y * 10.0f;
-                    }
-                    else {
-                        // Несколько снарядов - распределяем веером
-                        float angleOffset = (i - (player.projectileCount - 1) / 2.0f) * 0.2f;
-                        Vector2 rotatedDirection = {
-                            direction.x * cosf(angleOffset) - direction.y * sinf(angleOffset),
-                            direction.x * sinf(angleOffset) + direction.y * cosf(angleOffset)
-                        };
-                        bullet.velocity.x = rotatedDirection.x * 10.0f;
-                        bullet.velocity.y = rotatedDirection.y * 10.0f;
-                    }
+    DrawRectangleRec(button.bounds, COLOR_UPGRADE_BUTTON_MAXED);
+    DrawRectangleLinesEx(button.bounds, 2, WHITE);
+    DrawText(button.text, button.bounds.x + (button.bounds.width - MeasureText(button.text, 18)) / 2,
+        button.bounds.y + (button.bounds.height - 18) / 2, 18, style == BUTTON_STYLE_PURCHASED ? GREEN : GRAY);
+}
 
-                    bullet.radius = 5.0f * SIZE_MULTIPLIER;
-                    bullet.damage = player.damage;
-                    bullets.push_back(bullet);
-                }
+// Статичный слой: все, кроме подсветки наведения
+void DrawUpgradeMenuStatic(const MetaProgression& meta, Button* buttons[UPGRADE_MENU_BUTTON_COUNT], UpgradeMenuCache& cache) {
+    int screenWidth = cache.width;
+    int screenHeight = cache.height;
 
-                // Дополнительный выстрел при улучшении
-                if (player.hasDoubleShot) {
-                    Bullet secondBullet;
-                    secondBullet.position = player.position;
+    BeginTextureMode(cache.staticLayer);
+    ClearBackground(BLACK);
 
-                    Vector2 perpendicular = { -direction.y, direction.x };
-                    secondBullet.velocity.x = direction.x * 8.0f + perpendicular.x * 3.0f;
-                    secondBullet.velocity.y = direction.y * 8.0f + perpendicular.y * 3.0f;
+    DrawText("UPGRADES", screenWidth / 2 - MeasureText("UPGRADES", 40) / 2, 30, 40, WHITE);
+    DrawText(TextFormat("Available Points: %d", meta.availablePoints), screenWidth / 2 - MeasureText(TextFormat("Available Points: %d", meta.availablePoints), 25) / 2, 90, 25, YELLOW);
+    DrawText(TextFormat("Total Points: %d", meta.totalPoints), screenWidth / 2 - MeasureText(TextFormat("Total Points: %d", meta.totalPoints), 20) / 2, 120, 20, LIGHTGRAY);
 
-                    float velLength = Vector2Length(secondBullet.velocity);
-                    secondBullet.velocity.x = secondBullet.velocity.x / velLength * 10.0f;
-                    secondBullet.velocity.y = secondBullet.velocity.y / velLength * 10.0f;
+    for (int i = 0; i < UPGRADE_MENU_BUTTON_COUNT; i++) {
+        Button button = *buttons[i];
+        button.hovered = false;
+        DrawUpgradeMenuButton(button, cache.styles[i]);
+    }
 
-                    secondBullet.radius = 5.0f * SIZE_MULTIPLIER;
-                    secondBullet.damage = player.damage;
-                    bullets.push_back(secondBullet);
-                }
+    DrawText("Premium Abilities:", 50, (int)buttons[5]->bounds.y - 35, 22, GOLD);
 
-                player.lastShotTime = currentTime;
-            }
-        }
-    }
+    // Отображение текущих бонусов
+    DrawText(TextFormat("Current Bonuses:"), 50, screenHeight - 150, 20, WHITE);
+    DrawText(TextFormat("Health: +%.0f%%", (meta.GetHealthBonus() - 1.0f) * 100), 70, screenHeight - 120, 18, GREEN);
+    DrawText(TextFormat("Damage: +%.0f%%", (meta.GetDamageBonus() - 1.0f) * 100), 70, screenHeight - 95, 18, ORANGE);
+    DrawText(TextFormat("Speed: +%.0f%%", (meta.GetSpeedBonus() - 1.0f) * 100), 70, screenHeight - 70, 18, WHITE);
+    DrawText(TextFormat("Attack Speed: +%.0f%%", (meta.GetAttackSpeedBonus() - 1.0f) * 100), 70, screenHeight - 45, 18, SKYBLUE);
+    DrawText(TextFormat("Projectile Count: %d", meta.GetProjectileCount()), 70, screenHeight - 20, 18, GOLD);
 
-    // Активация волновой атаки
-    if (player.hasWaveAttack && currentTime - player.lastWaveTime > player.waveCooldown) {
-        if (!enemies.empty()) {
-            Shockwave shockwave;
-            shockwave.position = player.position;
-            shockwave.radius = 10.0f * SIZE_MULTIPLIER;
+    EndTextureMode();
+    cache.staticRedraws++;
+}
 
-            Vector2 averagePosition = { 0, 0 };
-            int enemyCount = 0;
+void DrawUpgradeMenu(MetaProgression& meta, Button& healthButton, Button& damageButton, Button& speedButton,
+    Button& attackSpeedButton, Button& projectileCountButton, Button& bombAbilityButton,
+    Button& freezeAbilityButton, Button& waveAbilityButton, Button& resetButton, Button& backButton,
+    UpgradeMenuCache& cache) {
+    Button* buttons[UPGRADE_MENU_BUTTON_COUNT] = {
+        &healthButton, &damageButton, &speedButton, &attackSpeedButton, &projectileCountButton,
+        &bombAbilityButton, &freezeAbilityButton, &waveAbilityButton, &resetButton, &backButton
+    };
 
-            for (const auto& enemy : enemies) {
-                float distance = Vector2Distance(player.position, enemy.position);
-                if (distance < 300.0f * SIZE_MULTIPLIER) {
-                    averagePosition.x += enemy.position.x;
-                    averagePosition.y += enemy.position.y;
-                    enemyCount++;
-                }
-            }
+    int screenWidth = GetScreenWidth();
+    int screenHeight = GetScreenHeight();
 
-            Vector2 waveDirection = { 0, 1 };
+    // Пересоздание слоя при изменении размера экрана
+    if (!cache.hasTexture || cache.width != screenWidth || cache.height != screenHeight) {
+        UnloadUpgradeMenuCache(cache);
+        cache.staticLayer = LoadRenderTexture(screenWidth, screenHeight);
+        cache.hasTexture = true;
+        cache.width = screenWidth;
+        cache.height = screenHeight;
+    }
 
-            if (enemyCount > 0) {
-                averagePosition.x /= enemyCount;
-                averagePosition.y /= enemyCount;
-                waveDirection = Vector2Subtract(averagePosition, player.position);
-                waveDirection = Vector2Normalize(waveDirection);
-            }
-            else {
-                float min_distance = FLT_MAX;
-                for (const auto& enemy : enemies) {
-                    float distance = Vector2Distance(player.position, enemy.position);
-                    if (distance < min_distance) {
-                        min_distance = distance;
-                        waveDirection = Vector2Subtract(enemy.position, player.position);
-                        waveDirection = Vector2Normalize(waveDirection);
-                    }
-                }
-            }
+    if (!cache.valid) {
+        LayoutUpgradeMenu(meta, buttons, cache);
+        DrawUpgradeMenuStatic(meta, buttons, cache);
+        cache.valid = true;
+    }
+
+    BeginDrawing();
+    ClearBackground(BLACK);
 
-            shockwave.direction = waveDirection;
-            shockwave.speed = 3.0f;
-            shockwave.damage = player.waveDamage;
-            shockwave.active = true;
-            shockwaves.push_back(shockwave);
+    // Текстура рендер-таргета перевернута по Y
+    Rectangle source = { 0, 0, (float)cache.width, -(float)cache.height };
+    DrawTextureRec(cache.staticLayer.texture, source, { 0, 0 }, WHITE);
 
-            player.lastWaveTime = currentTime;
+    // Дорисовываем только подсвеченные кнопки
+    for (int i = 0; i < UPGRADE_MENU_BUTTON_COUNT; i++) {
+        if (buttons[i]->hovered && cache.styles[i] == BUTTON_STYLE_ACTIVE) {
+            DrawUpgradeMenuButton(*buttons[i], cache.styles[i]);
         }
     }
 
-    // Активация бомбы
-    if (player.hasBombAttack && currentTime - player.lastBombTime > player.bombCooldown) {
-        Bomb bomb;
-        bomb.position = player.position;
-        bomb.timer = 2.0f;
-        bomb.explosionRadius = player.bombRadius;
-        bomb.damage = player.bombDamage;
-        bomb.active = true;
-        bomb.exploded = false;
-        bombs.push_back(bomb);
+    EndDrawing();
+}
+
+// Строка HUD: координата y и размер шрифта заданы для 1080p
+void DrawHudText(const char* text, int y, float uiScale, Color color) {
+    DrawText(text, (int)(10 * uiScale), (int)(y * uiScale), (int)(20 * uiScale), color);
+}
+
+// Оверлей счетчиков (F3): значение за тик, за секунду и пик за тик
+void DrawStatsOverlay(const StatsState& stats) {
+    int x = GetScreenWidth() - 420;
+    int y = 10;
+#if ENABLE_STATS
+    DrawText("tick / second / peak tick", x, y, 20, LIGHTGRAY);
+    for (int counter = 0; counter < STAT_COUNT; counter++) {
+        y += 22;
+        DrawText(TextFormat("%s: %lld / %lld / %lld", STAT_NAMES[counter],
+            GetStat(stats, (StatCounter)counter, STAT_WINDOW_TICK),
+            GetStat(stats, (StatCounter)counter, STAT_WINDOW_SECOND),
+            GetStat(stats, (StatCounter)counter, STAT_WINDOW_PEAK_TICK)), x, y, 18, LIGHTGRAY);
+    }
+#else
+    DrawText("Stats compiled out (ENABLE_STATS 0)", x, y, 20, LIGHTGRAY);
+#endif
+
+    y += 32;
+    DrawText("memory: live / peak KB", x, y, 20, LIGHTGRAY);
+    for (int tag = 0; tag < MEM_COUNT; tag++) {
+        y += 22;
+        DrawText(TextFormat("%s: %.1f / %.1f", MEMORY_TAG_NAMES[tag],
+            GetMemoryLiveBytes((MemoryTag)tag) / 1024.0, GetMemoryPeakBytes((MemoryTag)tag) / 1024.0), x, y, 18, LIGHTGRAY);
+    }
+}
 
-        player.lastBombTime = currentTime;
+// Значение параметра командной строки вида "--name value" (nullptr, если его нет)
+const char* GetArgValue(int argc, char** argv, const char* name) {
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], name) == 0) return argv[i + 1];
     }
+    return nullptr;
+}
+
+// Загрузка настроек: строки "ключ = значение", комментарии с '#'.
+// Отсутствующие ключи берут значения по умолчанию; при ошибке файл отвергается целиком
+bool LoadTuningConfig(const char* path, TuningConfig& tuning) {
+    FILE* file = fopen(path, "r");
+    if (!file) return false;
+
+    tuning = CreateDefaultTuning();
+    char line[256];
+    int lineNumber = 0;
+    bool ok = true;
+    while (fgets(line, sizeof(line), file)) {
+        lineNumber++;
+        char* comment = strchr(line, '#');
+        if (comment) *comment = 0;
+
+        char key[64];
+        char value[64];
+        char extra;
+        int fields = sscanf(line, " %63[A-Za-z0-9_] = %63s %c", key, value, &extra);
+        if (fields <= 0) {
+            if (strspn(line, " \t\r\n") != strlen(line)) fields = 1;
+            else continue;
+        }
+        if (fields != 2) {
+            fprintf(stderr, "tuning: %s:%d: expected 'key = value'\n", path, lineNumber);
+            ok = false;
+            continue;
+        }
+
+        const TuningField* field = nullptr;
+        for (int i = 0; i < TUNING_FIELD_COUNT && !field; i++) {
+            if (strcmp(TUNING_FIELDS[i].name, key) == 0) field = &TUNING_FIELDS[i];
+        }
+        char* end;
+        double number = strtod(value, &end);
+        if (!field || *end != 0) {
+            fprintf(stderr, "tuning: %s:%d: %s '%s'\n", path, lineNumber, field ? "bad value for" : "unknown key", key);
+            ok = false;
+            continue;
+        }
 
-    // Активация заморозки
-    if (player.hasFreezeAttack && currentTime - player.lastFreezeTime > player.freezeCooldown) {
-        FreezeArea freeze;
-        freeze.position = player.position;
-        freeze.radius = player.freezeRadius;
-        freeze.duration = player.freezeDuration;
-        freeze.timer = freeze.duration;
-        freeze.active = true;
-        freezeAreas.push_back(freeze);
+        bool inRange = std::isfinite(number) && (field->range == TUNING_POSITIVE ? number > 0.0 :
+            field->range == TUNING_NON_NEGATIVE ? number >= 0.0 : number > 0.0 && number <= 1.0);
+        if (field->type == TUNING_INT && (number != std::floor(number) || number > INT_MAX)) inRange = false;
+        if (field->type == TUNING_FLOAT && number > FLT_MAX) inRange = false;
+        if (!inRange) {
+            fprintf(stderr, "tuning: %s:%d: %s = %s is out of range\n", path, lineNumber, key, value);
+            ok = false;
+            continue;
+        }
 
-        player.lastFreezeTime = currentTime;
+        char* target = (char*)&tuning + field->offset;
+        switch (field->type) {
+        case TUNING_INT: *(int*)target = (int)number; break;
+        case TUNING_FLOAT: *(float*)target = (float)number; break;
+        case TUNING_DOUBLE: *(double*)target = number; break;
+        }
     }
+    fclose(file);
+    return ok;
+}
 
-    // Активация фаербола
-    if (player.hasFireballAttack && currentTime - player.lastFireballTime > player.fireballCooldown) {
-        float min_distance = FLT_MAX;
-        Enemy* nearest_enemy = nullptr;
-        for (auto& enemy : enemies) {
-            float distance = Vector2Distance(player.position, enemy.position);
-            if (distance < min_distance) {
-                min_distance = distance;
-                nearest_enemy = &enemy;
-            }
+bool SaveTuningConfig(const char* path, const TuningConfig& tuning) {
+    FILE* file = fopen(path, "w");
+    if (!file) return false;
+    fprintf(file, "# Balance tuning (reloaded while the game runs)\n");
+    for (int i = 0; i < TUNING_FIELD_COUNT; i++) {
+        const char* source = (const char*)&tuning + TUNING_FIELDS[i].offset;
+        switch (TUNING_FIELDS[i].type) {
+        case TUNING_INT: fprintf(file, "%s = %d\n", TUNING_FIELDS[i].name, *(const int*)source); break;
+        case TUNING_FLOAT: fprintf(file, "%s = %g\n", TUNING_FIELDS[i].name, *(const float*)source); break;
+        case TUNING_DOUBLE: fprintf(file, "%s = %g\n", TUNING_FIELDS[i].name, *(const double*)source); break;
         }
+    }
+    fclose(file);
+    return true;
+}
 
-        if (nearest_enemy != nullptr) {
-            Fireball fireball;
-            fireball.position = player.position;
+// Загруженные настройки ждут ближайшей границы тика
+void PublishTuning(const TuningConfig& tuning) {
+    TuningConfig* previous = pendingTuning.exchange(new TuningConfig(tuning));
+    delete previous;
+}
+
+// Вызывается главным потоком между тиками (системы не работают): после подмены старые
+// настройки никто не читает и их можно освободить. Игроки забега переводятся на новые
+// значения (RetunePlayer), остальное читается из GetTuning() в момент использования
+bool ApplyPendingTuning(Player* players, int playerCount) {
+    TuningConfig* next = pendingTuning.exchange(nullptr);
+    if (!next) return false;
+    const TuningConfig* previous = activeTuning.exchange(next);
+    for (int i = 0; i < playerCount; i++) {
+        RetunePlayer(players[i], *previous, *next);
+    }
+    if (previous != &defaultTuning) delete previous;
+    return true;
+}
+
+void ReloadTuning(const char* path) {
+    TuningConfig tuning;
+    if (LoadTuningConfig(path, tuning)) {
+        PublishTuning(tuning);
+        fprintf(stderr, "tuning: reloaded %s\n", path);
+    }
+    else {
+        fprintf(stderr, "tuning: %s rejected, keeping previous values\n", path);
+    }
+}
 
-            Vector2 direction = Vector2Subtract(nearest_enemy->position, player.position);
-            direction = Vector2Normalize(direction);
+// Слежение за файлом настроек в отдельном потоке: inotify на Linux (событие каталога,
+// так как редакторы часто сохраняют через переименование), иначе опрос времени изменения
+struct TuningWatcher {
+    std::string path;
+    std::thread thread;
+    std::atomic<bool> stopping;
+};
 
-            fireball.velocity.x = direction.x * player.fireballSpeed;
-            fireball.velocity.y = direction.y * player.fireballSpeed;
-            fireball.radius = 8.0f * SIZE_MULTIPLIER;
-            fireball.damage = player.fireballDamage + player.damage / 2;
-            fireball.explosionRadius = player.fireballExplosionRadius;
-            fireball.active = true;
-            fireball.exploded = false;
-            fireball.explosionTimer = 0.3f;
+void TuningWatcherLoop(TuningWatcher* watcher) {
+    const std::string& path = watcher->path;
+    size_t slash = path.find_last_of("/\\");
+    std::string directory = slash == std::string::npos ? "." : path.substr(0, slash);
+    std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+
+#if defined(__linux__)
+    int fd = inotify_init1(IN_NONBLOCK);
+    if (fd >= 0 && inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) >= 0) {
+        alignas(inotify_event) char buffer[4096];
+        while (!watcher->stopping.load()) {
+            pollfd descriptor = { fd, POLLIN, 0 };
+            if (poll(&descriptor, 1, 200) <= 0) continue;
+
+            bool changed = false;
+            ssize_t size;
+            while ((size = read(fd, buffer, sizeof(buffer))) > 0) {
+                for (char* cursor = buffer; cursor < buffer + size;) {
+                    const inotify_event* event = (const inotify_event*)cursor;
+                    if (event->len > 0 && name == event->name) changed = true;
+                    cursor += sizeof(inotify_event) + event->len;
+                }
+            }
+            if (changed) ReloadTuning(path.c_str());
+        }
+        close(fd);
+        return;
+    }
+    if (fd >= 0) close(fd);
+#endif
+
+    long modTime = FileExists(path.c_str()) ? GetFileModTime(path.c_str()) : 0;
+    while (!watcher->stopping.load()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(250));
+        long current = FileExists(path.c_str()) ? GetFileModTime(path.c_str()) : 0;
+        if (current != modTime) {
+            modTime = current;
+            if (current != 0) ReloadTuning(path.c_str());
+        }
+    }
+}
 
-            fireballs.push_back(fireball);
-            player.lastFireballTime = currentTime;
+// Настройки из --tuning файл (по умолчанию tuning.cfg рядом с игрой, если он есть).
+// Начальные значения применяются сразу; watch - следить за файлом дальше
+void StartTuning(int argc, char** argv, TuningWatcher* watcher) {
+    const char* path = GetArgValue(argc, argv, "--tuning");
+    if (!path) path = "tuning.cfg";
+
+    TuningConfig tuning;
+    if (FileExists(path)) {
+        if (LoadTuningConfig(path, tuning)) {
+            PublishTuning(tuning);
+            ApplyPendingTuning(nullptr, 0);
+            fprintf(stderr, "tuning: loaded %s\n", path);
+        }
+        else {
+            fprintf(stderr, "tuning: %s rejected, using defaults\n", path);
         }
     }
+
+    if (watcher) {
+        watcher->path = path;
+        watcher->stopping = false;
+        watcher->thread = std::thread(TuningWatcherLoop, watcher);
+    }
 }
 
-void DrawPlayer(const Player& player) {
-    DrawCircleV(player.position, player.radius, COLOR_PLAYER);
+void StopTuningWatcher(TuningWatcher& watcher) {
+    if (!watcher.thread.joinable()) return;
+    watcher.stopping = true;
+    watcher.thread.join();
+}
 
-    float healthBarWidth = 40.0f * SIZE_MULTIPLIER;
-    float healthBarHeight = 5.0f * SIZE_MULTIPLIER;
-    Vector2 healthBarPos = {
-            player.position.x - healthBarWidth / 2,
-            player.position.y - player.radius - 15.0f * SIZE_MULTIPLIER
-    };
+// Время от старта процесса (глобальные объекты создаются до main)
+const std::chrono::steady_clock::time_point processStartTime = std::chrono::steady_clock::now();
 
-    DrawRectangle((int)healthBarPos.x, (int)healthBarPos.y, (int)healthBarWidth, (int)healthBarHeight, RED);
-    DrawRectangle((int)healthBarPos.x, (int)healthBarPos.y, (int)(healthBarWidth * (player.health / (float)player.maxHealth)), (int)healthBarHeight, GREEN);
+double GetStartupSeconds() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - processStartTime).count();
 }
 
-// Функции для пуль
-void UpdateBullets(std::vector<Bullet>& bullets) {
-    for (auto it = bullets.begin(); it != bullets.end();) {
-        if (it == bullets.end()) break;
+// Пакет ресурсов: один файл, который отображается в память целиком.
+// Заголовок, таблица записей и данные, выровненные по ASSET_PACK_ALIGNMENT.
+// Данные уже в том виде, в котором уходят на видеокарту или в микшер (RGBA8, PCM16),
+// поэтому загрузка - это отображение файла и передача указателей, без разбора и копий
+const unsigned int ASSET_PACK_MAGIC = 0x4B505353u;     // "SSPK"
+const unsigned int ASSET_PACK_VERSION = 1;
+const unsigned int ASSET_PACK_ALIGNMENT = 64;
+const int ASSET_NAME_LENGTH = 28;
+const double ASSET_UPLOAD_BUDGET_MS = 4.0;             // Загрузка текстур на GPU за кадр меню
+const unsigned int ASSET_SOUND_RATE = 44100;           // Звуки в пакете: моно PCM16 с частотой микшера
+
+enum AssetType {
+    ASSET_TEXTURE = 1,
+    ASSET_SOUND = 2
+};
 
-        it->position.x += it->velocity.x;
-        it->position.y += it->velocity.y;
+struct AssetPackHeader {
+    unsigned int magic;
+    unsigned int version;
+    unsigned int entryCount;
+    unsigned int tocOffset;
+};
+
+struct AssetPackEntry {
+    char name[ASSET_NAME_LENGTH];
+    unsigned int type;
+    unsigned int offset;
+    unsigned int size;
+    unsigned int width;        // Текстура: ширина; звук: частота
+    unsigned int height;       // Текстура: высота; звук: число кадров
+    unsigned int format;       // Текстура: PixelFormat; звук: бит на отсчет
+    unsigned int channels;     // Звук: каналы
+};
 
-        int screenWidth = GetScreenWidth();
-        int screenHeight = GetScreenHeight();
+static_assert(sizeof(AssetPackHeader) == 16, "asset pack header layout");
+static_assert(sizeof(AssetPackEntry) == 56, "asset pack entry layout");
+
+struct MappedFile {
+    const unsigned char* data;
+    size_t size;
+#if defined(_WIN32)
+    void* file;
+    void* mapping;
+#else
+    int descriptor;
+#endif
+};
 
-        if (it->position.x < -100 || it->position.x > screenWidth + 100 ||
-            it->position.y < -100 || it->position.y > screenHeight + 100) {
-            it = bullets.erase(it);
+bool MapFile(const char* path, MappedFile& mapped) {
+    mapped.data = nullptr;
+    mapped.size = 0;
+#if defined(_WIN32)
+    mapped.mapping = nullptr;
+    mapped.file = CreateFileA(path, WIN_GENERIC_READ, WIN_FILE_SHARE_READ, nullptr, WIN_OPEN_EXISTING, WIN_FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (mapped.file == (void*)~(size_t)0) {
+        mapped.file = nullptr;
+        return false;
+    }
+    long long size = 0;
+    if (GetFileSizeEx(mapped.file, &size) && size > 0) {
+        mapped.mapping = CreateFileMappingA(mapped.file, nullptr, WIN_PAGE_READONLY, 0, 0, nullptr);
+        if (mapped.mapping) {
+            mapped.data = (const unsigned char*)MapViewOfFile(mapped.mapping, WIN_FILE_MAP_READ, 0, 0, 0);
+            mapped.size = (size_t)size;
         }
-        else {
-            ++it;
+    }
+    if (!mapped.data) {
+        if (mapped.mapping) CloseHandle(mapped.mapping);
+        CloseHandle(mapped.file);
+        mapped.mapping = nullptr;
+        mapped.file = nullptr;
+        mapped.size = 0;
+        return false;
+    }
+#else
+    mapped.descriptor = open(path, O_RDONLY);
+    if (mapped.descriptor < 0) return false;
+    struct stat info;
+    if (fstat(mapped.descriptor, &info) == 0 && info.st_size > 0) {
+        void* data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, mapped.descriptor, 0);
+        if (data != MAP_FAILED) {
+            mapped.data = (const unsigned char*)data;
+            mapped.size = (size_t)info.st_size;
         }
     }
-}
-
-void DrawBullets(const std::vector<Bullet>& bullets) {
-    for (const auto& bullet : bullets) {
-        DrawCircleV(bullet.position, bullet.radius, COLOR_BULLET);
+    if (!mapped.data) {
+        close(mapped.descriptor);
+        mapped.descriptor = -1;
+        return false;
     }
+#endif
+    return true;
 }
 
-// Функции для шоквейвов
-void UpdateShockwaves(std::vector<Shockwave>& shockwaves) {
-    for (auto it = shockwaves.begin(); it != shockwaves.end();) {
-        if (it == shockwaves.end()) break;
-
-        it->position.x += it->direction.x * it->speed;
-        it->position.y += it->direction.y * it->speed;
-        it->radius += 0.8f;
+void UnmapFile(MappedFile& mapped) {
+    if (!mapped.data) return;
+#if defined(_WIN32)
+    UnmapViewOfFile(mapped.data);
+    CloseHandle(mapped.mapping);
+    CloseHandle(mapped.file);
+#else
+    munmap((void*)mapped.data, mapped.size);
+    close(mapped.descriptor);
+#endif
+    mapped.data = nullptr;
+    mapped.size = 0;
+}
 
-        int screenWidth = GetScreenWidth();
-        int screenHeight = GetScreenHeight();
+// Проверка заголовка и таблицы: все записи должны лежать внутри файла с выравниванием
+// ASSET_PACK_ALIGNMENT и иметь размер, точно соответствующий их формату
+const AssetPackEntry* ValidateAssetPack(const MappedFile& mapped, int& entryCount) {
+    entryCount = 0;
+    if (mapped.size < sizeof(AssetPackHeader)) return nullptr;
+    AssetPackHeader header;
+    memcpy(&header, mapped.data, sizeof(header));
+    if (header.magic != ASSET_PACK_MAGIC || header.version != ASSET_PACK_VERSION) return nullptr;
+    if (header.tocOffset % alignof(AssetPackEntry) != 0 || header.tocOffset > mapped.size ||
+        header.entryCount > (mapped.size - header.tocOffset) / sizeof(AssetPackEntry)) {
+        return nullptr;
+    }
 
-        if (it->position.x < -100 || it->position.x > screenWidth + 100 ||
-            it->position.y < -100 || it->position.y > screenHeight + 100 ||
-            it->radius > 200 * SIZE_MULTIPLIER) {
-            it = shockwaves.erase(it);
+    const AssetPackEntry* entries = (const AssetPackEntry*)(mapped.data + header.tocOffset);
+    for (unsigned int i = 0; i < header.entryCount; i++) {
+        const AssetPackEntry& entry = entries[i];
+        if (entry.offset > mapped.size || entry.size > mapped.size - entry.offset) return nullptr;
+        if (entry.offset % ASSET_PACK_ALIGNMENT != 0) return nullptr;
+        if (entry.name[ASSET_NAME_LENGTH - 1] != 0) return nullptr;
+        unsigned long long expected = 0;
+        if (entry.type == ASSET_TEXTURE && entry.format == PIXELFORMAT_UNCOMPRESSED_R8G8B8A8) {
+            expected = 4ull * entry.width * entry.height;
         }
-        else {
-            ++it;
+        else if (entry.type == ASSET_SOUND && entry.format == 16 && entry.width != 0) {
+            expected = 2ull * entry.height * entry.channels;
         }
+        if (expected == 0 || expected != entry.size) return nullptr;
     }
+    entryCount = (int)header.entryCount;
+    return entries;
 }
 
-void DrawShockwaves(const std::vector<Shockwave>& shockwaves) {
-    for (const auto& shockwave : shockwaves) {
-        DrawCircleV(shockwave.position, shockwave.radius, COLOR_WAVE_ATTACK);
-        DrawCircleLines((int)shockwave.position.x, (int)shockwave.position.y, (int)shockwave.radius, BLUE);
-    }
-}
+// Асинхронная загрузка: фоновый поток отображает и проверяет файл и заранее
+// подкачивает страницы, пока меню уже рисуется. Загрузка текстур на GPU возможна
+// только в потоке окна, поэтому ее делает главный цикл порциями по времени
+enum AssetLoadState {
+    ASSETS_MAPPING,
+    ASSETS_UPLOADING,
+    ASSETS_READY,
+    ASSETS_FAILED
+};
 
-// Функции для бомб
-void UpdateBombs(std::vector<Bomb>& bombs, double deltaTime) {
-    for (auto it = bombs.begin(); it != bombs.end();) {
-        if (it == bombs.end()) break;
+struct AssetLoader {
+    std::string path;
+    std::thread thread;
+    std::atomic<int> state;
+    MappedFile file;
+    const AssetPackEntry* entries;
+    int entryCount;
+    int uploaded;                       // Записей, уже обработанных главным потоком
+    std::vector<Texture2D> textures;    // По записям; id 0 - не текстура
+    unsigned int pageChecksum;          // Результат подкачки страниц (чтобы чтение не выбросил компилятор)
+    double startSeconds;
+    double mappedSeconds;
+    double readySeconds;
+    double uploadMs;
+};
 
-        it->timer -= (float)deltaTime;
+void LoadAssetPackTask(AssetLoader* loader) {
+    if (!MapFile(loader->path.c_str(), loader->file)) {
+        loader->state.store(ASSETS_FAILED, std::memory_order_release);
+        return;
+    }
+    loader->entries = ValidateAssetPack(loader->file, loader->entryCount);
+    if (!loader->entries) {
+        UnmapFile(loader->file);
+        loader->state.store(ASSETS_FAILED, std::memory_order_release);
+        return;
+    }
 
-        if (it->timer <= 0 && !it->exploded) {
-            it->exploded = true;
-            it->timer = 0.3f;
-        }
+    // Первое обращение к каждой странице здесь, а не в кадре, который загружает текстуру
+    unsigned int checksum = 0;
+    for (size_t offset = 0; offset < loader->file.size; offset += 4096) {
+        checksum += loader->file.data[offset];
+    }
+    loader->pageChecksum = checksum;
+    loader->mappedSeconds = GetStartupSeconds();
+    loader->state.store(ASSETS_UPLOADING, std::memory_order_release);
+}
+
+void StartAssetLoader(AssetLoader& loader, const char* path) {
+    loader.path = path;
+    loader.entries = nullptr;
+    loader.entryCount = 0;
+    loader.uploaded = 0;
+    loader.textures.clear();
+    loader.pageChecksum = 0;
+    loader.startSeconds = GetStartupSeconds();
+    loader.mappedSeconds = 0.0;
+    loader.readySeconds = 0.0;
+    loader.uploadMs = 0.0;
+    loader.state = ASSETS_MAPPING;
+    loader.thread = std::thread(LoadAssetPackTask, &loader);
+}
 
-        if (it->exploded && it->timer <= 0) {
-            it = bombs.erase(it);
+// Вызывается каждый кадр до готовности; true - загрузка завершена (успешно или нет)
+bool UpdateAssetLoader(AssetLoader& loader) {
+    int state = loader.state.load(std::memory_order_acquire);
+    if (state == ASSETS_MAPPING) return false;
+    if (loader.thread.joinable()) {
+        loader.thread.join();
+        loader.textures.assign(loader.entryCount, Texture2D{});
+        if (state == ASSETS_FAILED) {
+            TraceLog(LOG_WARNING, "ASSETS: cannot load pack %s, using built-in resources", loader.path.c_str());
+            loader.readySeconds = GetStartupSeconds();
         }
-        else {
-            ++it;
+    }
+    if (state != ASSETS_UPLOADING) return true;
+
+    auto start = std::chrono::steady_clock::now();
+    double elapsedMs = 0.0;
+    while (loader.uploaded < loader.entryCount && elapsedMs < ASSET_UPLOAD_BUDGET_MS) {
+        const AssetPackEntry& entry = loader.entries[loader.uploaded];
+        if (entry.type == ASSET_TEXTURE) {
+            // Image указывает прямо в отображенный файл: raylib только читает данные
+            Image image = { (void*)(loader.file.data + entry.offset), (int)entry.width, (int)entry.height, 1, (int)entry.format };
+            loader.textures[loader.uploaded] = LoadTextureFromImage(image);
         }
+        loader.uploaded++;
+        elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
     }
+    loader.uploadMs += elapsedMs;
+
+    if (loader.uploaded < loader.entryCount) return false;
+    loader.readySeconds = GetStartupSeconds();
+    loader.state.store(ASSETS_READY, std::memory_order_release);
+    return true;
 }
 
-void DrawBombs(const std::vector<Bomb>& bombs) {
-    for (const auto& bomb : bombs) {
-        if (!bomb.exploded) {
-            Color bombColor = COLOR_BOMB;
-            if (bomb.timer < 0.5f) {
-                bombColor = (fmod(bomb.timer, 0.1f) > 0.05f) ? RED : COLOR_BOMB;
-            }
-            DrawCircleV(bomb.position, 12.0f * SIZE_MULTIPLIER, bombColor);
-        }
-        else {
-            DrawCircleV(bomb.position, bomb.explosionRadius, COLOR_EXPLOSION);
-            DrawCircleLines((int)bomb.position.x, (int)bomb.position.y, (int)bomb.explosionRadius, RED);
-        }
+float GetAssetLoadProgress(const AssetLoader& loader) {
+    int state = loader.state.load(std::memory_order_acquire);
+    if (state == ASSETS_MAPPING) return 0.0f;
+    if (state != ASSETS_UPLOADING || loader.entryCount == 0) return 1.0f;
+    return (float)loader.uploaded / loader.entryCount;
+}
+
+int FindAssetEntry(const AssetLoader& loader, const char* name, AssetType type) {
+    if (loader.state.load(std::memory_order_acquire) != ASSETS_READY) return -1;
+    for (int i = 0; i < loader.entryCount; i++) {
+        if (loader.entries[i].type == (unsigned int)type && strcmp(loader.entries[i].name, name) == 0) return i;
     }
+    return -1;
 }
 
-// Функции для заморозки
-void UpdateFreezeAreas(std::vector<FreezeArea>& freezeAreas, double deltaTime) {
-    for (auto it = freezeAreas.begin(); it != freezeAreas.end();) {
-        if (it == freezeAreas.end()) break;
+bool FindAssetTexture(const AssetLoader& loader, const char* name, Texture2D& texture) {
+    int index = FindAssetEntry(loader, name, ASSET_TEXTURE);
+    if (index < 0) return false;
+    texture = loader.textures[index];
+    return true;
+}
 
-        it->timer -= (float)deltaTime;
+// Звук не копируется: Wave ссылается на данные в отображенном файле
+bool FindAssetSound(const AssetLoader& loader, const char* name, Wave& wave) {
+    int index = FindAssetEntry(loader, name, ASSET_SOUND);
+    if (index < 0) return false;
+    const AssetPackEntry& entry = loader.entries[index];
+    wave.frameCount = entry.height;
+    wave.sampleRate = entry.width;
+    wave.sampleSize = entry.format;
+    wave.channels = entry.channels;
+    wave.data = (void*)(loader.file.data + entry.offset);
+    return true;
+}
 
-        if (it->timer <= 0) {
-            it = freezeAreas.erase(it);
-        }
-        else {
-            ++it;
-        }
+void UnloadAssets(AssetLoader& loader) {
+    if (loader.thread.joinable()) {
+        loader.thread.join();
     }
+    for (size_t i = 0; i < loader.textures.size(); i++) {
+        if (loader.textures[i].id != 0) UnloadTexture(loader.textures[i]);
+    }
+    loader.textures.clear();
+    UnmapFile(loader.file);
+    loader.entries = nullptr;
+    loader.entryCount = 0;
 }
 
-void DrawFreezeAreas(const std::vector<FreezeArea>& freezeAreas) {
-    for (const auto& freeze : freezeAreas) {
-        DrawCircleV(freeze.position, freeze.radius, COLOR_FREEZE);
-        DrawCircleLines((int)freeze.position.x, (int)freeze.position.y, (int)freeze.radius, BLUE);
+// Сборка пакета: встроенные ресурсы (сгенерированные) и файлы из командной строки,
+// приведенные к формату пакета (изображения -> RGBA8, звуки -> PCM16)
+struct AssetPackSource {
+    AssetPackEntry entry;
+    std::vector<unsigned char> data;
+};
+
+void SetAssetName(AssetPackEntry& entry, const char* path) {
+    const char* name = path;
+    for (const char* c = path; *c; c++) {
+        if (*c == '/' || *c == '\\') name = c + 1;
     }
+    size_t length = strcspn(name, ".");
+    length = std::min(length, (size_t)ASSET_NAME_LENGTH - 1);
+    memset(entry.name, 0, sizeof(entry.name));
+    memcpy(entry.name, name, length);
 }
 
-// Функции для фаерболов
-void UpdateFireballs(std::vector<Fireball>& fireballs, std::vector<Enemy>& enemies, double deltaTime) {
-    for (auto it = fireballs.begin(); it != fireballs.end();) {
-        if (it == fireballs.end()) break;
+void AddPackImage(std::vector<AssetPackSource>& sources, const char* name, Image image) {
+    ImageFormat(&image, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+    AssetPackSource source;
+    memset(&source.entry, 0, sizeof(source.entry));
+    SetAssetName(source.entry, name);
+    source.entry.type = ASSET_TEXTURE;
+    source.entry.width = (unsigned int)image.width;
+    source.entry.height = (unsigned int)image.height;
+    source.entry.format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8;
+    const unsigned char* pixels = (const unsigned char*)image.data;
+    source.data.assign(pixels, pixels + 4 * image.width * image.height);
+    sources.push_back(source);
+}
 
-        if (!it->exploded) {
-            it->position.x += it->velocity.x;
-            it->position.y += it->velocity.y;
+void AddPackWave(std::vector<AssetPackSource>& sources, const char* name, Wave wave) {
+    WaveFormat(&wave, (int)ASSET_SOUND_RATE, 16, 1);
+    AssetPackSource source;
+    memset(&source.entry, 0, sizeof(source.entry));
+    SetAssetName(source.entry, name);
+    source.entry.type = ASSET_SOUND;
+    source.entry.width = wave.sampleRate;
+    source.entry.height = wave.frameCount;
+    source.entry.format = 16;
+    source.entry.channels = wave.channels;
+    const unsigned char* samples = (const unsigned char*)wave.data;
+    source.data.assign(samples, samples + 2 * wave.frameCount * wave.channels);
+    sources.push_back(source);
+}
 
-            bool hitEnemy = false;
-            for (auto& enemy : enemies) {
-                float distance = Vector2Distance(it->position, enemy.position);
-                if (distance < it->radius + enemy.radius) {
-                    hitEnemy = true;
-                    break;
-                }
-            }
+bool WriteAssetPack(const char* path, std::vector<AssetPackSource>& sources) {
+    FILE* file = fopen(path, "wb");
+    if (!file) return false;
+
+    AssetPackHeader header = { ASSET_PACK_MAGIC, ASSET_PACK_VERSION, (unsigned int)sources.size(), (unsigned int)sizeof(AssetPackHeader) };
+    unsigned int offset = header.tocOffset + (unsigned int)(sources.size() * sizeof(AssetPackEntry));
+    for (size_t i = 0; i < sources.size(); i++) {
+        offset = (offset + ASSET_PACK_ALIGNMENT - 1) / ASSET_PACK_ALIGNMENT * ASSET_PACK_ALIGNMENT;
+        sources[i].entry.offset = offset;
+        sources[i].entry.size = (unsigned int)sources[i].data.size();
+        offset += sources[i].entry.size;
+    }
 
-            int screenWidth = GetScreenWidth();
-            int screenHeight = GetScreenHeight();
+    fwrite(&header, sizeof(header), 1, file);
+    for (size_t i = 0; i < sources.size(); i++) {
+        fwrite(&sources[i].entry, sizeof(AssetPackEntry), 1, file);
+    }
+    static const unsigned char padding[ASSET_PACK_ALIGNMENT] = {};
+    long position = (long)(header.tocOffset + sources.size() * sizeof(AssetPackEntry));
+    for (size_t i = 0; i < sources.size(); i++) {
+        fwrite(padding, 1, sources[i].entry.offset - position, file);
+        fwrite(sources[i].data.data(), 1, sources[i].data.size(), file);
+        position = (long)(sources[i].entry.offset + sources[i].entry.size);
+    }
+    bool ok = ferror(file) == 0;
+    fclose(file);
+    return ok;
+}
 
-            if (it->position.x < 0 || it->position.x > screenWidth ||
-                it->position.y < 0 || it->position.y > screenHeight ||
-                hitEnemy) {
-                it->exploded = true;
+// --build-pack [файл.pak] [изображение.png|звук.wav ...]
+int RunBuildAssetPack(int argc, char** argv) {
+    const char* outputPath = argc > 2 ? argv[2] : "assets.pak";
+    std::vector<AssetPackSource> sources;
+
+    Image particle = GenImageGradientRadial(32, 32, 0.0f, WHITE, BLANK);
+    AddPackImage(sources, "particle", particle);
+    UnloadImage(particle);
+
+    for (int i = 3; i < argc; i++) {
+        const char* extension = strrchr(argv[i], '.');
+        bool isSound = extension && (strcmp(extension, ".wav") == 0 || strcmp(extension, ".ogg") == 0 ||
+            strcmp(extension, ".mp3") == 0 || strcmp(extension, ".flac") == 0);
+        if (isSound) {
+            Wave wave = LoadWave(argv[i]);
+            if (wave.data == nullptr) {
+                fprintf(stderr, "cannot load sound %s\n", argv[i]);
+                return 1;
             }
+            AddPackWave(sources, argv[i], wave);
+            UnloadWave(wave);
         }
         else {
-            it->explosionTimer -= (float)deltaTime;
-            if (it->explosionTimer <= 0) {
-                it = fireballs.erase(it);
-                continue;
+            Image image = LoadImage(argv[i]);
+            if (image.data == nullptr) {
+                fprintf(stderr, "cannot load image %s\n", argv[i]);
+                return 1;
             }
+            AddPackImage(sources, argv[i], image);
+            UnloadImage(image);
         }
-        ++it;
     }
-}
 
-void DrawFireballs(const std::vector<Fireball>& fireballs) {
-    for (const auto& fireball : fireballs) {
-        if (!fireball.exploded) {
-            DrawCircleV(fireball.position, fireball.radius, COLOR_FIREBALL);
+    if (!WriteAssetPack(outputPath, sources)) {
+        fprintf(stderr, "cannot write %s\n", outputPath);
+        return 1;
+    }
 
-            for (int i = 0; i < 3; i++) {
-                float offset = (float)GetTime() * 10.0f + i * 2.0f;
-                float pulse = (sinf(offset) + 1.0f) * 0.5f;
-                float trailRadius = fireball.radius * (0.7f + pulse * 0.3f);
-                Color trailColor = { 255, 140, 0, (unsigned char)(150 * pulse) };
-                DrawCircleV(fireball.position, trailRadius, trailColor);
-            }
-        }
-        else {
-            DrawCircleV(fireball.position, fireball.explosionRadius, COLOR_FIREBALL_EXPLOSION);
-            DrawCircleLines((int)fireball.position.x, (int)fireball.position.y, (int)fireball.explosionRadius, ORANGE);
-        }
+    MappedFile mapped;
+    int entryCount = 0;
+    const AssetPackEntry* entries = MapFile(outputPath, mapped) ? ValidateAssetPack(mapped, entryCount) : nullptr;
+    if (!entries) {
+        fprintf(stderr, "FAIL: %s does not validate\n", outputPath);
+        UnmapFile(mapped);
+        return 1;
+    }
+    printf("name,type,offset,size,width,height\n");
+    for (int i = 0; i < entryCount; i++) {
+        printf("%s,%s,%u,%u,%u,%u\n", entries[i].name, entries[i].type == ASSET_TEXTURE ? "texture" : "sound",
+            entries[i].offset, entries[i].size, entries[i].width, entries[i].height);
     }
+    printf("%s: %d assets, %zu bytes\n", outputPath, entryCount, mapped.size);
+    UnmapFile(mapped);
+    return 0;
 }
 
-// Функции для врагов (бесконечное усложнение)
-Enemy CreateEnemy(EnemyType type, Vector2 position, float difficultyScale, int waveNumber) {
-    Enemy enemy;
-    enemy.type = type;
-    enemy.position = position;
-    enemy.radius = 15.0f * SIZE_MULTIPLIER;
-    enemy.isFrozen = false;
-    enemy.frozenUntil = 0.0;
+// Звук
+// Источник звуков - игровые события. За тик события одного вида сливаются в один голос
+// (громче, если событий много), поэтому команд в микшер не больше SOUND_COUNT за тик.
+// Голоса берутся из фиксированного пула, микшер работает в своем потоке и получает
+// команды через очередь без блокировок (один писатель - главный поток, один читатель).
+// Стоимость микширования ограничена числом голосов и не зависит от числа событий
+const int AUDIO_SAMPLE_RATE = (int)ASSET_SOUND_RATE;
+const int AUDIO_BLOCK_FRAMES = 512;             // ~12 мс стерео за блок
+const int AUDIO_VOICE_COUNT = 24;
+const int AUDIO_VOICES_PER_SOUND = 4;           // Остальные голоса вида вытесняются
+const int AUDIO_QUEUE_SIZE = 256;               // Степень двойки
+const float AUDIO_MAX_COALESCED_GAIN = 2.0f;
+const float AUDIO_MASTER_GAIN = 0.6f;           // Запас под одновременные голоса
+const float AUDIO_LIMITER_CEILING = 0.9f;       // Пик выхода после ограничителя
+const float AUDIO_LIMITER_RELEASE = 0.02f;      // Возврат усиления ограничителя за блок (~0.6 с до 1)
+
+enum SoundId {
+    SOUND_SHOT,
+    SOUND_HIT,
+    SOUND_KILL,
+    SOUND_PLAYER_HIT,
+    SOUND_UPGRADE,
+    SOUND_EXPLOSION,
+    SOUND_COUNT
+};
 
-    // Бесконечное масштабирование сложности
-    float waveMultiplier = 1.0f + (waveNumber * 0.1f); // +10% за каждую волну
-    float healthMultiplier = 1.0f + difficultyScale * 0.5f + (waveNumber * 0.05f);
-    float damageMultiplier = 1.0f + difficultyScale * 0.3f + (waveNumber * 0.03f);
-    float speedMultiplier = 1.0f + difficultyScale * 0.2f + (waveNumber * 0.02f);
+const char* const SOUND_NAMES[SOUND_COUNT] = { "shot", "hit", "kill", "player_hit", "upgrade", "explosion" };
+const float SOUND_BASE_GAIN[SOUND_COUNT] = { 0.15f, 0.2f, 0.35f, 0.6f, 0.5f, 0.7f };
 
-    switch (type) {
-    case ENEMY_GREEN:
-        enemy.color = COLOR_GREEN_ENEMY;
-        enemy.speed = 2.5f * speedMultiplier;
-        enemy.health = std::max(1, (int)(30 * healthMultiplier * waveMultiplier));
-        enemy.maxHealth = enemy.health;
-        enemy.damage = std::max(1, (int)(5 * damageMultiplier * waveMultiplier));
-        enemy.attackRange = 20.0f * SIZE_MULTIPLIER;
-        enemy.isRanged = false;
-        enemy.attackCooldown = 1.0f / waveMultiplier;
-        break;
+// Моно PCM16 с частотой микшера: из пакета ресурсов или сгенерированный
+struct SoundClip {
+    const short* samples;
+    int frameCount;
+    std::vector<short> generated;
+};
 
-    case ENEMY_PURPLE:
-        enemy.color = COLOR_PURPLE_ENEMY;
-        enemy.speed = 1.0f * speedMultiplier;
-        enemy.health = std::max(1, (int)(50 * healthMultiplier * waveMultiplier));
-        enemy.maxHealth = enemy.health;
-        enemy.damage = std::max(1, (int)(8 * damageMultiplier * waveMultiplier));
-        enemy.attackRange = 150.0f * SIZE_MULTIPLIER;
-        enemy.isRanged = true;
-        enemy.attackCooldown = 1.0f / waveMultiplier;
-        break;
+struct AudioCommand {
+    unsigned char sound;
+    float gain;
+    float pan;               // -1 слева, 1 справа
+};
 
-    case ENEMY_RED:
-        enemy.color = COLOR_RED_ENEMY;
-        enemy.speed = 0.8f * speedMultiplier;
-        enemy.health = std::max(1, (int)(150 * healthMultiplier * waveMultiplier));
-        enemy.maxHealth = enemy.health;
-        enemy.damage = std::max(1, (int)(15 * damageMultiplier * waveMultiplier));
-        enemy.attackRange = 25.0f * SIZE_MULTIPLIER;
-        enemy.isRanged = false;
-        enemy.attackCooldown = 1.0f / waveMultiplier;
-        break;
-    }
+struct AudioCommandQueue {
+    AudioCommand commands[AUDIO_QUEUE_SIZE];
+    std::atomic<unsigned int> head;     // Пишет главный поток
+    std::atomic<unsigned int> tail;     // Пишет микшер
+    std::atomic<unsigned int> dropped;
+};
 
-    enemy.lastAttackTime = -enemy.attackCooldown;
-    return enemy;
+bool PushAudioCommand(AudioCommandQueue& queue, const AudioCommand& command) {
+    unsigned int head = queue.head.load(std::memory_order_relaxed);
+    if (head - queue.tail.load(std::memory_order_acquire) >= (unsigned int)AUDIO_QUEUE_SIZE) {
+        queue.dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    queue.commands[head & (AUDIO_QUEUE_SIZE - 1)] = command;
+    queue.head.store(head + 1, std::memory_order_release);
+    return true;
 }
 
-void UpdateEnemies(std::vector<Enemy>& enemies, Player& player, double currentTime, const std::vector<FreezeArea>& freezeAreas) {
-    for (auto& enemy : enemies) {
-        enemy.isFrozen = false;
-        for (const auto& freeze : freezeAreas) {
-            if (Vector2Distance(enemy.position, freeze.position) <= freeze.radius) {
-                enemy.isFrozen = true;
-                enemy.frozenUntil = currentTime + 0.1;
-                break;
-            }
-        }
+bool PopAudioCommand(AudioCommandQueue& queue, AudioCommand& command) {
+    unsigned int tail = queue.tail.load(std::memory_order_relaxed);
+    if (tail == queue.head.load(std::memory_order_acquire)) return false;
+    command = queue.commands[tail & (AUDIO_QUEUE_SIZE - 1)];
+    queue.tail.store(tail + 1, std::memory_order_release);
+    return true;
+}
 
-        if (!enemy.isFrozen || currentTime > enemy.frozenUntil) {
-            Vector2 direction = Vector2Subtract(player.position, enemy.position);
-            float distance = Vector2Length(direction);
+// Голос принадлежит потоку микшера
+struct AudioVoice {
+    int sound;
+    int position;
+    float gainLeft;
+    float gainRight;
+    unsigned int startOrder;
+    bool active;
+};
 
-            if (distance > enemy.attackRange) {
-                if (distance > 0) {
-                    direction.x /= distance;
-                    direction.y /= distance;
-                }
+enum AudioOutputKind {
+    AUDIO_OUTPUT_NULL,       // Без устройства: блоки считаются и выбрасываются в реальном темпе
+    AUDIO_OUTPUT_DEVICE
+};
 
-                enemy.position.x += direction.x * enemy.speed;
-                enemy.position.y += direction.y * enemy.speed;
-            }
-            else if (currentTime - enemy.lastAttackTime > enemy.attackCooldown) {
-                if (enemy.isRanged) {
-                    Vector2 projDirection = Vector2Normalize(direction);
-                    EnemyProjectile projectile;
-                    projectile.position = enemy.position;
-                    projectile.velocity.x = projDirection.x * 4.0f;
-                    projectile.velocity.y = projDirection.y * 4.0f;
-                    projectile.radius = 7.0f * SIZE_MULTIPLIER;
-                    projectile.damage = enemy.damage;
+struct AudioSystem {
+    SoundClip clips[SOUND_COUNT];
+    AudioCommandQueue queue;
+    AudioVoice voices[AUDIO_VOICE_COUNT];
+    unsigned int voiceOrder;
+    AudioOutputKind output;
+    AudioStream stream;
+    std::thread thread;
+    std::atomic<bool> stopping;
+    std::vector<float> mixBuffer;
+    std::vector<short> outputBuffer;
+
+    // Пишет микшер, читать можно откуда угодно
+    std::atomic<long long> blocksMixed;
+    std::atomic<long long> mixNanoseconds;
+    std::atomic<long long> voicesStarted;
+    std::atomic<long long> voicesStolen;
+    std::atomic<int> maxActiveVoices;
+    std::atomic<int> peakSample;
+    std::atomic<long long> clippedBlocks;   // Блоки, где выход уперся в предел PCM16
+    float limiterGain;                      // Состояние ограничителя (поток микшера)
+
+    // Пишет главный поток
+    long long eventsConsumed;
+    long long commandsSent;
+};
 
-                    enemy.projectiles.push_back(projectile);
-                }
-                else {
-                    player.health -= enemy.damage;
-                }
+// Короткие процедурные звуки на случай, если в пакете их нет
+void SynthesizeSound(SoundId sound, std::vector<short>& samples) {
+    const float durations[SOUND_COUNT] = { 0.06f, 0.04f, 0.15f, 0.2f, 0.25f, 0.6f };
+    int frameCount = (int)(durations[sound] * AUDIO_SAMPLE_RATE);
+    samples.resize(frameCount);
+
+    unsigned int noise = 0x12345678u + (unsigned int)sound;
+    float phase = 0.0f;
+    float filtered = 0.0f;
+    for (int i = 0; i < frameCount; i++) {
+        float t = (float)i / AUDIO_SAMPLE_RATE;
+        float progress = (float)i / frameCount;
+        noise ^= noise << 13;
+        noise ^= noise >> 17;
+        noise ^= noise << 5;
+        float white = (float)(noise & 0xFFFF) / 32768.0f - 1.0f;
+
+        float value = 0.0f;
+        float frequency = 0.0f;
+        switch (sound) {
+        case SOUND_SHOT:
+            frequency = 880.0f - 440.0f * progress;
+            value = (sinf(phase) > 0.0f ? 0.5f : -0.5f) * (1.0f - progress);
+            break;
+        case SOUND_HIT:
+            value = white * 0.6f * (1.0f - progress) * (1.0f - progress);
+            break;
+        case SOUND_KILL:
+            frequency = 300.0f - 180.0f * progress;
+            value = (sinf(phase) * 0.7f + white * 0.2f) * (1.0f - progress);
+            break;
+        case SOUND_PLAYER_HIT:
+            frequency = 110.0f;
+            value = (sinf(phase) > 0.0f ? 0.6f : -0.6f) * expf(-6.0f * t);
+            break;
+        case SOUND_UPGRADE:
+            frequency = progress < 0.5f ? 660.0f : 990.0f;
+            value = sinf(phase) * 0.6f * (1.0f - progress);
+            break;
+        case SOUND_EXPLOSION:
+        default:
+            filtered += (white - filtered) * 0.08f;
+            value = filtered * 2.5f * expf(-5.0f * t);
+            break;
+        }
+        phase += 2.0f * PI * frequency / AUDIO_SAMPLE_RATE;
+        value = std::max(-1.0f, std::min(1.0f, value));
+        samples[i] = (short)(value * 32767.0f);
+    }
+}
 
-                enemy.lastAttackTime = currentTime;
-            }
+void StartVoice(AudioSystem& audio, const AudioCommand& command) {
+    // Свободный голос; при превышении лимита вида или полном пуле - самый старый
+    int sameSound = 0;
+    int oldestSame = -1;
+    int oldest = -1;
+    int free = -1;
+    for (int i = 0; i < AUDIO_VOICE_COUNT; i++) {
+        const AudioVoice& voice = audio.voices[i];
+        if (!voice.active) {
+            if (free < 0) free = i;
+            continue;
         }
+        if (oldest < 0 || voice.startOrder < audio.voices[oldest].startOrder) oldest = i;
+        if (voice.sound == command.sound) {
+            sameSound++;
+            if (oldestSame < 0 || voice.startOrder < audio.voices[oldestSame].startOrder) oldestSame = i;
+        }
+    }
 
-        for (auto it = enemy.projectiles.begin(); it != enemy.projectiles.end();) {
-            if (it == enemy.projectiles.end()) break;
+    int index = free;
+    if (sameSound >= AUDIO_VOICES_PER_SOUND) index = oldestSame;
+    else if (index < 0) index = oldest;
+    if (audio.voices[index].active) {
+        audio.voicesStolen.fetch_add(1, std::memory_order_relaxed);
+    }
 
-            it->position.x += it->velocity.x;
-            it->position.y += it->velocity.y;
+    // Панорама с постоянной мощностью
+    float angle = (std::max(-1.0f, std::min(1.0f, command.pan)) + 1.0f) * PI / 4.0f;
+    AudioVoice& voice = audio.voices[index];
+    voice.sound = command.sound;
+    voice.position = 0;
+    voice.gainLeft = command.gain * cosf(angle);
+    voice.gainRight = command.gain * sinf(angle);
+    voice.startOrder = audio.voiceOrder++;
+    voice.active = true;
+    audio.voicesStarted.fetch_add(1, std::memory_order_relaxed);
+}
 
-            int screenWidth = GetScreenWidth();
-            int screenHeight = GetScreenHeight();
+void MixAudioBlock(AudioSystem& audio) {
+    auto start = std::chrono::steady_clock::now();
 
-            if (it->position.x < 0 || it->position.x > screenWidth ||
-                it->position.y < 0 || it->position.y > screenHeight) {
-                it = enemy.projectiles.erase(it);
-            }
-            else {
-                ++it;
-            }
-        }
+    AudioCommand command;
+    while (PopAudioCommand(audio.queue, command)) {
+        StartVoice(audio, command);
     }
-}
 
-void DrawEnemies(const std::vector<Enemy>& enemies) {
-    for (const auto& enemy : enemies) {
-        Color enemyColor = enemy.color;
-        if (enemy.isFrozen) {
-            enemyColor = BLUE;
+    float* mix = audio.mixBuffer.data();
+    std::fill(audio.mixBuffer.begin(), audio.mixBuffer.end(), 0.0f);
+    int activeVoices = 0;
+    for (int v = 0; v < AUDIO_VOICE_COUNT; v++) {
+        AudioVoice& voice = audio.voices[v];
+        if (!voice.active) continue;
+        activeVoices++;
+
+        const SoundClip& clip = audio.clips[voice.sound];
+        int frames = std::min(AUDIO_BLOCK_FRAMES, clip.frameCount - voice.position);
+        const short* samples = clip.samples + voice.position;
+        const float scale = 1.0f / 32768.0f;
+        for (int i = 0; i < frames; i++) {
+            float sample = samples[i] * scale;
+            mix[2 * i] += sample * voice.gainLeft;
+            mix[2 * i + 1] += sample * voice.gainRight;
         }
+        voice.position += frames;
+        if (voice.position >= clip.frameCount) voice.active = false;
+    }
 
-        DrawCircleV(enemy.position, enemy.radius, enemyColor);
+    // Ограничитель пиков: усиление падает сразу до уровня, при котором пик блока не выше
+    // AUDIO_LIMITER_CEILING, и плавно возвращается к 1 по блокам. Внутри блока усиление
+    // меняется линейно между значениями, которые оба не превышают допустимое
+    float mixPeak = 0.0f;
+    for (int i = 0; i < 2 * AUDIO_BLOCK_FRAMES; i++) {
+        mixPeak = std::max(mixPeak, fabsf(mix[i]));
+    }
+    float allowed = mixPeak * AUDIO_MASTER_GAIN > AUDIO_LIMITER_CEILING ? AUDIO_LIMITER_CEILING / (mixPeak * AUDIO_MASTER_GAIN) : 1.0f;
+    float targetGain = std::min(allowed, audio.limiterGain + AUDIO_LIMITER_RELEASE);
+    float gain = std::min(audio.limiterGain, targetGain);
+    float gainStep = (targetGain - gain) / AUDIO_BLOCK_FRAMES;
+    audio.limiterGain = targetGain;
+
+    int peak = 0;
+    for (int i = 0; i < AUDIO_BLOCK_FRAMES; i++) {
+        for (int channel = 0; channel < 2; channel++) {
+            int value = (int)(std::max(-1.0f, std::min(1.0f, mix[2 * i + channel] * AUDIO_MASTER_GAIN * gain)) * 32767.0f);
+            audio.outputBuffer[2 * i + channel] = (short)value;
+            peak = std::max(peak, abs(value));
+        }
+        gain += gainStep;
+    }
+    if (peak >= 32767) {
+        audio.clippedBlocks.fetch_add(1, std::memory_order_relaxed);
+    }
 
-        float healthBarWidth = 30.0f * SIZE_MULTIPLIER;
-        float healthBarHeight = 4.0f * SIZE_MULTIPLIER;
-        Vector2 healthBarPos = {
-                enemy.position.x - healthBarWidth / 2,
-                enemy.position.y - enemy.radius - 12.0f * SIZE_MULTIPLIER
-        };
+    if (activeVoices > audio.maxActiveVoices.load(std::memory_order_relaxed)) {
+        audio.maxActiveVoices.store(activeVoices, std::memory_order_relaxed);
+    }
+    if (peak > audio.peakSample.load(std::memory_order_relaxed)) {
+        audio.peakSample.store(peak, std::memory_order_relaxed);
+    }
+    audio.mixNanoseconds.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count(),
+        std::memory_order_relaxed);
+    audio.blocksMixed.fetch_add(1, std::memory_order_relaxed);
+}
 
-        DrawRectangle((int)healthBarPos.x, (int)healthBarPos.y, (int)healthBarWidth, (int)healthBarHeight, RED);
-        DrawRectangle((int)healthBarPos.x, (int)healthBarPos.y, (int)(healthBarWidth * (enemy.health / (float)enemy.maxHealth)), (int)healthBarHeight, GREEN);
+void AudioMixerLoop(AudioSystem* audio) {
+    const auto blockDuration = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>((double)AUDIO_BLOCK_FRAMES / AUDIO_SAMPLE_RATE));
+    auto nextBlock = std::chrono::steady_clock::now();
 
-        for (const auto& projectile : enemy.projectiles) {
-            DrawCircleV(projectile.position, projectile.radius, COLOR_PROJECTILE);
+    while (!audio->stopping.load(std::memory_order_acquire)) {
+        if (audio->output == AUDIO_OUTPUT_DEVICE) {
+            // Устройство само задает темп: новый блок, когда освободился буфер потока
+            if (!IsAudioStreamProcessed(audio->stream)) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+                continue;
+            }
+            MixAudioBlock(*audio);
+            UpdateAudioStream(audio->stream, audio->outputBuffer.data(), AUDIO_BLOCK_FRAMES);
+        }
+        else {
+            MixAudioBlock(*audio);
+            nextBlock += blockDuration;
+            std::this_thread::sleep_until(nextBlock);
         }
     }
 }
 
-// Функции для улучшений
-Upgrade CreateUpgrade(Vector2 position) {
-    Upgrade upgrade;
-    upgrade.position = position;
-    upgrade.radius = 10.0f * SIZE_MULTIPLIER;
-
-    int type = GetRandomValue(0, 9); // Добавили UPGRADE_PROJECTILE_COUNT
-    switch (type) {
-    case 0:
-        upgrade.type = UPGRADE_HEALTH;
-        upgrade.color = COLOR_UPGRADE_HEALTH;
-        break;
-    case 1:
-        upgrade.type = UPGRADE_ATTACK_SPEED;
-        upgrade.color = COLOR_UPGRADE_ATTACK_SPEED;
-        break;
-    case 2:
-        upgrade.type = UPGRADE_DAMAGE;
-        upgrade.color = COLOR_UPGRADE_DAMAGE;
-        break;
-    case 3:
-        upgrade.type = UPGRADE_SPEED;
-        upgrade.color = COLOR_UPGRADE_SPEED;
-        break;
-    case 4:
-        upgrade.type = UPGRADE_WAVE;
-        upgrade.color = COLOR_UPGRADE_WAVE;
-        break;
-    case 5:
-        upgrade.type = UPGRADE_DOUBLE_SHOT;
-        upgrade.color = COLOR_UPGRADE_DOUBLE_SHOT;
-        break;
-    case 6:
-        upgrade.type = UPGRADE_BOMB;
-        upgrade.color = COLOR_UPGRADE_BOMB;
-        break;
-    case 7:
-        upgrade.type = UPGRADE_FREEZE;
-        upgrade.color = COLOR_UPGRADE_FREEZE;
-        break;
-    case 8:
-        upgrade.type = UPGRADE_FIREBALL;
-        upgrade.color = COLOR_UPGRADE_FIREBALL;
-        break;
-    case 9:
-        upgrade.type = UPGRADE_PROJECTILE_COUNT;
-        upgrade.color = COLOR_PROJECTILE_COUNT;
-        break;
+// Звуки берутся из пакета по именам SOUND_NAMES, недостающие генерируются.
+// Пакет должен жить, пока работает микшер
+void StartAudio(AudioSystem& audio, const AssetLoader& assets, AudioOutputKind output) {
+    int fromPack = 0;
+    for (int i = 0; i < SOUND_COUNT; i++) {
+        SoundClip& clip = audio.clips[i];
+        Wave wave;
+        if (FindAssetSound(assets, SOUND_NAMES[i], wave) && wave.sampleRate == (unsigned int)AUDIO_SAMPLE_RATE &&
+            wave.channels == 1 && wave.frameCount > 0) {
+            clip.samples = (const short*)wave.data;
+            clip.frameCount = (int)wave.frameCount;
+            fromPack++;
+        }
+        else {
+            SynthesizeSound((SoundId)i, clip.generated);
+            clip.samples = clip.generated.data();
+            clip.frameCount = (int)clip.generated.size();
+        }
     }
 
-    return upgrade;
+    audio.queue.head = 0;
+    audio.queue.tail = 0;
+    audio.queue.dropped = 0;
+    for (int i = 0; i < AUDIO_VOICE_COUNT; i++) {
+        audio.voices[i].active = false;
+    }
+    audio.voiceOrder = 0;
+    audio.mixBuffer.assign(2 * AUDIO_BLOCK_FRAMES, 0.0f);
+    audio.outputBuffer.assign(2 * AUDIO_BLOCK_FRAMES, 0);
+    audio.blocksMixed = 0;
+    audio.mixNanoseconds = 0;
+    audio.voicesStarted = 0;
+    audio.voicesStolen = 0;
+    audio.maxActiveVoices = 0;
+    audio.peakSample = 0;
+    audio.clippedBlocks = 0;
+    audio.limiterGain = 1.0f;
+    audio.eventsConsumed = 0;
+    audio.commandsSent = 0;
+
+    audio.output = output;
+    if (output == AUDIO_OUTPUT_DEVICE) {
+        SetAudioStreamBufferSizeDefault(AUDIO_BLOCK_FRAMES);
+        audio.stream = LoadAudioStream((unsigned int)AUDIO_SAMPLE_RATE, 16, 2);
+        PlayAudioStream(audio.stream);
+    }
+    audio.stopping = false;
+    audio.thread = std::thread(AudioMixerLoop, &audio);
+    TraceLog(LOG_INFO, "AUDIO: %s output, %d of %d sounds from pack, %d voices",
+        output == AUDIO_OUTPUT_DEVICE ? "device" : "null", fromPack, SOUND_COUNT, AUDIO_VOICE_COUNT);
 }
 
-void ApplyUpgrade(Upgrade& upgrade, Player& player, MetaProgression& meta) {
-    switch (upgrade.type) {
-    case UPGRADE_HEALTH:
-        player.maxHealth += 10;
-        player.health = std::min(player.maxHealth, player.health + 20);
-        break;
-
-    case UPGRADE_ATTACK_SPEED:
-        player.attackSpeed += 0.2f;
-        break;
-
-    case UPGRADE_DAMAGE:
-        player.damage += 5;
-        break;
-
-    case UPGRADE_SPEED:
-        player.speed += 0.5f;
-        break;
+void StopAudio(AudioSystem& audio) {
+    if (!audio.thread.joinable()) return;
+    audio.stopping.store(true, std::memory_order_release);
+    audio.thread.join();
+    if (audio.output == AUDIO_OUTPUT_DEVICE) {
+        StopAudioStream(audio.stream);
+        UnloadAudioStream(audio.stream);
+    }
+}
 
-    case UPGRADE_WAVE:
-        if (!player.hasWaveAttack) {
-            player.hasWaveAttack = true;
+// Потребитель событий (главный поток, раз в тик): события одного вида сливаются
+// в одну команду с громкостью, растущей как логарифм их числа.
+// listenerX и halfWidth задают панораму относительно центра экрана
+void ConsumeAudioEvents(const EventBatch& batch, AudioSystem& audio, float listenerX, float halfWidth) {
+    if (!audio.thread.joinable()) return;
+
+    int counts[SOUND_COUNT] = {};
+    float positionSum[SOUND_COUNT] = {};
+    for (const auto& event : batch) {
+        int sound = -1;
+        switch (event.type) {
+        case EVENT_DAMAGE_DEALT: sound = SOUND_HIT; break;
+        case EVENT_ENEMY_KILLED: sound = SOUND_KILL; break;
+        case EVENT_PLAYER_HIT: sound = SOUND_PLAYER_HIT; break;
+        case EVENT_UPGRADE_COLLECTED: sound = SOUND_UPGRADE; break;
+        case EVENT_EXPLOSION: sound = SOUND_EXPLOSION; break;
+        case EVENT_SHOT: sound = SOUND_SHOT; break;
         }
-        else {
-            player.waveCooldown = std::max(10.0, player.waveCooldown * 0.8f);
-            player.waveDamage += 10;
+        if (sound < 0) continue;
+        counts[sound]++;
+        positionSum[sound] += event.position.x;
+    }
+    audio.eventsConsumed += (long long)batch.size();
+
+    for (int sound = 0; sound < SOUND_COUNT; sound++) {
+        if (counts[sound] == 0) continue;
+        AudioCommand command;
+        command.sound = (unsigned char)sound;
+        command.gain = SOUND_BASE_GAIN[sound] * std::min(AUDIO_MAX_COALESCED_GAIN, 1.0f + 0.25f * log2f((float)counts[sound]));
+        command.pan = halfWidth > 0.0f ? (positionSum[sound] / counts[sound] - listenerX) / halfWidth : 0.0f;
+        if (PushAudioCommand(audio.queue, command)) {
+            audio.commandsSent++;
         }
-        break;
-
-    case UPGRADE_DOUBLE_SHOT:
-        player.hasDoubleShot = true;
-        break;
+    }
+}
 
-    case UPGRADE_BOMB:
-        if (!player.hasBombAttack) {
-            player.hasBombAttack = true;
-        }
-        else {
-            player.bombCooldown = std::max(8.0, player.bombCooldown * 0.8f);
-            player.bombDamage += 10;
-            player.bombRadius += 10.0f * SIZE_MULTIPLIER;
+// Проверка звука без устройства: поток событий растет от единиц до десятков тысяч за тик,
+// команд в микшер не больше SOUND_COUNT за тик, выход не упирается в предел PCM16,
+// время микширования блока не растет (сравнение с уровнем, где пул голосов уже заполнен)
+// --audio-selftest [секунд на уровень]
+const double AUDIO_SELFTEST_MAX_CLIPPED = 0.01;     // Доля блоков с перегрузкой
+const double AUDIO_SELFTEST_MIX_GROWTH = 2.0;       // Допустимый рост времени микширования
+int RunAudioSelfTest(int argc, char** argv) {
+    double secondsPerLevel = argc > 2 ? atof(argv[2]) : 1.0;
+    secondsPerLevel = std::max(0.1, secondsPerLevel);
+    const int levels[] = { 1, 10, 100, 1000, 10000, 50000 };
+    const int levelCount = sizeof(levels) / sizeof(levels[0]);
+    const GameEventType types[] = { EVENT_SHOT, EVENT_DAMAGE_DEALT, EVENT_DAMAGE_DEALT, EVENT_ENEMY_KILLED, EVENT_EXPLOSION,
+        EVENT_PLAYER_HIT, EVENT_UPGRADE_COLLECTED };
+    const int typeCount = sizeof(types) / sizeof(types[0]);
+
+    AssetLoader assets;
+    assets.state = ASSETS_FAILED;
+    assets.entries = nullptr;
+    assets.entryCount = 0;
+    assets.file.data = nullptr;
+    assets.file.size = 0;
+    AudioSystem audio;
+    StartAudio(audio, assets, AUDIO_OUTPUT_NULL);
+
+    EventBatch batch;
+    bool passed = true;
+    double referenceMixUs = 0.0;
+    double worstMixGrowth = 0.0;
+    int ticksPerLevel = (int)(secondsPerLevel * SIM_TICK_RATE);
+    printf("events_per_tick,ticks,commands_per_tick,blocks,mix_us_per_block,voices_started,voices_stolen,max_active_voices,peak,clipped_blocks\n");
+    for (int level = 0; level < levelCount; level++) {
+        long long commandsBefore = audio.commandsSent;
+        long long blocksBefore = audio.blocksMixed.load();
+        long long mixBefore = audio.mixNanoseconds.load();
+        long long startedBefore = audio.voicesStarted.load();
+        long long stolenBefore = audio.voicesStolen.load();
+        long long clippedBefore = audio.clippedBlocks.load();
+        audio.maxActiveVoices = 0;
+        audio.peakSample = 0;
+
+        auto nextTick = std::chrono::steady_clock::now();
+        for (int tick = 0; tick < ticksPerLevel; tick++) {
+            batch.clear();
+            for (int i = 0; i < levels[level]; i++) {
+                GameEvent event = { types[(i + tick) % typeCount], 0, 10, { (float)(i % 1920), 540.0f } };
+                batch.push_back(event);
+            }
+            ConsumeAudioEvents(batch, audio, 960.0f, 960.0f);
+            nextTick += std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(SIM_TICK_SECONDS));
+            std::this_thread::sleep_until(nextTick);
         }
-        break;
 
-    case UPGRADE_FREEZE:
-        if (!player.hasFreezeAttack) {
-            player.hasFreezeAttack = true;
+        long long commands = audio.commandsSent - commandsBefore;
+        long long blocks = audio.blocksMixed.load() - blocksBefore;
+        double mixUs = blocks > 0 ? (audio.mixNanoseconds.load() - mixBefore) / 1000.0 / blocks : 0.0;
+        double commandsPerTick = (double)commands / ticksPerLevel;
+        int maxActive = audio.maxActiveVoices.load();
+        long long clipped = audio.clippedBlocks.load() - clippedBefore;
+        printf("%d,%d,%.2f,%lld,%.2f,%lld,%lld,%d,%d,%lld\n", levels[level], ticksPerLevel, commandsPerTick, blocks, mixUs,
+            audio.voicesStarted.load() - startedBefore, audio.voicesStolen.load() - stolenBefore, maxActive, audio.peakSample.load(),
+            clipped);
+        fflush(stdout);
+
+        if (commandsPerTick > SOUND_COUNT || maxActive > AUDIO_VOICE_COUNT || blocks == 0 || audio.peakSample.load() == 0) {
+            passed = false;
         }
-        else {
-            player.freezeCooldown = std::max(12.0, player.freezeCooldown * 0.8f);
-            player.freezeDuration += 0.5f;
-            player.freezeRadius += 15.0f * SIZE_MULTIPLIER;
+        if (blocks > 0 && (double)clipped / blocks > AUDIO_SELFTEST_MAX_CLIPPED) {
+            passed = false;
         }
-        break;
 
-    case UPGRADE_FIREBALL:
-        if (!player.hasFireballAttack) {
-            player.hasFireballAttack = true;
+        // Первые уровни заполняют пул голосов; дальше время блока не должно зависеть от событий
+        if (level == 1) {
+            referenceMixUs = mixUs;
         }
-        else {
-            player.fireballCooldown = std::max(4.0, player.fireballCooldown * 0.8f);
-            player.fireballDamage += 5;
-            player.fireballExplosionRadius += 10.0f * SIZE_MULTIPLIER;
+        else if (level > 1 && referenceMixUs > 0.0) {
+            worstMixGrowth = std::max(worstMixGrowth, mixUs / referenceMixUs);
         }
-        break;
+    }
+    if (worstMixGrowth > AUDIO_SELFTEST_MIX_GROWTH) passed = false;
+    unsigned int dropped = audio.queue.dropped.load();
+    StopAudio(audio);
+
+    if (dropped > 0) passed = false;
+    printf("%s: %u commands dropped, mix time %.2f us per block at %d events, worst growth x%.2f (limit x%.1f)\n",
+        passed ? "PASS" : "FAIL", dropped, referenceMixUs, levels[1], worstMixGrowth, AUDIO_SELFTEST_MIX_GROWTH);
+    return passed ? 0 : 1;
+}
 
-    case UPGRADE_PROJECTILE_COUNT:
-        player.projectileCount++;
-        break;
+// Замеры запуска: от старта процесса до окна, первого кадра и до момента,
+// когда меню принимает ввод (ресурсы загружены)
+struct StartupReport {
+    double windowSeconds;
+    double firstFrameSeconds;
+    double interactiveSeconds;
+    bool reported;
+};
+
+StartupReport CreateStartupReport() {
+    StartupReport report = { -1.0, -1.0, -1.0, false };
+    return report;
+}
+
+// Вызывается после каждого показанного кадра меню до первого интерактивного
+void MarkStartupFrame(StartupReport& report, const AssetLoader& assets, bool interactive) {
+    if (report.reported) return;
+    double now = GetStartupSeconds();
+    if (report.firstFrameSeconds < 0.0) {
+        report.firstFrameSeconds = now;
     }
+    if (!interactive) return;
+
+    report.interactiveSeconds = now;
+    report.reported = true;
+    bool loaded = assets.state.load(std::memory_order_acquire) == ASSETS_READY;
+    TraceLog(LOG_INFO, "STARTUP: window %.1f ms, first frame %.1f ms, interactive %.1f ms",
+        report.windowSeconds * 1000.0, report.firstFrameSeconds * 1000.0, report.interactiveSeconds * 1000.0);
+    TraceLog(LOG_INFO, "STARTUP: pack %s %s: %d assets, %.1f KB, mapped in %.1f ms, GPU upload %.1f ms, ready %.1f ms",
+        assets.path.c_str(), loaded ? "loaded" : "missing", assets.entryCount, assets.file.size / 1024.0,
+        loaded ? (assets.mappedSeconds - assets.startSeconds) * 1000.0 : 0.0, assets.uploadMs, assets.readySeconds * 1000.0);
 }
 
-void DrawUpgrades(const std::vector<Upgrade>& upgrades) {
-    for (const auto& upgrade : upgrades) {
-        if (upgrade.type >= UPGRADE_WAVE) {
-            DrawRectangle((int)(upgrade.position.x - upgrade.radius), (int)(upgrade.position.y - upgrade.radius),
-                (int)(upgrade.radius * 2), (int)(upgrade.radius * 2), upgrade.color);
-        }
-        else {
-            DrawCircleV(upgrade.position, upgrade.radius, upgrade.color);
-        }
+// Бенчмарк обновления врагов без окна
+struct EnemyBenchResult {
+    double msPerFrame;
+    double meanDistance;  // Средняя дистанция до игрока в конце (для сравнения поведения)
+};
+
+EnemyBenchResult BenchEnemyUpdates(int enemyCount, int frameCount, bool lodEnabled) {
+    std::mt19937 rng(12345);
+    std::uniform_real_distribution<float> positionX(0.0f, WORLD_WIDTH);
+    std::uniform_real_distribution<float> positionY(0.0f, WORLD_HEIGHT);
+    std::uniform_int_distribution<int> enemyType(0, 2);
+
+    EnemyArchetypeTable archetypes;
+    ComponentPool<Enemy> enemies;
+    enemies.reserve(enemyCount);
+    for (int i = 0; i < enemyCount; i++) {
+        Vector2 position = { positionX(rng), positionY(rng) };
+        enemies.push_back(CreateEnemy(archetypes, (EnemyType)enemyType(rng), position, 0.5f, 20));
+    }
+
+    MetaProgression meta = { 0, 0, 0, 0, 0, 0, 0, false, false, false };
+    Player player = CreatePlayer(meta);
+    ComponentPool<EnemyProjectile> projectiles;
+    EnemyMoveBatch moveBatch;
+    EventBus events;
+    EventBatch eventBatch;
+
+    Rectangle view = { player.position.x - 960.0f, player.position.y - 540.0f, 1920.0f, 1080.0f };
+    ChunkGrid grid = CreateChunkGrid();
+    if (lodEnabled) {
+        SetActiveChunks(grid, view);
+    }
+    else {
+        DisableEnemyLod(grid);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < frameCount; frame++) {
+        BuildChunkGrid(grid, enemies);
+        UpdateEnemies(enemies, archetypes, &player, 1, projectiles, grid, moveBatch, frame, events);
+        UpdateEnemyProjectiles(projectiles, enemies, GetActiveArea(grid));
+        DrainEvents(events, eventBatch);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double totalDistance = 0.0;
+    for (const auto& enemy : enemies) {
+        totalDistance += Vector2Distance(GetEnemyPosition(enemy), player.position);
     }
+
+    EnemyBenchResult result;
+    result.msPerFrame = std::chrono::duration<double, std::milli>(end - start).count() / frameCount;
+    result.meanDistance = enemies.empty() ? 0.0 : totalDistance / enemies.size();
+    return result;
 }
 
-// Безопасная проверка коллизий
-void CheckCollisions(Player& player, std::vector<Bullet>& bullets, std::vector<Enemy>& enemies,
-    std::vector<Upgrade>& upgrades, std::vector<Shockwave>& shockwaves,
-    std::vector<Bomb>& bombs, std::vector<FreezeArea>& freezeAreas,
-    std::vector<Fireball>& fireballs, int& score, MetaProgression& meta) {
+// --bench-enemies [количество] [кадры]
+int RunEnemyBenchmark(int argc, char** argv) {
+    int enemyCount = argc > 2 ? atoi(argv[2]) : 50000;
+    int frameCount = argc > 3 ? atoi(argv[3]) : 600;
+    enemyCount = std::max(1, enemyCount);
+    frameCount = std::max(1, frameCount);
+
+    EnemyBenchResult full = BenchEnemyUpdates(enemyCount, frameCount, false);
+    EnemyBenchResult lod = BenchEnemyUpdates(enemyCount, frameCount, true);
+
+    printf("Enemies: %d, frames: %d\n", enemyCount, frameCount);
+    printf("Full update: %.3f ms/frame (%.0f enemies/ms), mean distance %.1f\n",
+        full.msPerFrame, enemyCount / full.msPerFrame, full.meanDistance);
+    printf("LOD update:  %.3f ms/frame (%.0f enemies/ms), mean distance %.1f\n",
+        lod.msPerFrame, enemyCount / lod.msPerFrame, lod.meanDistance);
+    printf("Speedup: x%.2f\n", full.msPerFrame / lod.msPerFrame);
+    return 0;
+}
 
-    // Пули - враги
-    for (auto bulletIt = bullets.begin(); bulletIt != bullets.end();) {
-        bool bulletHit = false;
+// Безголовый прогон одной волны через системы мира с проверкой счетчиков.
+// Волна перезапускается при зачистке, игрок не умирает (события урона не применяются)
+// --bench-wave [волна] [кадры] [лимит проверок коллизий за тик]
+int RunWaveBenchmark(int argc, char** argv) {
+    int waveNumber = argc > 2 ? atoi(argv[2]) : 40;
+    int frameCount = argc > 3 ? atoi(argv[3]) : 1200;
+    long long maxCollisionTests = argc > 4 ? atoll(argv[4]) : 50000;
+    waveNumber = std::max(1, waveNumber);
+    frameCount = std::max(1, frameCount);
 
-        for (auto enemyIt = enemies.begin(); enemyIt != enemies.end();) {
-            if (bulletIt == bullets.end() || enemyIt == enemies.end()) break;
+    MetaProgression meta = { 0, 0, 0, 0, 0, 0, 0, false, false, false };
+    World world;
+    world.chunkGrid = CreateChunkGrid();
+    ResetWorld(world, &meta, 1);
+
+    SystemScheduler schedule = CreateGameplaySchedule();
+    TaskPool pool;
+    StartTaskPool(pool, GetDefaultWorkerCount());
+    PlayerInput input = { 0, 0 };
+    StatsState stats;
+    ResetStats(stats);
+    EventBatch eventBatch;
+
+    TimerBatch firedTimers;
+
+    WavePlan plan = { {}, 0, 0 };
+    SimRandom random = CreateSimRandom(1);
+    double spawnCooldown = 0.0;
+    int enemyCount = 5 + waveNumber * 2;
+    PlanWave(plan, world.archetypes, random, waveNumber, enemyCount, 0, spawnCooldown, true);
+
+    // Одну и ту же волну бенчмарк перезапускает сам, поэтому расписание опрашивается напрямую
+    auto start = std::chrono::steady_clock::now();
+    for (int tick = 1; tick <= frameCount; tick++) {
+        AdvanceTimers(world.timers, tick, firedTimers);
+        DispatchWorldTimers(world, firedTimers);
+        if (world.enemies.empty() && !IsWaveSpawning(plan)) {
+            PlanWave(plan, world.archetypes, random, waveNumber, enemyCount, tick, spawnCooldown, true);
+        }
+        Rectangle view = GetCameraView(world.camera);
+        SpawnDueEnemies(plan, world.archetypes, tick, &view, 1, world.enemies);
 
-            float distance = Vector2Distance(bulletIt->position, enemyIt->position);
+        FrameContext frame = { (unsigned int)tick, SIM_TICK_SECONDS, &input };
+        RunSchedule(schedule, pool, world, frame);
+        DrainEvents(world.events, eventBatch);
+        EndStatsTick(stats, SIM_TICK_SECONDS);
+    }
+    auto end = std::chrono::steady_clock::now();
+    StopTaskPool(pool);
+
+    printf("Wave: %d, frames: %d, %.3f ms/frame\n", waveNumber, frameCount,
+        std::chrono::duration<double, std::milli>(end - start).count() / frameCount);
+    for (int counter = 0; counter < STAT_COUNT; counter++) {
+        printf("%-20s total %12lld  per tick %10.1f  peak tick %10lld\n", STAT_NAMES[counter],
+            GetStat(stats, (StatCounter)counter, STAT_WINDOW_TOTAL),
+            GetStat(stats, (StatCounter)counter, STAT_WINDOW_TOTAL) / (double)stats.ticks,
+            GetStat(stats, (StatCounter)counter, STAT_WINDOW_PEAK_TICK));
+    }
+    PrintMemoryReport(stdout);
+
+#if ENABLE_STATS
+    long long peakTests = GetStat(stats, STAT_COLLISION_TESTS, STAT_WINDOW_PEAK_TICK);
+    bool passed = peakTests < maxCollisionTests;
+    printf("%s: collision tests per tick %lld (limit %lld)\n", passed ? "PASS" : "FAIL", peakTests, maxCollisionTests);
+    return passed ? 0 : 1;
+#else
+    printf("SKIP: stats compiled out\n");
+    return 0;
+#endif
+}
 
-            if (distance < bulletIt->radius + enemyIt->radius) {
-                enemyIt->health -= bulletIt->damage;
-                bulletHit = true;
+// Пиковое потребление памяти процессом (байты)
+size_t GetPeakMemoryBytes() {
+#if defined(_WIN32)
+    ProcessMemoryCounters counters;
+    memset(&counters, 0, sizeof(counters));
+    counters.cb = sizeof(counters);
+    if (K32GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return counters.peakWorkingSetSize;
+    }
+    return 0;
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+    return (size_t)usage.ru_maxrss;
+#else
+    return (size_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
 
-                if (enemyIt->health <= 0) {
-                    switch (enemyIt->type) {
-                    case ENEMY_GREEN: score += 10; break;
-                    case ENEMY_PURPLE: score += 20; break;
-                    case ENEMY_RED: score += 50; break;
-                    }
-                    enemyIt = enemies.erase(enemyIt);
-                    continue;
-                }
-                else {
-                    ++enemyIt;
-                }
-                break;
-            }
-            else {
-                ++enemyIt;
-            }
-        }
+// Перцентиль по времени кадров (массив переупорядочивается)
+double GetPercentile(std::vector<double>& values, double percentile) {
+    if (values.empty()) return 0.0;
+    size_t index = std::min(values.size() - 1, (size_t)(percentile * values.size()));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
 
-        if (bulletHit) {
-            bulletIt = bullets.erase(bulletIt);
+// Длительный безголовый прогон на автопилоте с максимальной скоростью.
+// Сборка мета-прогрессии задана уровнем всех улучшений; при смерти здоровье
+// восстанавливается (смерть считается), чтобы забег дошел до поздних волн.
+// По каждой волне пишется строка: время кадра (p50/p95/p99/max), пик памяти, сущности
+// --soak [часы] [уровень мета-улучшений] [последняя волна] [зерно]
+int RunSoakTest(int argc, char** argv) {
+    double hours = argc > 2 ? atof(argv[2]) : 1.0;
+    int metaLevel = argc > 3 ? atoi(argv[3]) : 20;
+    int lastWave = argc > 4 ? atoi(argv[4]) : 0;
+    unsigned int seed = argc > 5 ? (unsigned int)strtoul(argv[5], nullptr, 10) : 1;
+    TuningWatcher tuningWatcher;
+    StartTuning(argc, argv, &tuningWatcher);
+
+    MetaProgression meta = { 0, 0, metaLevel, metaLevel, metaLevel, metaLevel, metaLevel, true, true, true };
+    World world;
+    world.chunkGrid = CreateChunkGrid();
+    SystemScheduler schedule = CreateGameplaySchedule();
+    TaskPool pool;
+    StartTaskPool(pool, GetDefaultWorkerCount());
+    Joystick joystick = CreateJoystick();
+    StatsState stats;
+    ResetStats(stats);
+    GameSession session;
+    StartGameSession(session, world, &meta, 1, seed);
+    Player& player = world.players[0];
+
+    std::vector<double> frameTimes;
+    size_t maxEnemies = 0;
+    size_t maxBullets = 0;
+    size_t maxProjectiles = 0;
+    int deaths = 0;
+    int wave = session.waveNumber;
+    auto start = std::chrono::steady_clock::now();
+    auto deadline = start + std::chrono::duration<double>(hours * 3600.0);
+
+    printf("wave,sim_time_s,wall_time_s,frames,p50_ms,p95_ms,p99_ms,max_ms,peak_memory_mb,max_enemies,max_bullets,max_enemy_projectiles,deaths");
+    for (int tag = 0; tag < MEM_COUNT; tag++) {
+        printf(",%s_live_kb,%s_peak_kb", MEMORY_TAG_NAMES[tag], MEMORY_TAG_NAMES[tag]);
+    }
+    printf("\n");
+    for (;;) {
+        auto frameStart = std::chrono::steady_clock::now();
+        ApplyPendingTuning(world.players, world.playerCount);
+        UpdateAutopilot(joystick, player, world.archetypes, world.enemies, world.enemyProjectiles, world.upgrades);
+        PlayerInput input = SamplePlayerInput(joystick, false);
+        StepGameSession(session, world, schedule, pool, &input, &stats);
+        auto frameEnd = std::chrono::steady_clock::now();
+        frameTimes.push_back(std::chrono::duration<double, std::milli>(frameEnd - frameStart).count());
+
+        maxEnemies = std::max(maxEnemies, world.enemies.size());
+        maxBullets = std::max(maxBullets, world.bullets.size());
+        maxProjectiles = std::max(maxProjectiles, world.enemyProjectiles.size());
+
+        if (player.health <= 0) {
+            deaths++;
+            player.health = player.maxHealth;
         }
-        else {
-            ++bulletIt;
+
+        bool finished = frameEnd >= deadline || (lastWave > 0 && session.waveNumber > lastWave);
+        if (session.waveNumber != wave || finished) {
+            size_t frameCount = frameTimes.size();
+            double maxFrame = *std::max_element(frameTimes.begin(), frameTimes.end());
+            printf("%d,%.1f,%.1f,%zu,%.3f,%.3f,%.3f,%.3f,%.1f,%zu,%zu,%zu,%d", wave, session.gameTime,
+                std::chrono::duration<double>(frameEnd - start).count(), frameCount,
+                GetPercentile(frameTimes, 0.50), GetPercentile(frameTimes, 0.95), GetPercentile(frameTimes, 0.99), maxFrame,
+                GetPeakMemoryBytes() / (1024.0 * 1024.0), maxEnemies, maxBullets, maxProjectiles, deaths);
+            for (int tag = 0; tag < MEM_COUNT; tag++) {
+                printf(",%.1f,%.1f", GetMemoryLiveBytes((MemoryTag)tag) / 1024.0, GetMemoryPeakBytes((MemoryTag)tag) / 1024.0);
+            }
+            printf("\n");
+            fflush(stdout);
+
+            frameTimes.clear();
+            maxEnemies = maxBullets = maxProjectiles = 0;
+            wave = session.waveNumber;
         }
+
+        if (finished) break;
     }
 
-    // Шоквейвы - враги
-    for (auto waveIt = shockwaves.begin(); waveIt != shockwaves.end(); ++waveIt) {
-        for (auto enemyIt = enemies.begin(); enemyIt != enemies.end();) {
-            if (waveIt == shockwaves.end() || enemyIt == enemies.end()) break;
+    StopTuningWatcher(tuningWatcher);
+    StopTaskPool(pool);
+    PrintMemoryReport(stderr);
+    return 0;
+}
 
-            float distance = Vector2Distance(waveIt->position, enemyIt->position);
+// Проверка сетевой игры без сети: пиры и ретранслятор в одном процессе на 127.0.0.1.
+// Пиры по очереди делают шаг (ввод от автопилота), ретранслятор задерживает и теряет пакеты.
+// Окончательные контрольные суммы всех пиров должны совпасть между собой и с прогоном
+// того же ввода без сети и откатов
+// --net-selftest [игроки] [тики] [задержка в шагах] [потери %] [зерно]
+int RunNetSelfTest(int argc, char** argv) {
+    int playerCount = argc > 2 ? atoi(argv[2]) : 2;
+    int tickCount = argc > 3 ? atoi(argv[3]) : 3600;
+    int latencySteps = argc > 4 ? atoi(argv[4]) : 3;
+    int lossPercent = argc > 5 ? atoi(argv[5]) : 10;
+    unsigned int seed = argc > 6 ? (unsigned int)strtoul(argv[6], nullptr, 10) : 1;
+    playerCount = std::max(2, std::min(MAX_PLAYERS, playerCount));
+    tickCount = std::max(1, tickCount);
+    latencySteps = std::max(0, latencySteps);
+    lossPercent = std::max(0, std::min(90, lossPercent));
+
+    MetaProgression metas[MAX_PLAYERS];
+    for (int i = 0; i < MAX_PLAYERS; i++) {
+        metas[i] = { 0, 0, 5 * i, 5 * i, 5 * i, 5 * i, 5 * i, i > 0, i > 1, i > 2 };
+    }
 
-            if (distance < waveIt->radius + enemyIt->radius) {
-                enemyIt->health -= waveIt->damage;
+    SystemScheduler schedule = CreateGameplaySchedule();
+    TaskPool pool;
+    StartTaskPool(pool, GetDefaultWorkerCount());
+    StatsState stats;
+    ResetStats(stats);
+
+    NetRelay relay;
+    std::vector<NetPeer> peers(playerCount);
+    bool started = StartNetRelay(relay, latencySteps, lossPercent, seed ^ 0x5EEDu);
+    for (int i = 0; i < playerCount; i++) {
+        started = StartNetPeer(peers[i], i, playerCount, GetUdpPort(relay.socket), metas, seed) && started;
+    }
+    if (!started) {
+        printf("FAIL: cannot open loopback UDP sockets\n");
+        StopTaskPool(pool);
+        return 1;
+    }
 
-                if (enemyIt->health <= 0) {
-                    switch (enemyIt->type) {
-                    case ENEMY_GREEN: score += 10; break;
-                    case ENEMY_PURPLE: score += 20; break;
-                    case ENEMY_RED: score += 50; break;
+    // Окончательные суммы и ввод по тикам (индекс - тик - 1)
+    std::vector<std::vector<unsigned long long>> checksums(playerCount);
+    std::vector<std::vector<PlayerInput>> finalInputs(MAX_PLAYERS);
+    long long steps = 0;
+    const long long maxSteps = (long long)tickCount * 20 + 1000;
+    auto start = std::chrono::steady_clock::now();
+
+    for (;;) {
+        bool done = true;
+        for (int i = 0; i < playerCount; i++) {
+            NetPeer& peer = peers[i];
+            UpdateNetPeer(peer, schedule, pool, stats, true);
+
+            unsigned int finalTick = std::min(GetFinalTick(peer), (unsigned int)tickCount);
+            for (unsigned int tick = peer.verifiedTick + 1; tick <= finalTick; tick++) {
+                checksums[i].push_back(peer.checksums[tick & (NET_INPUT_HISTORY - 1)]);
+                if (i == 0) {
+                    for (int player = 0; player < playerCount; player++) {
+                        finalInputs[player].push_back(GetHistoryInput(peer.inputs[player], tick));
                     }
-                    enemyIt = enemies.erase(enemyIt);
-                    continue;
                 }
             }
-            ++enemyIt;
+            peer.verifiedTick = std::max(peer.verifiedTick, finalTick);
+            done = done && peer.verifiedTick >= (unsigned int)tickCount;
+        }
+        UpdateNetRelay(relay);
+        steps++;
+        if (done || steps >= maxSteps) break;
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    // Эталон: тот же ввод в одном мире без сети
+    World reference;
+    reference.camera = { { 0, 0 }, { WORLD_WIDTH / 2.0f, WORLD_HEIGHT / 2.0f }, 0.0f, 1.0f };
+    reference.chunkGrid = CreateChunkGrid();
+    GameSession referenceSession;
+    StartGameSession(referenceSession, reference, metas, playerCount, seed);
+    std::vector<unsigned long long> referenceChecksums;
+    PlayerInput inputs[MAX_PLAYERS];
+    for (size_t tick = 0; tick < checksums[0].size(); tick++) {
+        for (int player = 0; player < playerCount; player++) {
+            inputs[player] = finalInputs[player][tick];
+        }
+        StepGameSession(referenceSession, reference, schedule, pool, inputs, &stats);
+        referenceChecksums.push_back(ComputeWorldChecksum(reference, referenceSession));
+    }
+    StopTaskPool(pool);
+
+    bool passed = true;
+    int firstMismatch = -1;
+    for (int i = 0; i < playerCount; i++) {
+        if (checksums[i].size() < (size_t)tickCount) passed = false;
+        size_t common = std::min(checksums[i].size(), referenceChecksums.size());
+        for (size_t tick = 0; tick < common; tick++) {
+            if (checksums[i][tick] != referenceChecksums[tick]) {
+                passed = false;
+                if (firstMismatch < 0 || (int)tick + 1 < firstMismatch) firstMismatch = (int)tick + 1;
+                break;
+            }
         }
     }
 
-    // Бомбы - враги
-    for (auto bombIt = bombs.begin(); bombIt != bombs.end();) {
-        if (bombIt->exploded) {
-            for (auto enemyIt = enemies.begin(); enemyIt != enemies.end();) {
-                if (bombIt == bombs.end() || enemyIt == enemies.end()) break;
+    printf("Players: %d, ticks: %d, latency: %d steps, loss: %d%%, steps: %lld, %.1f ms\n", playerCount, tickCount,
+        latencySteps, lossPercent, steps, std::chrono::duration<double, std::milli>(end - start).count());
+    printf("Relay: %lld bytes forwarded, %lld packets dropped\n", relay.bytesForwarded, relay.packetsDropped);
+    for (int i = 0; i < playerCount; i++) {
+        const NetPeer& peer = peers[i];
+        printf("Peer %d: verified %u, sent %lld packets %lld bytes (%.1f bytes/tick), received %lld, "
+            "rollbacks %d, resimulated %lld ticks, stalls %lld, enemies %zu, wave %d\n",
+            i, peer.verifiedTick, peer.packetsSent, peer.bytesSent, peer.bytesSent / (double)std::max(1u, peer.session.tick),
+            peer.packetsReceived, peer.rollbacks, peer.resimulatedTicks, peer.stalls, peer.world.enemies.size(),
+            peer.session.waveNumber);
+    }
 
-                float distance = Vector2Distance(bombIt->position, enemyIt->position);
+    for (int i = 0; i < playerCount; i++) {
+        StopNetPeer(peers[i]);
+    }
+    StopNetRelay(relay);
 
-                if (distance < bombIt->explosionRadius + enemyIt->radius) {
-                    enemyIt->health -= bombIt->damage;
+    if (firstMismatch > 0) {
+        printf("FAIL: checksum mismatch at tick %d\n", firstMismatch);
+    }
+    else {
+        printf("%s: %zu ticks match across peers and the offline replay\n", passed ? "PASS" : "FAIL", referenceChecksums.size());
+    }
+    return passed ? 0 : 1;
+}
 
-                    if (enemyIt->health <= 0) {
-                        switch (enemyIt->type) {
-                        case ENEMY_GREEN: score += 10; break;
-                        case ENEMY_PURPLE: score += 20; break;
-                        case ENEMY_RED: score += 50; break;
-                        }
-                        enemyIt = enemies.erase(enemyIt);
-                        continue;
-                    }
-                }
-                ++enemyIt;
-            }
-            bombIt = bombs.erase(bombIt);
-        }
-        else {
-            ++bombIt;
-        }
+// Безголовый авторитетный сервер с синтетическими клиентами на 127.0.0.1 (окно и звук не создаются).
+// Клиенты ходят по кругу и принимают снимки с имитацией потерь; каждый разобранный снимок
+// сверяется с тем, что сервер отправил. Дополнительные враги раскладываются по всему миру,
+// чтобы проверить, что трафик на клиента не растет вместе с их числом
+// --server [клиенты] [тики] [дополнительные враги] [потери %]
+int RunServerTest(int argc, char** argv) {
+    int clientCount = argc > 2 ? atoi(argv[2]) : 2;
+    int tickCount = argc > 3 ? atoi(argv[3]) : 3600;
+    int extraEnemies = argc > 4 ? atoi(argv[4]) : 0;
+    int lossPercent = argc > 5 ? atoi(argv[5]) : 5;
+    clientCount = std::max(1, std::min(MAX_PLAYERS, clientCount));
+    tickCount = std::max(1, tickCount);
+    extraEnemies = std::max(0, extraEnemies);
+    lossPercent = std::max(0, std::min(90, lossPercent));
+
+    MetaProgression metas[MAX_PLAYERS];
+    for (int i = 0; i < MAX_PLAYERS; i++) {
+        metas[i] = { 0, 0, 20, 20, 20, 20, 20, true, true, true };
     }
 
-    // Фаерболы - враги
-    for (auto fireballIt = fireballs.begin(); fireballIt != fireballs.end();) {
-        if (fireballIt->exploded) {
-            for (auto enemyIt = enemies.begin(); enemyIt != enemies.end();) {
-                if (fireballIt == fireballs.end() || enemyIt == enemies.end()) break;
+    SystemScheduler schedule = CreateGameplaySchedule();
+    TaskPool pool;
+    StartTaskPool(pool, GetDefaultWorkerCount());
+    StatsState stats;
+    ResetStats(stats);
+
+    SnapshotServer server;
+    std::vector<SnapshotClient> clients(clientCount);
+    bool started = StartSnapshotServer(server, clientCount, metas, 1);
+    for (int i = 0; i < clientCount; i++) {
+        started = StartSnapshotClient(clients[i], GetUdpPort(server.socket), 1920.0f, 1080.0f) && started;
+    }
+    if (!started) {
+        printf("FAIL: cannot open loopback UDP sockets\n");
+        StopTaskPool(pool);
+        return 1;
+    }
 
-                float distance = Vector2Distance(fireballIt->position, enemyIt->position);
+    SimRandom random = CreateSimRandom(7);
+    for (int i = 0; i < extraEnemies; i++) {
+        Vector2 position = { (float)SimRandomValue(random, 0, (int)WORLD_WIDTH - 1), (float)SimRandomValue(random, 0, (int)WORLD_HEIGHT - 1) };
+        server.world.enemies.push_back(CreateEnemy(server.world.archetypes, (EnemyType)SimRandomValue(random, 0, 2), position, 1.0f, 1));
+    }
 
-                if (distance < fireballIt->explosionRadius + enemyIt->radius) {
-                    enemyIt->health -= fireballIt->damage;
+    // Клиенты представляются до первого тика, чтобы порядок игроков совпал с их номерами
+    for (int i = 0; i < clientCount; i++) {
+        SendClientInput(clients[i]);
+        while (server.clientCount <= i) {
+            ReceiveClientInputs(server);
+        }
+    }
 
-                    if (enemyIt->health <= 0) {
-                        switch (enemyIt->type) {
-                        case ENEMY_GREEN: score += 10; break;
-                        case ENEMY_PURPLE: score += 20; break;
-                        case ENEMY_RED: score += 50; break;
-                        }
-                        enemyIt = enemies.erase(enemyIt);
-                        continue;
-                    }
-                }
-                ++enemyIt;
+    long long mismatches = 0;
+    long long checked = 0;
+    long long deaths = 0;
+    double serverMs = 0.0;
+    auto start = std::chrono::steady_clock::now();
+    for (int tick = 1; tick <= tickCount; tick++) {
+        auto tickStart = std::chrono::steady_clock::now();
+        UpdateSnapshotServer(server, schedule, pool, stats);
+        serverMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tickStart).count();
+
+        // Сервер не заканчивает забег: погибший игрок восстанавливается
+        for (int i = 0; i < clientCount; i++) {
+            Player& player = server.world.players[i];
+            if (player.health <= 0) {
+                deaths++;
+                player.health = player.maxHealth;
             }
-            ++fireballIt;
         }
-        else {
-            bool hitEnemy = false;
-            for (auto enemyIt = enemies.begin(); enemyIt != enemies.end();) {
-                if (fireballIt == fireballs.end() || enemyIt == enemies.end()) break;
-
-                float distance = Vector2Distance(fireballIt->position, enemyIt->position);
-
-                if (distance < fireballIt->radius + enemyIt->radius) {
-                    enemyIt->health -= fireballIt->damage;
-                    hitEnemy = true;
 
-                    if (enemyIt->health <= 0) {
-                        switch (enemyIt->type) {
-                        case ENEMY_GREEN: score += 10; break;
-                        case ENEMY_PURPLE: score += 20; break;
-                        case ENEMY_RED: score += 50; break;
-                        }
-                        enemyIt = enemies.erase(enemyIt);
-                        continue;
-                    }
-                    break;
+        for (int i = 0; i < clientCount; i++) {
+            SnapshotClient& client = clients[i];
+            unsigned int latest = client.latestSequence;
+            ReceiveSnapshots(client, random, lossPercent);
+
+            if (client.latestSequence != latest) {
+                const EntitySnapshot& decoded = client.received[client.latestSequence & (SNAPSHOT_HISTORY - 1)];
+                const EntitySnapshot& sent = server.clients[i].sent[client.latestSequence & (SNAPSHOT_HISTORY - 1)];
+                bool same = sent.sequence == decoded.sequence && sent.entities.size() == decoded.entities.size() &&
+                    sent.score == decoded.score && sent.waveNumber == decoded.waveNumber;
+                for (size_t e = 0; same && e < sent.entities.size(); e++) {
+                    const SnapshotEntity& a = sent.entities[e];
+                    const SnapshotEntity& b = decoded.entities[e];
+                    same = a.id == b.id && a.x == b.x && a.y == b.y && a.health == b.health && a.kind == b.kind;
                 }
-                ++enemyIt;
+                checked++;
+                if (!same) mismatches++;
             }
 
-            if (hitEnemy) {
-                fireballIt->exploded = true;
-                ++fireballIt;
-            }
-            else {
-                ++fireballIt;
-            }
+            float angle = tick * 0.01f + i * 1.5f;
+            client.input = { (signed char)lroundf(cosf(angle) * 127.0f), (signed char)lroundf(sinf(angle) * 127.0f) };
+            SendClientInput(client);
         }
     }
+    auto end = std::chrono::steady_clock::now();
+    StopTaskPool(pool);
+
+    long long decodeErrors = 0;
+    printf("Clients: %d, ticks: %d, enemies: %zu, wave %d, loss: %d%%, server %.3f ms/tick, total %.1f ms, deaths %lld\n",
+        clientCount, tickCount, server.world.enemies.size(), server.session.waveNumber, lossPercent, serverMs / tickCount,
+        std::chrono::duration<double, std::milli>(end - start).count(), deaths);
+    for (int i = 0; i < clientCount; i++) {
+        const SnapshotClient& client = clients[i];
+        const ServerClient& sent = server.clients[i];
+        const EntitySnapshot& latest = client.received[client.latestSequence & (SNAPSHOT_HISTORY - 1)];
+        printf("Client %d: sent %.1f bytes/tick (max packet %d), received %lld packets %.1f bytes/tick, "
+            "full snapshots %lld, decode errors %lld, entities in view %zu\n",
+            i, sent.bytesSent / (double)tickCount, sent.maxPacket, client.packetsReceived, client.bytesReceived / (double)tickCount,
+            client.fullSnapshots, client.decodeErrors, latest.entities.size());
+        decodeErrors += client.decodeErrors;
+    }
 
-    // Вражеские снаряды - игрок
-    for (auto& enemy : enemies) {
-        for (auto projIt = enemy.projectiles.begin(); projIt != enemy.projectiles.end();) {
-            float distance = Vector2Distance(projIt->position, player.position);
-
-            if (distance < projIt->radius + player.radius) {
-                player.health -= projIt->damage;
-                projIt = enemy.projectiles.erase(projIt);
-            }
-            else {
-                ++projIt;
-            }
-        }
+    for (int i = 0; i < clientCount; i++) {
+        StopSnapshotClient(clients[i]);
     }
+    StopSnapshotServer(server);
 
-    // Враги - игрок (ближний бой)
-    for (auto& enemy : enemies) {
-        float distance = Vector2Distance(enemy.position, player.position);
+    bool passed = mismatches == 0 && decodeErrors == 0 && checked > 0;
+    printf("%s: %lld snapshots decoded, %lld mismatches\n", passed ? "PASS" : "FAIL", checked, mismatches);
+    return passed ? 0 : 1;
+}
 
-        if (distance < enemy.radius + player.radius) {
-            player.health -= enemy.damage;
-        }
-    }
+// Пакетный прогон баланса: множество безголовых забегов на автопилоте до смерти игрока
+// (или до лимита времени) для каждой сборки мета-улучшений. Забеги раздаются пулу задач
+// по одному; у каждого потока свой мир и свое расписание систем, системы внутри забега
+// идут последовательно. Забег i каждой сборки использует одно и то же зерно, поэтому
+// сборки сравниваются на одинаковых волнах
+const int BALANCE_DEFAULT_LEVELS[] = { 0, 5, 10, 20 };
 
-    // Улучшения - игрок
-    for (auto upgradeIt = upgrades.begin(); upgradeIt != upgrades.end();) {
-        float distance = Vector2Distance(upgradeIt->position, player.position);
+struct BalanceBuild {
+    char name[32];
+    MetaProgression meta;
+};
 
-        if (distance < upgradeIt->radius + player.radius) {
-            ApplyUpgrade(*upgradeIt, player, meta);
-            upgradeIt = upgrades.erase(upgradeIt);
-        }
-        else {
-            ++upgradeIt;
-        }
+struct BalanceRun {
+    int build;
+    unsigned int seed;
+    int waveReached;
+    double timeSurvived;
+    int pointsEarned;
+    bool timedOut;
+};
+
+struct BalanceBatch {
+    const BalanceBuild* builds;
+    BalanceRun* runs;
+    int runCount;
+    unsigned int maxTicks;
+    World* worlds;                    // По потоку пула
+    SystemScheduler* schedules;
+    TaskPool* pools;                  // Без рабочих потоков: системы забега идут в потоке задачи
+    std::atomic<int> finished;
+};
+
+// Сборка "здоровье/урон/скорость/скорость атаки/снаряды/bfw" (bfw - 0/1 для бомбы, заморозки, волны)
+bool ParseBalanceBuild(const char* text, BalanceBuild& build) {
+    int levels[5];
+    char abilities[4] = { '0', '0', '0', 0 };
+    int fields = sscanf(text, "%d/%d/%d/%d/%d/%3[01]", &levels[0], &levels[1], &levels[2], &levels[3], &levels[4], abilities);
+    if (fields < 5) return false;
+    for (int i = 0; i < 5; i++) {
+        if (levels[i] < 0) return false;
     }
+
+    build.meta = { 0, 0, levels[0], levels[1], levels[2], levels[3], levels[4],
+        abilities[0] == '1', abilities[1] == '1', abilities[2] == '1' };
+    snprintf(build.name, sizeof(build.name), "%d/%d/%d/%d/%d/%c%c%c", levels[0], levels[1], levels[2], levels[3], levels[4],
+        abilities[0], abilities[1], abilities[2]);
+    return true;
 }
 
-// Функции для меню улучшений (расширенное с бесконечной прокачкой)
-void DrawUpgradeMenu(MetaProgression& meta, Button& healthButton, Button& damageButton, Button& speedButton,
-    Button& attackSpeedButton, Button& projectileCountButton, Button& bombAbilityButton,
-    Button& freezeAbilityButton, Button& waveAbilityButton, Button& resetButton, Button& backButton) {
-    BeginDrawing();
-    ClearBackground(BLACK);
+void RunBalanceTask(void* context, int index, int worker) {
+    BalanceBatch& batch = *(BalanceBatch*)context;
+    BalanceRun& run = batch.runs[index];
+    World& world = batch.worlds[worker];
 
-    int screenWidth = GetScreenWidth();
-    int screenHeight = GetScreenHeight();
+    GameSession session;
+    StartGameSession(session, world, &batch.builds[run.build].meta, 1, run.seed);
+    Joystick joystick = CreateJoystick();
+    Player& player = world.players[0];
 
-    DrawText("UPGRADES", screenWidth / 2 - MeasureText("UPGRADES", 40) / 2, 30, 40, WHITE);
-    DrawText(TextFormat("Available Points: %d", meta.availablePoints), screenWidth / 2 - MeasureText(TextFormat("Available Points: %d", meta.availablePoints), 25) / 2, 90, 25, YELLOW);
-    DrawText(TextFormat("Total Points: %d", meta.totalPoints), screenWidth / 2 - MeasureText(TextFormat("Total Points: %d", meta.totalPoints), 20) / 2, 120, 20, LIGHTGRAY);
+    while (player.health > 0 && session.tick < batch.maxTicks) {
+        UpdateAutopilot(joystick, player, world.archetypes, world.enemies, world.enemyProjectiles, world.upgrades);
+        PlayerInput input = SamplePlayerInput(joystick, false);
+        StepGameSession(session, world, batch.schedules[worker], batch.pools[worker], &input, nullptr);
+    }
 
-    int yPos = 160;
+    run.waveReached = session.waveNumber;
+    run.timeSurvived = session.gameTime;
+    run.pointsEarned = GetPointsEarned(session.score);
+    run.timedOut = player.health > 0;
 
-    // Кнопка здоровья (бесконечная)
-    healthButton.bounds = { static_cast<float>(screenWidth) / 2 - 150, static_cast<float>(yPos), 300, 40 };
-    if (meta.availablePoints >= meta.GetHealthCost()) {
-        healthButton.text = TextFormat("Health (Level %d) - Cost: %d", meta.healthLevel, meta.GetHealthCost());
-        DrawButton(healthButton);
-    }
-    else {
-        healthButton.text = TextFormat("Health (Level %d) - Need: %d", meta.healthLevel, meta.GetHealthCost());
-        DrawRectangleRec(healthButton.bounds, COLOR_UPGRADE_BUTTON_MAXED);
-        DrawRectangleLinesEx(healthButton.bounds, 2, WHITE);
-        DrawText(healthButton.text, healthButton.bounds.x + (healthButton.bounds.width - MeasureText(healthButton.text, 18)) / 2,
-            healthButton.bounds.y + (healthButton.bounds.height - 18) / 2, 18, GRAY);
+    int finished = batch.finished.fetch_add(1) + 1;
+    if (finished * 10 / batch.runCount != (finished - 1) * 10 / batch.runCount) {
+        fprintf(stderr, "balance: %d/%d runs\n", finished, batch.runCount);
     }
-    yPos += 50;
+}
 
-    // Кнопка урона (бесконечная)
-    damageButton.bounds = { static_cast<float>(screenWidth) / 2 - 150, static_cast<float>(yPos), 300, 40 };
-    if (meta.availablePoints >= meta.GetDamageCost()) {
-        damageButton.text = TextFormat("Damage (Level %d) - Cost: %d", meta.damageLevel, meta.GetDamageCost());
-        DrawButton(damageButton);
+// Распределение значения по сборке: среднее и перцентили
+void WriteBalanceDistribution(FILE* file, std::vector<double>& values) {
+    double sum = 0.0;
+    for (double value : values) sum += value;
+    fprintf(file, ",%.2f,%.2f,%.2f,%.2f,%.2f,%.2f", sum / values.size(),
+        GetPercentile(values, 0.10), GetPercentile(values, 0.50), GetPercentile(values, 0.90),
+        *std::min_element(values.begin(), values.end()), *std::max_element(values.begin(), values.end()));
+}
+
+// --balance [забегов на сборку] [лимит забега, мин] [файл.csv] [сборка;сборка;...]
+// Без списка сборок - сетка: одинаковый уровень всех улучшений 0/5/10/20, без способностей и со всеми
+int RunBalanceBatch(int argc, char** argv) {
+    int runsPerBuild = argc > 2 ? atoi(argv[2]) : 100;
+    double maxMinutes = argc > 3 ? atof(argv[3]) : 20.0;
+    const char* outputPath = argc > 4 ? argv[4] : "balance.csv";
+    runsPerBuild = std::max(1, runsPerBuild);
+    maxMinutes = std::max(0.1, maxMinutes);
+    // Настройки читаются один раз: все забеги пакета идут на одних и тех же числах
+    StartTuning(argc, argv, nullptr);
+
+    std::vector<BalanceBuild> builds;
+    if (argc > 5) {
+        std::string list = argv[5];
+        size_t begin = 0;
+        while (begin <= list.size()) {
+            size_t end = list.find(';', begin);
+            if (end == std::string::npos) end = list.size();
+            std::string text = list.substr(begin, end - begin);
+            BalanceBuild build;
+            if (!text.empty()) {
+                if (!ParseBalanceBuild(text.c_str(), build)) {
+                    fprintf(stderr, "Bad build '%s' (expected health/damage/speed/attackSpeed/projectiles/bfw)\n", text.c_str());
+                    return 1;
+                }
+                builds.push_back(build);
+            }
+            begin = end + 1;
+        }
     }
     else {
-        damageButton.text = TextFormat("Damage (Level %d) - Need: %d", meta.damageLevel, meta.GetDamageCost());
-        DrawRectangleRec(damageButton.bounds, COLOR_UPGRADE_BUTTON_MAXED);
-        DrawRectangleLinesEx(damageButton.bounds, 2, WHITE);
-        DrawText(damageButton.text, damageButton.bounds.x + (damageButton.bounds.width - MeasureText(damageButton.text, 18)) / 2,
-            damageButton.bounds.y + (damageButton.bounds.height - 18) / 2, 18, GRAY);
+        for (int abilities = 0; abilities < 2; abilities++) {
+            for (int level : BALANCE_DEFAULT_LEVELS) {
+                BalanceBuild build;
+                char text[32];
+                snprintf(text, sizeof(text), "%d/%d/%d/%d/%d/%s", level, level, level, level, level / 5, abilities ? "111" : "000");
+                ParseBalanceBuild(text, build);
+                builds.push_back(build);
+            }
+        }
     }
-    yPos += 50;
+    if (builds.empty()) return 1;
 
-    // Кнопка скорости (бесконечная)
-    speedButton.bounds = { static_cast<float>(screenWidth) / 2 - 150, static_cast<float>(yPos), 300, 40 };
-    if (meta.availablePoints >= meta.GetSpeedCost()) {
-        speedButton.text = TextFormat("Speed (Level %d) - Cost: %d", meta.speedLevel, meta.GetSpeedCost());
-        DrawButton(speedButton);
+    std::vector<BalanceRun> runs;
+    for (int build = 0; build < (int)builds.size(); build++) {
+        for (int i = 0; i < runsPerBuild; i++) {
+            runs.push_back({ build, (unsigned int)(i + 1), 0, 0.0, 0, false });
+        }
     }
-    else {
-        speedButton.text = TextFormat("Speed (Level %d) - Need: %d", meta.speedLevel, meta.GetSpeedCost());
-        DrawRectangleRec(speedButton.bounds, COLOR_UPGRADE_BUTTON_MAXED);
-        DrawRectangleLinesEx(speedButton.bounds, 2, WHITE);
-        DrawText(speedButton.text, speedButton.bounds.x + (speedButton.bounds.width - MeasureText(speedButton.text, 18)) / 2,
-            speedButton.bounds.y + (speedButton.bounds.height - 18) / 2, 18, GRAY);
+
+    TaskPool pool;
+    int workerCount = GetDefaultWorkerCount();
+    StartTaskPool(pool, workerCount);
+    std::vector<World> worlds(workerCount + 1);
+    std::vector<SystemScheduler> schedules(workerCount + 1);
+    std::vector<TaskPool> runPools(workerCount + 1);
+    for (int worker = 0; worker <= workerCount; worker++) {
+        worlds[worker].camera = { { 0, 0 }, { WORLD_WIDTH / 2.0f, WORLD_HEIGHT / 2.0f }, 0.0f, 1.0f };
+        worlds[worker].chunkGrid = CreateChunkGrid();
+        schedules[worker] = CreateGameplaySchedule();
+        StartTaskPool(runPools[worker], 0);
     }
-    yPos += 50;
 
-    // Кнопка скорости атаки (бесконечная)
-    attackSpeedButton.bounds = { static_cast<float>(screenWidth) / 2 - 150, static_cast<float>(yPos), 300, 40 };
-    if (meta.availablePoints >= meta.GetAttackSpeedCost()) {
-        attackSpeedButton.text = TextFormat("Attack Speed (Level %d) - Cost: %d", meta.attackSpeedLevel, meta.GetAttackSpeedCost());
-        DrawButton(attackSpeedButton);
+    BalanceBatch batch;
+    batch.builds = builds.data();
+    batch.runs = runs.data();
+    batch.runCount = (int)runs.size();
+    batch.maxTicks = (unsigned int)(maxMinutes * 60.0 * SIM_TICK_RATE);
+    batch.worlds = worlds.data();
+    batch.schedules = schedules.data();
+    batch.pools = runPools.data();
+    batch.finished = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    RunTasks(pool, RunBalanceTask, &batch, batch.runCount);
+    auto end = std::chrono::steady_clock::now();
+    StopTaskPool(pool);
+
+    FILE* file = fopen(outputPath, "w");
+    if (!file) {
+        fprintf(stderr, "Cannot write %s\n", outputPath);
+        return 1;
     }
-    else {
-        attackSpeedButton.text = TextFormat("Attack Speed (Level %d) - Need: %d", meta.attackSpeedLevel, meta.GetAttackSpeedCost());
-        DrawRectangleRec(attackSpeedButton.bounds, COLOR_UPGRADE_BUTTON_MAXED);
-        DrawRectangleLinesEx(attackSpeedButton.bounds, 2, WHITE);
-        DrawText(attackSpeedButton.text, attackSpeedButton.bounds.x + (attackSpeedButton.bounds.width - MeasureText(attackSpeedButton.text, 18)) / 2,
-            attackSpeedButton.bounds.y + (attackSpeedButton.bounds.height - 18) / 2, 18, GRAY);
+    fprintf(file, "build,health,damage,speed,attack_speed,projectiles,bomb_ability,freeze_ability,wave_ability,runs,timeouts");
+    const char* metrics[] = { "wave", "time_s", "points" };
+    for (const char* metric : metrics) {
+        fprintf(file, ",%s_mean,%s_p10,%s_p50,%s_p90,%s_min,%s_max", metric, metric, metric, metric, metric, metric);
     }
-    yPos += 50;
+    fprintf(file, "\n");
+
+    std::vector<double> waves;
+    std::vector<double> times;
+    std::vector<double> points;
+    for (int build = 0; build < (int)builds.size(); build++) {
+        const MetaProgression& meta = builds[build].meta;
+        waves.clear();
+        times.clear();
+        points.clear();
+        int timeouts = 0;
+        for (const BalanceRun& run : runs) {
+            if (run.build != build) continue;
+            waves.push_back(run.waveReached);
+            times.push_back(run.timeSurvived);
+            points.push_back(run.pointsEarned);
+            if (run.timedOut) timeouts++;
+        }
 
-    // Кнопка количества снарядов (бесконечная)
-    projectileCountButton.bounds = { static_cast<float>(screenWidth) / 2 - 150, static_cast<float>(yPos), 300, 40 };
-    if (meta.availablePoints >= meta.GetProjectileCountCost()) {
-        projectileCountButton.text = TextFormat("Projectiles (Level %d) - Cost: %d", meta.projectileCountLevel, meta.GetProjectileCountCost());
-        DrawButton(projectileCountButton);
-    }
-    else {
-        projectileCountButton.text = TextFormat("Projectiles (Level %d) - Need: %d", meta.projectileCountLevel, meta.GetProjectileCountCost());
-        DrawRectangleRec(projectileCountButton.bounds, COLOR_UPGRADE_BUTTON_MAXED);
-        DrawRectangleLinesEx(projectileCountButton.bounds, 2, WHITE);
-        DrawText(projectileCountButton.text, projectileCountButton.bounds.x + (projectileCountButton.bounds.width - MeasureText(projectileCountButton.text, 18)) / 2,
-            projectileCountButton.bounds.y + (projectileCountButton.bounds.height - 18) / 2, 18, GRAY);
+        fprintf(file, "%s,%d,%d,%d,%d,%d,%d,%d,%d,%zu,%d", builds[build].name, meta.healthLevel, meta.damageLevel, meta.speedLevel,
+            meta.attackSpeedLevel, meta.projectileCountLevel, meta.hasBombAbility, meta.hasFreezeAbility, meta.hasWaveAbility,
+            waves.size(), timeouts);
+        WriteBalanceDistribution(file, waves);
+        WriteBalanceDistribution(file, times);
+        WriteBalanceDistribution(file, points);
+        fprintf(file, "\n");
+
+        printf("%-24s wave p50 %5.1f  time p50 %7.1f s  points p50 %6.1f  timeouts %d\n", builds[build].name,
+            GetPercentile(waves, 0.50), GetPercentile(times, 0.50), GetPercentile(points, 0.50), timeouts);
     }
-    yPos += 60;
+    fclose(file);
 
-    // Премиум способности (покупаются один раз)
-    DrawText("Premium Abilities:", 50, yPos, 22, GOLD);
-    yPos += 35;
+    double seconds = std::chrono::duration<double>(end - start).count();
+    printf("%d runs on %d threads in %.1f s (%.1f runs/s), written to %s\n", batch.runCount, workerCount + 1, seconds,
+        batch.runCount / seconds, outputPath);
+    return 0;
+}
 
-    // Бомба
-    bombAbilityButton.bounds = { static_cast<float>(screenWidth) / 2 - 150, static_cast<float>(yPos), 300, 40 };
-    if (!meta.hasBombAbility) {
-        if (meta.availablePoints >= meta.GetBombAbilityCost()) {
-            bombAbilityButton.text = TextFormat("Bomb Ability - Cost: %d", meta.GetBombAbilityCost());
-            DrawButton(bombAbilityButton);
-        }
-        else {
-            bombAbilityButton.text = TextFormat("Bomb Ability - Need: %d", meta.GetBombAbilityCost());
-            DrawRectangleRec(bombAbilityButton.bounds, COLOR_UPGRADE_BUTTON_MAXED);
-            DrawRectangleLinesEx(bombAbilityButton.bounds, 2, WHITE);
-            DrawText(bombAbilityButton.text, bombAbilityButton.bounds.x + (bombAbilityButton.bounds.width - MeasureText(bombAbilityButton.text, 18)) / 2,
-                bombAbilityButton.bounds.y + (bombAbilityButton.bounds.height - 18) / 2, 18, GRAY);
-        }
+// Основная функция игры
+int main(int argc, char** argv) {
+    if (argc > 1 && strcmp(argv[1], "--bench-enemies") == 0) {
+        return RunEnemyBenchmark(argc, argv);
     }
-    else {
-        bombAbilityButton.text = "Bomb Ability - PURCHASED";
-        DrawRectangleRec(bombAbilityButton.bounds, COLOR_UPGRADE_BUTTON_MAXED);
-        DrawRectangleLinesEx(bombAbilityButton.bounds, 2, WHITE);
-        DrawText(bombAbilityButton.text, bombAbilityButton.bounds.x + (bombAbilityButton.bounds.width - MeasureText(bombAbilityButton.text, 18)) / 2,
-            bombAbilityButton.bounds.y + (bombAbilityButton.bounds.height - 18) / 2, 18, GREEN);
+    if (argc > 1 && strcmp(argv[1], "--bench-wave") == 0) {
+        return RunWaveBenchmark(argc, argv);
     }
-    yPos += 50;
-
-    // Заморозка
-    freezeAbilityButton.bounds = { static_cast<float>(screenWidth) / 2 - 150, static_cast<float>(yPos), 300, 40 };
-    if (!meta.hasFreezeAbility) {
-        if (meta.availablePoints >= meta.GetFreezeAbilityCost()) {
-            freezeAbilityButton.text = TextFormat("Freeze Ability - Cost: %d", meta.GetFreezeAbilityCost());
-            DrawButton(freezeAbilityButton);
-        }
-        else {
-            freezeAbilityButton.text = TextFormat("Freeze Ability - Need: %d", meta.GetFreezeAbilityCost());
-            DrawRectangleRec(freezeAbilityButton.bounds, COLOR_UPGRADE_BUTTON_MAXED);
-            DrawRectangleLinesEx(freezeAbilityButton.bounds, 2, WHITE);
-            DrawText(freezeAbilityButton.text, freezeAbilityButton.bounds.x + (freezeAbilityButton.bounds.width - MeasureText(freezeAbilityButton.text, 18)) / 2,
-                freezeAbilityButton.bounds.y + (freezeAbilityButton.bounds.height - 18) / 2, 18, GRAY);
-        }
+    if (argc > 1 && strcmp(argv[1], "--soak") == 0) {
+        return RunSoakTest(argc, argv);
     }
-    else {
-        freezeAbilityButton.text = "Freeze Ability - PURCHASED";
-        DrawRectangleRec(freezeAbilityButton.bounds, COLOR_UPGRADE_BUTTON_MAXED);
-        DrawRectangleLinesEx(freezeAbilityButton.bounds, 2, WHITE);
-        DrawText(freezeAbilityButton.text, freezeAbilityButton.bounds.x + (freezeAbilityButton.bounds.width - MeasureText(freezeAbilityButton.text, 18)) / 2,
-            freezeAbilityButton.bounds.y + (freezeAbilityButton.bounds.height - 18) / 2, 18, GREEN);
+    if (argc > 1 && strcmp(argv[1], "--net-selftest") == 0) {
+        return RunNetSelfTest(argc, argv);
     }
-    yPos += 50;
-
-    // Волна
-    waveAbilityButton.bounds = { static_cast<float>(screenWidth) / 2 - 150, static_cast<float>(yPos), 300, 40 };
-    if (!meta.hasWaveAbility) {
-        if (meta.availablePoints >= meta.GetWaveAbilityCost()) {
-            waveAbilityButton.text = TextFormat("Wave Ability - Cost: %d", meta.GetWaveAbilityCost());
-            DrawButton(waveAbilityButton);
-        }
-        else {
-            waveAbilityButton.text = TextFormat("Wave Ability - Need: %d", meta.GetWaveAbilityCost());
-            DrawRectangleRec(waveAbilityButton.bounds, COLOR_UPGRADE_BUTTON_MAXED);
-            DrawRectangleLinesEx(waveAbilityButton.bounds, 2, WHITE);
-            DrawText(waveAbilityButton.text, waveAbilityButton.bounds.x + (waveAbilityButton.bounds.width - MeasureText(waveAbilityButton.text, 18)) / 2,
-                waveAbilityButton.bounds.y + (waveAbilityButton.bounds.height - 18) / 2, 18, GRAY);
+    if (argc > 1 && strcmp(argv[1], "--server") == 0) {
+        return RunServerTest(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "--balance") == 0) {
+        return RunBalanceBatch(argc, argv);
+    }
+    // --audio-selftest [секунд на уровень]: проверка микшера без звукового устройства
+    if (argc > 1 && strcmp(argv[1], "--audio-selftest") == 0) {
+        return RunAudioSelfTest(argc, argv);
+    }
+    // --build-pack [файл.pak] [ресурсы...]: собрать пакет ресурсов для отображения в память
+    if (argc > 1 && strcmp(argv[1], "--build-pack") == 0) {
+        return RunBuildAssetPack(argc, argv);
+    }
+    // --dump-tuning [файл]: записать настройки по умолчанию как образец для правки
+    if (argc > 1 && strcmp(argv[1], "--dump-tuning") == 0) {
+        const char* path = argc > 2 ? argv[2] : "tuning.cfg";
+        if (!SaveTuningConfig(path, defaultTuning)) {
+            fprintf(stderr, "cannot write %s\n", path);
+            return 1;
         }
+        return 0;
     }
-    else {
-        waveAbilityButton.text = "Wave Ability - PURCHASED";
-        DrawRectangleRec(waveAbilityButton.bounds, COLOR_UPGRADE_BUTTON_MAXED);
-        DrawRectangleLinesEx(waveAbilityButton.bounds, 2, WHITE);
-        DrawText(waveAbilityButton.text, waveAbilityButton.bounds.x + (waveAbilityButton.bounds.width - MeasureText(waveAbilityButton.text, 18)) / 2,
-            waveAbilityButton.bounds.y + (waveAbilityButton.bounds.height - 18) / 2, 18, GREEN);
+
+    // --autopilot: игрок управляется автопилотом (переключение F2)
+    bool autopilot = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--autopilot") == 0) autopilot = true;
     }
-    yPos += 70;
 
-    // Кнопка сброса прогресса
-    resetButton.bounds = { static_cast<float>(screenWidth) / 2 - 150, static_cast<float>(yPos), 300, 40 };
-    resetButton.text = "Reset Progress (Get 50% points back)";
-    DrawButton(resetButton);
-    yPos += 60;
+    // --schedule-graph файл.dot: граф систем последнего кадра при выходе
+    const char* scheduleGraphPath = GetArgValue(argc, argv, "--schedule-graph");
 
-    // Кнопка назад
-    backButton.bounds = { static_cast<float>(screenWidth) / 2 - 100, static_cast<float>(yPos), 200, 50 };
-    backButton.text = "Back to Menu";
-    DrawButton(backButton);
+    // --trace файл.json: таймлайн кадров для chrome://tracing или ui.perfetto.dev
+    const char* tracePath = GetArgValue(argc, argv, "--trace");
+    if (tracePath != nullptr && !OpenTrace(tracePath)) {
+        TraceLog(LOG_WARNING, "TRACE: cannot open %s", tracePath);
+    }
 
-    // Отображение текущих бонусов
-    DrawText(TextFormat("Current Bonuses:"), 50, screenHeight - 150, 20, WHITE);
-    DrawText(TextFormat("Health: +%.0f%%", (meta.GetHealthBonus() - 1.0f) * 100), 70, screenHeight - 120, 18, GREEN);
-    DrawText(TextFormat("Damage: +%.0f%%", (meta.GetDamageBonus() - 1.0f) * 100), 70, screenHeight - 95, 18, ORANGE);
-    DrawText(TextFormat("Speed: +%.0f%%", (meta.GetSpeedBonus() - 1.0f) * 100), 70, screenHeight - 70, 18, WHITE);
-    DrawText(TextFormat("Attack Speed: +%.0f%%", (meta.GetAttackSpeedBonus() - 1.0f) * 100), 70, screenHeight - 45, 18, SKYBLUE);
-    DrawText(TextFormat("Projectile Count: %d", meta.GetProjectileCount()), 70, screenHeight - 20, 18, GOLD);
+    // --render-scale 0.5..1: постоянная доля разрешения мира вместо динамической
+    const char* renderScaleArg = GetArgValue(argc, argv, "--render-scale");
+    float fixedRenderScale = renderScaleArg != nullptr ? (float)atof(renderScaleArg) : 0.0f;
 
-    EndDrawing();
-}
+    // --tuning файл: настройки баланса, перечитываются при сохранении файла
+    TuningWatcher tuningWatcher;
+    StartTuning(argc, argv, &tuningWatcher);
 
-// Основная функция игры
-int main() {
     SetConfigFlags(FLAG_FULLSCREEN_MODE);
     InitWindow(0, 0, "Survival Shooter");
-    SetTargetFPS(TARGET_FPS);
+    // Без ограничителя raylib: иначе его ожидание попадает внутрь EndDrawing и в замер
+    // динамического разрешения. Кадры выравнивает WaitFrameBudget
+    SetTargetFPS(0);
     HideCursor();
 
+    // --assets файл.pak: пакет ресурсов, грузится в фоне, пока показывается меню
+    StartupReport startup = CreateStartupReport();
+    startup.windowSeconds = GetStartupSeconds();
+    const char* assetPackPath = GetArgValue(argc, argv, "--assets");
+    AssetLoader assets;
+    StartAssetLoader(assets, assetPackPath != nullptr ? assetPackPath : "assets.pak");
+    bool assetsApplied = false;
+
+    // --mute: микшер работает с пустым выводом
+    bool mute = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--mute") == 0) mute = true;
+    }
+    if (!mute) {
+        InitAudioDevice();
+    }
+    AudioSystem audio;
+
     GameState gameState = MAIN_MENU;
     MetaProgression meta = { 0, 0, 0, 0, 0, 0, 0, false, false, false };
 
@@ -1535,33 +7956,50 @@ int main() {
     Button resetButton = { { 0, 0, 0, 0 }, "", false };
     Button backButton = { { 0, 0, 0, 0 }, "", false };
 
+    UpgradeMenuCache upgradeMenuCache = CreateUpgradeMenuCache();
+
     Button confirmResetButton = { { 0, 0, 0, 0 }, "Confirm Reset", false };
     Button cancelResetButton = { { 0, 0, 0, 0 }, "Cancel", false };
 
-    Player player;
+    World world;
+    world.camera = { { 0, 0 }, { WORLD_WIDTH / 2.0f, WORLD_HEIGHT / 2.0f }, 0.0f, 1.0f };
+    world.chunkGrid = CreateChunkGrid();
+    Player& player = world.players[0];
+    Camera2D& camera = world.camera;
+    SystemScheduler gameplaySchedule = CreateGameplaySchedule();
+    TaskPool taskPool;
+    StartTaskPool(taskPool, GetDefaultWorkerCount());
     Joystick joystick;
-    std::vector<Bullet> bullets;
-    std::vector<Enemy> enemies;
-    std::vector<Upgrade> upgrades;
-    std::vector<Shockwave> shockwaves;
-    std::vector<Bomb> bombs;
-    std::vector<FreezeArea> freezeAreas;
-    std::vector<Fireball> fireballs;
-
-    double lastEnemySpawnTime = 0;
-    double enemySpawnCooldown = 2.0;
-    int score = 0;
-    double gameTime = 0;
-    float difficultyScale = 0.0f;
-    int waveNumber = 1;
-    int enemiesPerWave = 5;
-    int enemiesSpawnedThisWave = 0;
-    bool waveInProgress = false;
-
-    while (!WindowShouldClose()) {
-        double currentTime = GetTime();
-        double deltaTime = GetFrameTime();
-        deltaTime = std::min(deltaTime, 0.1);
+    ParticleSystem particles = CreateParticleSystem();
+    DynamicResolution resolution = CreateDynamicResolution(fixedRenderScale);
+    double renderSeconds = 0.0;
+
+    GameSession session;
+    StartGameSession(session, world, &meta, 1, (unsigned int)GetRandomValue(1, 0x7FFFFFFF));
+    StatsState stats;
+    ResetStats(stats);
+    bool showStats = false;
+
+    FrameCounter frames = { 0, 0, 0 };
+    MenuRedrawState menuRedraw = { false, false, MAIN_MENU, 0 };
+    bool exitRequested = false;
+
+    while (!exitRequested && !WindowShouldClose()) {
+        auto frameStart = std::chrono::steady_clock::now();
+        frames.loopIterations++;
+        bool assetsDone = UpdateAssetLoader(assets);
+        if (assetsDone && !assetsApplied) {
+            Texture2D particleTexture;
+            if (FindAssetTexture(assets, "particle", particleTexture)) {
+                UseParticleTexture(particles, particleTexture);
+            }
+            StartAudio(audio, assets, !mute && IsAudioDeviceReady() ? AUDIO_OUTPUT_DEVICE : AUDIO_OUTPUT_NULL);
+            assetsApplied = true;
+        }
+        UpdatePresentationMode(menuRedraw, gameState, !assetsDone);
+
+        double frameTime = GetFrameTime();
+        double deltaTime = std::min(frameTime, 0.1);
 
         switch (gameState) {
         case MAIN_MENU: {
@@ -1569,25 +8007,12 @@ int main() {
             IsButtonHovered(upgradeButton);
             IsButtonHovered(exitButton);
 
-            if (IsButtonClicked(startButton)) {
+            if (assetsDone && IsButtonClicked(startButton)) {
                 try {
-                    player = CreatePlayer(meta);
+                    StartGameSession(session, world, &meta, 1, (unsigned int)GetRandomValue(1, 0x7FFFFFFF));
+                    ResetStats(stats);
                     joystick = CreateJoystick();
-                    bullets.clear();
-                    enemies.clear();
-                    upgrades.clear();
-                    shockwaves.clear();
-                    bombs.clear();
-                    freezeAreas.clear();
-                    fireballs.clear();
-                    score = 0;
-                    gameTime = 0;
-                    difficultyScale = 0.0f;
-                    waveNumber = 1;
-                    enemiesPerWave = 5;
-                    enemiesSpawnedThisWave = 0;
-                    waveInProgress = true;
-                    lastEnemySpawnTime = 0;
+                    particles.count = 0;
                     gameState = PLAYING;
                 }
                 catch (...) {
@@ -1600,8 +8025,18 @@ int main() {
             }
 
             if (IsButtonClicked(exitButton)) {
-                CloseWindow();
-                return 0;
+                exitRequested = true;
+                break;
+            }
+
+            int loadPercent = (int)(GetAssetLoadProgress(assets) * 100.0f);
+            unsigned int mainSignature = MetaSignature(0, meta);
+            mainSignature = HashCombine(mainSignature, assetsDone ? 101u : (unsigned int)loadPercent);
+            mainSignature = ButtonSignature(mainSignature, startButton);
+            mainSignature = ButtonSignature(mainSignature, upgradeButton);
+            mainSignature = ButtonSignature(mainSignature, exitButton);
+            if (!MenuNeedsRedraw(menuRedraw, MAIN_MENU, mainSignature, frames)) {
+                break;
             }
 
             BeginDrawing();
@@ -1617,11 +8052,17 @@ int main() {
             upgradeButton.bounds = { static_cast<float>(screenWidth) / 2 - 100, static_cast<float>(screenHeight) / 2 + 50, 200, 50 };
             exitButton.bounds = { static_cast<float>(screenWidth) / 2 - 100, static_cast<float>(screenHeight) / 2 + 125, 200, 50 };
 
+            startButton.text = assetsDone ? "Start Game" : "Loading...";
             DrawButton(startButton);
             DrawButton(upgradeButton);
             DrawButton(exitButton);
+            if (!assetsDone) {
+                const char* loadingText = TextFormat("Loading resources %d%%", loadPercent);
+                DrawText(loadingText, screenWidth / 2 - MeasureText(loadingText, 20) / 2, screenHeight / 2 - 60, 20, LIGHTGRAY);
+            }
 
             EndDrawing();
+            MarkStartupFrame(startup, assets, assetsDone);
             break;
         }
 
@@ -1637,6 +8078,8 @@ int main() {
             IsButtonHovered(resetButton);
             IsButtonHovered(backButton);
 
+            unsigned int metaBeforeClicks = MetaSignature(0, meta);
+
             // Бесконечные улучшения
             if (IsButtonClicked(healthButton) && meta.availablePoints >= meta.GetHealthCost()) {
                 meta.availablePoints -= meta.GetHealthCost();
@@ -1679,6 +8122,10 @@ int main() {
                 meta.hasWaveAbility = true;
             }
 
+            if (MetaSignature(0, meta) != metaBeforeClicks) {
+                InvalidateUpgradeMenu(upgradeMenuCache);
+            }
+
             if (IsButtonClicked(resetButton)) {
                 gameState = RESET_CONFIRM;
             }
@@ -1687,9 +8134,24 @@ int main() {
                 gameState = MAIN_MENU;
             }
 
+            unsigned int upgradeSignature = MetaSignature(0, meta);
+            upgradeSignature = ButtonSignature(upgradeSignature, healthButton);
+            upgradeSignature = ButtonSignature(upgradeSignature, damageButton);
+            upgradeSignature = ButtonSignature(upgradeSignature, speedButton);
+            upgradeSignature = ButtonSignature(upgradeSignature, attackSpeedButton);
+            upgradeSignature = ButtonSignature(upgradeSignature, projectileCountButton);
+            upgradeSignature = ButtonSignature(upgradeSignature, bombAbilityButton);
+            upgradeSignature = ButtonSignature(upgradeSignature, freezeAbilityButton);
+            upgradeSignature = ButtonSignature(upgradeSignature, waveAbilityButton);
+            upgradeSignature = ButtonSignature(upgradeSignature, resetButton);
+            upgradeSignature = ButtonSignature(upgradeSignature, backButton);
+            if (!MenuNeedsRedraw(menuRedraw, UPGRADE_MENU, upgradeSignature, frames)) {
+                break;
+            }
+
             DrawUpgradeMenu(meta, healthButton, damageButton, speedButton, attackSpeedButton,
                 projectileCountButton, bombAbilityButton, freezeAbilityButton,
-                waveAbilityButton, resetButton, backButton);
+                waveAbilityButton, resetButton, backButton, upgradeMenuCache);
             break;
         }
 
@@ -1705,6 +8167,7 @@ int main() {
 
             if (IsButtonClicked(confirmResetButton)) {
                 meta.ResetProgress();
+                InvalidateUpgradeMenu(upgradeMenuCache);
                 gameState = UPGRADE_MENU;
             }
 
@@ -1712,6 +8175,13 @@ int main() {
                 gameState = UPGRADE_MENU;
             }
 
+            unsigned int resetSignature = MetaSignature(0, meta);
+            resetSignature = ButtonSignature(resetSignature, confirmResetButton);
+            resetSignature = ButtonSignature(resetSignature, cancelResetButton);
+            if (!MenuNeedsRedraw(menuRedraw, RESET_CONFIRM, resetSignature, frames)) {
+                break;
+            }
+
             BeginDrawing();
             ClearBackground(BLACK);
 
@@ -1729,131 +8199,158 @@ int main() {
         }
 
         case PLAYING: {
-            gameTime += deltaTime;
-            difficultyScale = std::min(1.0f, (float)gameTime / 300.0f);
+            TraceBegin("Frame");
 
-            UpdateJoystick(joystick);
-
-            // Система волн с бесконечным усложнением
-            if (enemies.empty() && !waveInProgress) {
-                waveNumber++;
-                enemiesPerWave = 5 + waveNumber * 2;
-                enemiesSpawnedThisWave = 0;
-                waveInProgress = true;
-                lastEnemySpawnTime = currentTime;
+            if (IsKeyPressed(KEY_F2)) {
+                autopilot = !autopilot;
             }
 
-            // Спавн врагов в волнах
-            if (waveInProgress && currentTime - lastEnemySpawnTime > enemySpawnCooldown && enemiesSpawnedThisWave < enemiesPerWave) {
-                Vector2 spawnPos;
-                int side = GetRandomValue(0, 3);
-
-                screenWidth = GetScreenWidth();
-                screenHeight = GetScreenHeight();
-
-                switch (side) {
-                case 0: spawnPos = { (float)GetRandomValue(0, screenWidth), -20 }; break;
-                case 1: spawnPos = { (float)screenWidth + 20, (float)GetRandomValue(0, screenHeight) }; break;
-                case 2: spawnPos = { (float)GetRandomValue(0, screenWidth), (float)screenHeight + 20 }; break;
-                case 3: spawnPos = { -20, (float)GetRandomValue(0, screenHeight) }; break;
-                }
-
-                int enemyType = GetRandomValue(0, 2);
-                // Передаем waveNumber для бесконечного усложнения
-                enemies.push_back(CreateEnemy((EnemyType)enemyType, spawnPos, difficultyScale, waveNumber));
-
-                lastEnemySpawnTime = currentTime;
-                enemiesSpawnedThisWave++;
-
-                if (enemiesSpawnedThisWave >= enemiesPerWave) {
-                    waveInProgress = false;
-                }
-
-                enemySpawnCooldown = std::max(0.3, enemySpawnCooldown * 0.99);
+            TraceBegin("UpdateJoystick");
+            if (autopilot) {
+                UpdateAutopilot(joystick, player, world.archetypes, world.enemies, world.enemyProjectiles, world.upgrades);
             }
-
-            // Спавн улучшений
-            if (GetRandomValue(0, 1000) < 2) {
-                screenWidth = GetScreenWidth();
-                screenHeight = GetScreenHeight();
-                Vector2 spawnPos = {
-                    (float)GetRandomValue(50, screenWidth - 50),
-                    (float)GetRandomValue(50, screenHeight - 50)
-                };
-                upgrades.push_back(CreateUpgrade(spawnPos));
+            else {
+                UpdateJoystick(joystick);
             }
-
-            // Обновление игровых объектов
-            UpdatePlayer(player, joystick, currentTime, bullets, enemies, shockwaves, bombs, freezeAreas, fireballs);
-            UpdateBullets(bullets);
-            UpdateEnemies(enemies, player, currentTime, freezeAreas);
-            UpdateShockwaves(shockwaves);
-            UpdateBombs(bombs, deltaTime);
-            UpdateFreezeAreas(freezeAreas, deltaTime);
-            UpdateFireballs(fireballs, enemies, deltaTime);
-
-            CheckCollisions(player, bullets, enemies, upgrades, shockwaves, bombs, freezeAreas, fireballs, score, meta);
-
-            // Дополнительные очки за выживание
-            score += (int)(deltaTime);
+            TraceEnd("UpdateJoystick");
+
+            // Фиксированный шаг: время кадра копится и расходуется целыми тиками,
+            // поэтому результат не зависит от частоты кадров
+            session.tickAccumulator += deltaTime;
+            int ticks = 0;
+            if (ApplyPendingTuning(world.players, world.playerCount)) {
+                TraceLog(LOG_INFO, "TUNING: new values applied at tick %u", session.tick);
+            }
+            PlayerInput input = SamplePlayerInput(joystick, true);
+            while (session.tickAccumulator >= SIM_TICK_SECONDS && ticks < MAX_TICKS_PER_FRAME && player.health > 0) {
+                StepGameSession(session, world, gameplaySchedule, taskPool, &input, &stats);
+                ConsumeEffectEvents(session.eventBatch, particles);
+                ConsumeAudioEvents(session.eventBatch, audio, camera.target.x, screenWidth * 0.5f / camera.zoom);
+                session.tickAccumulator -= SIM_TICK_SECONDS;
+                ticks++;
+            }
+            session.tickAccumulator = std::min(session.tickAccumulator, SIM_TICK_SECONDS);
+            Rectangle view = GetCameraView(camera);
+
+            TraceCounter("enemies", (long long)world.enemies.size());
+            TraceCounter("bullets", (long long)world.bullets.size());
+            TraceCounter("enemyProjectiles", (long long)world.enemyProjectiles.size());
+            TraceCounter("upgrades", (long long)world.upgrades.size());
+            TraceCounter("shockwaves", (long long)world.shockwaves.size());
+            TraceCounter("bombs", (long long)world.bombs.size());
+            TraceCounter("freezeAreas", (long long)world.freezeAreas.size());
+            TraceCounter("fireballs", (long long)world.fireballs.size());
+            TraceCounter("particles", (long long)particles.count);
+
+            EmitFireballTrails(particles, world.fireballs);
+            TraceBegin("UpdateParticles");
+            UpdateParticles(particles, (float)deltaTime);
+            TraceEnd("UpdateParticles");
 
             if (player.health <= 0) {
-                int pointsEarned = std::max(1, score / 10); // Очки основаны на score
-                meta.AddPoints(pointsEarned);
+                meta.AddPoints(GetPointsEarned(session.score));
+                InvalidateUpgradeMenu(upgradeMenuCache);
                 gameState = GAME_OVER;
             }
 
+            // Мир - в текстуру пониженного разрешения, интерфейс - поверх в родном
+            UpdateDynamicResolution(resolution, renderSeconds);
+            auto renderStart = std::chrono::steady_clock::now();
+            BeginTextureMode(resolution.target);
+            ClearBackground(BLACK);
+
+            BeginMode2D(GetRenderCamera(resolution, camera));
+
+            TraceBegin("DrawWorldBackground");
+            DrawWorldBackground(view);
+            TraceEnd("DrawWorldBackground");
+            TraceBegin("DrawShockwaves");
+            DrawShockwaves(world.shockwaves, view);
+            TraceEnd("DrawShockwaves");
+            TraceBegin("DrawBombs");
+            DrawBombs(world.bombs, view, session.tick);
+            TraceEnd("DrawBombs");
+            TraceBegin("DrawFreezeAreas");
+            DrawFreezeAreas(world.freezeAreas, view);
+            TraceEnd("DrawFreezeAreas");
+            TraceBegin("DrawFireballs");
+            DrawFireballs(world.fireballs, view);
+            TraceEnd("DrawFireballs");
+            TraceBegin("DrawParticles");
+            DrawParticles(particles, view);
+            TraceEnd("DrawParticles");
+            TraceBegin("DrawBullets");
+            DrawBullets(world.bullets, view);
+            TraceEnd("DrawBullets");
+            TraceBegin("DrawEnemyProjectiles");
+            DrawEnemyProjectiles(world.enemyProjectiles, view);
+            TraceEnd("DrawEnemyProjectiles");
+            TraceBegin("DrawEnemies");
+            DrawEnemies(world.enemies, world.archetypes, view);
+            DrawStatusEffects(world.statuses, world.enemies, view);
+            TraceEnd("DrawEnemies");
+            TraceBegin("DrawUpgrades");
+            DrawUpgrades(world.upgrades, view);
+            TraceEnd("DrawUpgrades");
+            TraceBegin("DrawPlayer");
+            for (int i = 0; i < world.playerCount; i++) {
+                DrawPlayer(world.players[i], view);
+            }
+            TraceEnd("DrawPlayer");
+
+            EndMode2D();
+            EndTextureMode();
+
             BeginDrawing();
             ClearBackground(BLACK);
+            TraceBegin("DrawRenderTarget");
+            DrawRenderTarget(resolution);
+            TraceEnd("DrawRenderTarget");
 
-            DrawShockwaves(shockwaves);
-            DrawBombs(bombs);
-            DrawFreezeAreas(freezeAreas);
-            DrawFireballs(fireballs);
-            DrawBullets(bullets);
-            DrawEnemies(enemies);
-            DrawUpgrades(upgrades);
-            DrawPlayer(player);
+            TraceBegin("DrawJoystick");
             DrawJoystick(joystick);
+            TraceEnd("DrawJoystick");
+
+            frames.presentedFrames++;
 
             // Отрисовка UI
-            DrawText(TextFormat("Health: %d/%d", player.health, player.maxHealth), 10, 10, 20, WHITE);
-            DrawText(TextFormat("Score: %d", score), 10, 40, 20, WHITE);
-            DrawText(TextFormat("Time: %.1f", gameTime), 10, 70, 20, WHITE);
-            DrawText(TextFormat("Wave: %d", waveNumber), 10, 100, 20, ORANGE);
-            DrawText(TextFormat("Enemies: %d/%d", enemies.size(), enemiesPerWave), 10, 130, 20, ORANGE);
-            DrawText(TextFormat("Projectiles: %d", player.projectileCount), 10, 160, 20, GOLD);
+            float uiScale = GetUiScale();
+            DrawHudText(TextFormat("Health: %d/%d", player.health, player.maxHealth), 10, uiScale, WHITE);
+            DrawHudText(TextFormat("Score: %d", session.score), 40, uiScale, WHITE);
+            DrawHudText(TextFormat("Time: %.1f", session.gameTime), 70, uiScale, WHITE);
+            DrawHudText(TextFormat("Wave: %d", session.waveNumber), 100, uiScale, ORANGE);
+            DrawHudText(TextFormat("Enemies: %d/%d", (int)world.enemies.size(), session.enemiesPerWave), 130, uiScale, ORANGE);
+            DrawHudText(TextFormat("Projectiles: %d", player.projectileCount), 160, uiScale, GOLD);
 
             int yPos = 190;
-            if (player.hasWaveAttack) {
-                double waveCooldownRemaining = player.waveCooldown - (currentTime - player.lastWaveTime);
-                if (waveCooldownRemaining < 0) waveCooldownRemaining = 0;
-                DrawText(TextFormat("Wave: %.1f", waveCooldownRemaining), 10, yPos, 20, COLOR_UPGRADE_WAVE);
-                yPos += 25;
-            }
-            if (player.hasBombAttack) {
-                double bombCooldownRemaining = player.bombCooldown - (currentTime - player.lastBombTime);
-                if (bombCooldownRemaining < 0) bombCooldownRemaining = 0;
-                DrawText(TextFormat("Bomb: %.1f", bombCooldownRemaining), 10, yPos, 20, COLOR_UPGRADE_BOMB);
-                yPos += 25;
-            }
-            if (player.hasFreezeAttack) {
-                double freezeCooldownRemaining = player.freezeCooldown - (currentTime - player.lastFreezeTime);
-                if (freezeCooldownRemaining < 0) freezeCooldownRemaining = 0;
-                DrawText(TextFormat("Freeze: %.1f", freezeCooldownRemaining), 10, yPos, 20, COLOR_UPGRADE_FREEZE);
+            ForEachAbility([&](auto ability) {
+                typedef decltype(ability) Ability;
+                if (!GetAbilityState<Ability>(player).owned) return;
+                double cooldownRemaining = GetCooldownRemaining(player, AbilityIdOf<Ability>(), session.tick);
+                DrawHudText(TextFormat("%s: %.1f", Ability::Name(), cooldownRemaining), yPos, uiScale, Ability::HudColor());
                 yPos += 25;
+            });
+            if (player.hasDoubleShot) {
+                DrawHudText("Double Shot", yPos, uiScale, COLOR_UPGRADE_DOUBLE_SHOT);
             }
-            if (player.hasFireballAttack) {
-                double fireballCooldownRemaining = player.fireballCooldown - (currentTime - player.lastFireballTime);
-                if (fireballCooldownRemaining < 0) fireballCooldownRemaining = 0;
-                DrawText(TextFormat("Fireball: %.1f", fireballCooldownRemaining), 10, yPos, 20, COLOR_UPGRADE_FIREBALL);
-                yPos += 25;
+
+            if (IsKeyPressed(KEY_F3)) {
+                showStats = !showStats;
             }
-            if (player.hasDoubleShot) {
-                DrawText("Double Shot", 10, yPos, 20, COLOR_UPGRADE_DOUBLE_SHOT);
+            if (showStats) {
+                DrawStatsOverlay(stats);
+                const char* renderText = TextFormat("Render %dx%d (%d%%), draw %.1f ms", GetWorldRenderWidth(resolution),
+                    GetWorldRenderHeight(resolution), (int)(resolution.scale * 100.0f + 0.5f), resolution.frameMs);
+                DrawText(renderText, GetScreenWidth() - MeasureText(renderText, 20) - 10, GetScreenHeight() - 30, 20, LIGHTGRAY);
             }
+            TraceCounter("renderScalePercent", (long long)(resolution.scale * 100.0f + 0.5f));
 
+            TraceBegin("EndDrawing");
             EndDrawing();
+            TraceEnd("EndDrawing");
+            renderSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - renderStart).count();
+            TraceEnd("Frame");
+            FlushTrace();
             break;
         }
 
@@ -1869,23 +8366,10 @@ int main() {
 
             if (IsButtonClicked(restartButton)) {
                 try {
-                    player = CreatePlayer(meta);
+                    StartGameSession(session, world, &meta, 1, (unsigned int)GetRandomValue(1, 0x7FFFFFFF));
+                    ResetStats(stats);
                     joystick = CreateJoystick();
-                    bullets.clear();
-                    enemies.clear();
-                    upgrades.clear();
-                    shockwaves.clear();
-                    bombs.clear();
-                    freezeAreas.clear();
-                    fireballs.clear();
-                    score = 0;
-                    gameTime = 0;
-                    difficultyScale = 0.0f;
-                    waveNumber = 1;
-                    enemiesPerWave = 5;
-                    enemiesSpawnedThisWave = 0;
-                    waveInProgress = true;
-                    lastEnemySpawnTime = 0;
+                    particles.count = 0;
                     gameState = PLAYING;
                 }
                 catch (...) {
@@ -1897,16 +8381,25 @@ int main() {
                 gameState = MAIN_MENU;
             }
 
+            unsigned int gameOverSignature = HashCombine(0, (unsigned int)session.score);
+            gameOverSignature = HashCombine(gameOverSignature, (unsigned int)session.waveNumber);
+            gameOverSignature = ButtonSignature(gameOverSignature, restartButton);
+            gameOverSignature = ButtonSignature(gameOverSignature, menuButton);
+            if (!MenuNeedsRedraw(menuRedraw, GAME_OVER, gameOverSignature, frames)) {
+                break;
+            }
+
             BeginDrawing();
             ClearBackground(BLACK);
 
             DrawRectangle(0, 0, screenWidth, screenHeight, { 0, 0, 0, 200 });
 
             DrawText("GAME OVER", screenWidth / 2 - MeasureText("GAME OVER", 50) / 2, 150, 50, RED);
-            DrawText(TextFormat("Final Score: %d", score), screenWidth / 2 - MeasureText(TextFormat("Final Score: %d", score), 30) / 2, 220, 30, WHITE);
-            DrawText(TextFormat("Survival Time: %.1f seconds", gameTime), screenWidth / 2 - MeasureText(TextFormat("Survival Time: %.1f seconds", gameTime), 25) / 2, 260, 25, WHITE);
-            DrawText(TextFormat("Wave Reached: %d", waveNumber), screenWidth / 2 - MeasureText(TextFormat("Wave Reached: %d", waveNumber), 25) / 2, 290, 25, ORANGE);
-            DrawText(TextFormat("Points Earned: %d", std::max(1, score / 10)), screenWidth / 2 - MeasureText(TextFormat("Points Earned: %d", std::max(1, score / 10)), 25) / 2, 320, 25, YELLOW);
+            DrawText(TextFormat("Final Score: %d", session.score), screenWidth / 2 - MeasureText(TextFormat("Final Score: %d", session.score), 30) / 2, 220, 30, WHITE);
+            DrawText(TextFormat("Survival Time: %.1f seconds", session.gameTime), screenWidth / 2 - MeasureText(TextFormat("Survival Time: %.1f seconds", session.gameTime), 25) / 2, 260, 25, WHITE);
+            DrawText(TextFormat("Wave Reached: %d", session.waveNumber), screenWidth / 2 - MeasureText(TextFormat("Wave Reached: %d", session.waveNumber), 25) / 2, 290, 25, ORANGE);
+            DrawText(TextFormat("Points Earned: %d", std::max(1, session.score / 10)), screenWidth / 2 - MeasureText(TextFormat("Points Earned: %d", std::max(1, session.score / 10)), 25) / 2, 320, 25, YELLOW);
+            DrawText(TextFormat("Kills: %d", session.runStats.kills[ENEMY_GREEN] + session.runStats.kills[ENEMY_PURPLE] + session.runStats.kills[ENEMY_RED]), screenWidth / 2 - MeasureText(TextFormat("Kills: %d", session.runStats.kills[ENEMY_GREEN] + session.runStats.kills[ENEMY_PURPLE] + session.runStats.kills[ENEMY_RED]), 25) / 2, 350, 25, LIGHTGRAY);
 
             DrawButton(restartButton);
             DrawButton(menuButton);
@@ -1915,8 +8408,28 @@ int main() {
             break;
         }
         }
+
+        WaitFrameBudget(frameStart);
     }
 
+    TraceLog(LOG_INFO, "FRAMES: loop iterations: %lld, presented: %lld, skipped idle menu frames: %lld, upgrade menu static redraws: %lld",
+        frames.loopIterations, frames.presentedFrames, frames.skippedFrames, upgradeMenuCache.staticRedraws);
+
+    if (scheduleGraphPath != nullptr && WriteScheduleGraph(gameplaySchedule, scheduleGraphPath)) {
+        TraceLog(LOG_INFO, "SCHEDULE: graph written to %s", scheduleGraphPath);
+    }
+
+    StopTuningWatcher(tuningWatcher);
+    StopTaskPool(taskPool);
+    CloseTrace();
+    StopAudio(audio);
+    if (IsAudioDeviceReady()) {
+        CloseAudioDevice();
+    }
+    UnloadParticleSystem(particles);
+    UnloadDynamicResolution(resolution);
+    UnloadAssets(assets);
+    UnloadUpgradeMenuCache(upgradeMenuCache);
     CloseWindow();
     return 0;
-}
\ No newline at end of file
+}
\ No newline at end of file